@@ -0,0 +1,76 @@
+#include "Rename/Batch.h"
+#include "Rename/Utility.h"
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Twine.h>
+
+#include <algorithm>
+#include <tuple>
+
+using llvm::StringRef;
+
+namespace rn {
+
+std::string parseRenameList(StringRef Buffer,
+                            std::vector<SymbolData> &Symbols) {
+  unsigned LineNumber = 0;
+  while (!Buffer.empty()) {
+    StringRef Line;
+    std::tie(Line, Buffer) = Buffer.split('\n');
+    ++LineNumber;
+    Line = Line.trim();
+    if (Line.empty() || Line.startswith("#"))
+      continue;
+
+    const auto Error = [&](StringRef Message) {
+      return ("line " + llvm::Twine(LineNumber) + ": " + Message).str();
+    };
+    // The new name is the last word, so a USR may contain spaces
+    const auto Split = Line.find_last_of(" \t");
+    if (Split == StringRef::npos)
+      return Error("no new name provided");
+    const auto Target = Line.substr(0, Split).rtrim();
+    const auto NewName = Line.substr(Split + 1);
+
+    if (Target.startswith("usr:")) {
+      const auto USR = Target.drop_front(4);
+      if (USR.empty())
+        return Error("empty USR");
+      Symbols.emplace_back(std::string(), 0, 0, NewName.str());
+      Symbols.back().USR = USR;
+      Symbols.back().Spelling = getSpellingFromUSR(USR);
+      continue;
+    }
+
+    // <file>:<line>:<column>, where the file may contain colons too
+    StringRef File, LineText, ColumnText;
+    std::tie(File, ColumnText) = Target.rsplit(':');
+    std::tie(File, LineText) = File.rsplit(':');
+    unsigned SymbolLine, SymbolColumn;
+    if (File.empty() || LineText.getAsInteger(10, SymbolLine) ||
+        ColumnText.getAsInteger(10, SymbolColumn) || SymbolLine == 0 ||
+        SymbolColumn == 0)
+      return Error("expected <file>:<line>:<column> or usr:<USR>");
+    Symbols.emplace_back(File.str(), SymbolLine, SymbolColumn, NewName.str());
+  }
+  return std::string();
+}
+
+std::string removeDuplicateSymbols(std::vector<SymbolData> &Symbols) {
+  llvm::StringMap<const SymbolData *> Seen;
+  std::vector<SymbolData> Unique;
+  for (auto &Data : Symbols) {
+    const auto Inserted = Seen.insert(std::make_pair(Data.USR, &Data));
+    if (Inserted.second) {
+      Unique.push_back(Data);
+      continue;
+    }
+    const auto &Other = *Inserted.first->second;
+    if (Other.NewSpelling != Data.NewSpelling)
+      return "'" + Data.USR + "' is renamed to both '" + Other.NewSpelling +
+             "' and '" + Data.NewSpelling + "'";
+  }
+  Symbols = std::move(Unique);
+  return std::string();
+}
+}
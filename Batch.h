@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Rename/Handlers.h"
+
+#include <llvm/ADT/StringRef.h>
+
+#include <string>
+#include <vector>
+
+namespace rn {
+
+// Reads a list of renames, one per line, in either form:
+//
+//   <file>:<line>:<column> <new name>
+//   usr:<USR> <new name>
+//
+// Blank lines and lines starting with '#' are ignored. The symbols given by
+// location still have to be located, and those given by USR have no
+// Spelling. Returns an error message, or an empty string on success.
+std::string parseRenameList(::llvm::StringRef Buffer,
+                            std::vector<SymbolData> &Symbols);
+
+// Drops the symbols that appear more than once with the same new name.
+// Returns an error message if a symbol is given two different new names, or
+// an empty string on success.
+std::string removeDuplicateSymbols(std::vector<SymbolData> &Symbols);
+}
@@ -0,0 +1,164 @@
+#include "Rename/Cache.h"
+#include "Rename/Parallel.h"
+
+#include <clang/Basic/DiagnosticOptions.h>
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/CompilerInvocation.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <algorithm>
+#include <map>
+
+using clang::ASTUnit;
+using clang::CompilerInstance;
+using clang::CompilerInvocation;
+using clang::DiagnosticOptions;
+using clang::DiagnosticsEngine;
+using clang::PCHContainerOperations;
+using clang::tooling::CompilationDatabase;
+using clang::tooling::CompileCommand;
+using clang::tooling::getAbsolutePath;
+
+using llvm::StringRef;
+
+namespace rn {
+
+ASTCache::ASTCache(const CompilationDatabase &Compilations, unsigned Capacity)
+    : Compilations(Compilations), Capacity(std::max(1u, Capacity)),
+      DiagConsumer(nullptr),
+      PCHContainerOps(std::make_shared<PCHContainerOperations>()) {}
+
+bool ASTCache::get(StringRef File, std::vector<ASTUnit *> &ASTs) {
+  ASTs.clear();
+  const auto Path = getAbsolutePath(File);
+
+  // Taken before parsing, so a file that changes meanwhile is seen as changed
+  const auto StampTime = getStampTime();
+  auto Found = Lookup.find(Path);
+  if (Found != Lookup.end()) {
+    Entries.splice(Entries.begin(), Entries, Found->second);
+    auto &E = Entries.front();
+    if (isStale(E)) {
+      // Only what follows the preamble is parsed again, unless one of the
+      // files it includes changed too
+      const bool Failed = std::any_of(
+          E.ASTs.begin(), E.ASTs.end(), [&](std::unique_ptr<ASTUnit> &AST) {
+            return AST->Reparse(PCHContainerOps, llvm::None);
+          });
+      if (Failed) {
+        Lookup.erase(Path);
+        Entries.pop_front();
+        return false;
+      }
+      recordInputs(E, StampTime);
+    }
+  } else {
+    Entry E;
+    E.File = Path;
+    for (const auto &Command : Compilations.getCompileCommands(Path)) {
+      auto AST = parse(Command);
+      if (!AST)
+        return false;
+      E.ASTs.push_back(std::move(AST));
+    }
+    if (E.ASTs.empty())
+      return false;
+    recordInputs(E, StampTime);
+    Entries.push_front(std::move(E));
+    Lookup[Path] = Entries.begin();
+    while (Entries.size() > Capacity) {
+      Lookup.erase(Entries.back().File);
+      Entries.pop_back();
+    }
+  }
+
+  for (const auto &AST : Entries.front().ASTs)
+    ASTs.push_back(AST.get());
+  return true;
+}
+
+bool ASTCache::contains(StringRef File) const {
+  return Lookup.count(getAbsolutePath(File)) != 0;
+}
+
+std::unique_ptr<ASTUnit> ASTCache::parse(const CompileCommand &Command) {
+  const auto Args = getSyntaxOnlyArgs(Command);
+  std::vector<const char *> Argv;
+  for (const auto &Arg : Args)
+    Argv.push_back(Arg.c_str());
+
+  static int StaticSymbol;
+  const auto ResourcesPath =
+      CompilerInvocation::GetResourcesPath(Argv.front(), &StaticSymbol);
+  llvm::IntrusiveRefCntPtr<DiagnosticsEngine> Diags =
+      CompilerInstance::createDiagnostics(new DiagnosticOptions, DiagConsumer,
+                                          /*ShouldOwnClient=*/false);
+
+  // The files are volatile, since they are expected to change while they're
+  // cached
+  return std::unique_ptr<ASTUnit>(ASTUnit::LoadFromCommandLine(
+      Argv.data(), Argv.data() + Argv.size(), PCHContainerOps, Diags,
+      ResourcesPath, /*OnlyLocalDecls=*/false, /*CaptureDiagnostics=*/false,
+      /*RemappedFiles=*/llvm::None, /*RemappedFilesKeepOriginalName=*/true,
+      /*PrecompilePreambleAfterNParses=*/1, clang::TU_Complete,
+      /*CacheCodeCompletionResults=*/false,
+      /*IncludeBriefCommentsInCodeCompletion=*/false,
+      /*AllowPCHWithCompilerErrors=*/false, /*SkipFunctionBodies=*/false,
+      /*UserFilesAreVolatile=*/true));
+}
+
+bool ASTCache::isStale(const Entry &E) const {
+  return std::any_of(E.Inputs.begin(), E.Inputs.end(),
+                     [&](const std::pair<std::string, FileStamp> &Input) {
+                       return hasChanged(Input.first, Input.second,
+                                         E.StampTime);
+                     });
+}
+
+void ASTCache::recordInputs(Entry &E, uint64_t StampTime) {
+  // The contents the ASTs were parsed from, when they still have them. The
+  // files in the preamble are read again.
+  std::map<std::string, const llvm::MemoryBuffer *> Contents;
+  for (const auto &AST : E.ASTs) {
+    const auto &SourceMgr = AST->getSourceManager();
+    auto Record = [&](const clang::SrcMgr::SLocEntry &SLoc) {
+      if (!SLoc.isFile())
+        return;
+      const auto *Content = SLoc.getFile().getContentCache();
+      if (Content == nullptr || Content->OrigEntry == nullptr)
+        return;
+      llvm::SmallString<256> Path(Content->OrigEntry->getName());
+      AST->getFileManager().makeAbsolutePath(Path);
+      auto &Buffer = Contents[Path.str()];
+      if (Buffer == nullptr)
+        Buffer = Content->getRawBuffer();
+    };
+    // The files in the preamble are only in the loaded entries
+    for (unsigned I = 0, N = SourceMgr.local_sloc_entry_size(); I < N; ++I)
+      Record(SourceMgr.getLocalSLocEntry(I));
+    for (unsigned I = 0, N = SourceMgr.loaded_sloc_entry_size(); I < N; ++I) {
+      bool Invalid = false;
+      const auto &SLoc = SourceMgr.getLoadedSLocEntry(I, &Invalid);
+      if (!Invalid)
+        Record(SLoc);
+    }
+  }
+
+  E.StampTime = StampTime;
+  E.Inputs.clear();
+  for (const auto &Content : Contents) {
+    FileStamp Stamp;
+    if (Content.second != nullptr
+            ? stampFile(Content.first, Content.second->getBuffer(), Stamp)
+            : stampFile(Content.first, Stamp))
+      E.Inputs.emplace_back(Content.first, Stamp);
+  }
+}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Rename/Digest.h"
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Frontend/PCHContainerOperations.h>
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rn {
+
+// Keeps the ASTs of the most recently used files alive between renames, for
+// long running processes. The files are parsed with a precompiled preamble,
+// so reparsing one after it was edited only reparses what follows its
+// #includes.
+class ASTCache {
+public:
+  // Capacity is the number of files whose ASTs are kept.
+  ASTCache(const ::clang::tooling::CompilationDatabase &Compilations,
+           unsigned Capacity);
+
+  // The consumer has to outlive the cache.
+  void setDiagnosticConsumer(::clang::DiagnosticConsumer *Consumer) {
+    DiagConsumer = Consumer;
+  }
+
+  // Sets ASTs to the ASTs of File (one per compile command), parsing it, or
+  // reparsing it if it or one of the files it includes changed since it was
+  // parsed. They stay valid until Capacity other files have been asked for.
+  // Returns false if File has no compile command or can't be parsed.
+  bool get(::llvm::StringRef File, std::vector<::clang::ASTUnit *> &ASTs);
+
+  // Returns true if the ASTs of File are in the cache, even if stale.
+  bool contains(::llvm::StringRef File) const;
+
+private:
+  struct Entry {
+    std::string File;
+    std::vector<std::unique_ptr<::clang::ASTUnit>> ASTs;
+    // Every file the ASTs were parsed from, as it was when they were
+    std::vector<std::pair<std::string, FileStamp>> Inputs;
+    // When they started being parsed
+    uint64_t StampTime;
+  };
+
+  std::unique_ptr<::clang::ASTUnit>
+  parse(const ::clang::tooling::CompileCommand &Command);
+  bool isStale(const Entry &E) const;
+  static void recordInputs(Entry &E, uint64_t StampTime);
+
+  const ::clang::tooling::CompilationDatabase &Compilations;
+  unsigned Capacity;
+  ::clang::DiagnosticConsumer *DiagConsumer;
+  std::shared_ptr<::clang::PCHContainerOperations> PCHContainerOps;
+
+  // Most recently used first
+  std::list<Entry> Entries;
+  ::llvm::StringMap<std::list<Entry>::iterator> Lookup;
+};
+}
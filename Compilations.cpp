@@ -0,0 +1,527 @@
+#include "Rename/Compilations.h"
+#include "Rename/Utility.h"
+
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/ConvertUTF.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+using clang::tooling::CompilationDatabase;
+using clang::tooling::CompileCommand;
+
+using llvm::StringRef;
+
+namespace rn {
+
+namespace {
+// The fields of a compile_commands.json entry
+struct Entry {
+  std::string Directory;
+  std::string File;
+  std::string Command;
+  std::vector<std::string> Arguments;
+};
+
+// Reads the JSON of a compilation database, just enough of it to find the
+// entries and their fields. The strings of the fields are the only values
+// that are decoded, everything else is skipped over.
+class EntryReader {
+public:
+  explicit EntryReader(StringRef Text) : Text(Text), Pos(0) {}
+
+  bool atEnd() {
+    skipSpace();
+    return Pos == Text.size();
+  }
+
+  bool consume(char C) {
+    skipSpace();
+    if (Pos == Text.size() || Text[Pos] != C)
+      return false;
+    ++Pos;
+    return true;
+  }
+
+  // Reads the object starting at the current position. Only the directory
+  // and the file are decoded unless Full is set. Sets *Range, if given, to
+  // its text.
+  bool readEntry(Entry &Result, bool Full, StringRef *Range) {
+    skipSpace();
+    const auto Begin = Pos;
+    if (!consume('{'))
+      return false;
+    if (consume('}')) {
+      if (Range != nullptr)
+        *Range = Text.slice(Begin, Pos);
+      return true;
+    }
+    do {
+      std::string Key;
+      if (!readString(Key) || !consume(':'))
+        return false;
+      bool Read;
+      if (Key == "directory")
+        Read = readString(Result.Directory);
+      else if (Key == "file")
+        Read = readString(Result.File);
+      else if (Key == "command" && Full)
+        Read = readString(Result.Command);
+      else if (Key == "arguments" && Full)
+        Read = readStrings(Result.Arguments);
+      else
+        Read = skipValue();
+      if (!Read)
+        return false;
+    } while (consume(','));
+    if (!consume('}'))
+      return false;
+    if (Range != nullptr)
+      *Range = Text.slice(Begin, Pos);
+    return true;
+  }
+
+private:
+  void skipSpace() {
+    while (Pos < Text.size() && (Text[Pos] == ' ' || Text[Pos] == '\t' ||
+                                 Text[Pos] == '\n' || Text[Pos] == '\r'))
+      ++Pos;
+  }
+
+  bool readString(std::string &Result) {
+    if (!consume('"'))
+      return false;
+    Result.clear();
+    while (Pos < Text.size()) {
+      const char C = Text[Pos++];
+      if (C == '"')
+        return true;
+      if (C != '\\') {
+        Result += C;
+        continue;
+      }
+      if (Pos == Text.size())
+        return false;
+      switch (const char Escaped = Text[Pos++]) {
+      case 'b':
+        Result += '\b';
+        break;
+      case 'f':
+        Result += '\f';
+        break;
+      case 'n':
+        Result += '\n';
+        break;
+      case 'r':
+        Result += '\r';
+        break;
+      case 't':
+        Result += '\t';
+        break;
+      case 'u': {
+        unsigned CodePoint, Low;
+        if (!parseHex(Text.substr(Pos, 4), CodePoint))
+          return false;
+        Pos += 4;
+        // A pair of surrogates encodes a code point outside the BMP, and a
+        // lone one is replaced like an invalid sequence would be
+        if (CodePoint >= 0xD800 && CodePoint < 0xDC00 &&
+            Text.substr(Pos, 2) == "\\u" &&
+            parseHex(Text.substr(Pos + 2, 4), Low) && Low >= 0xDC00 &&
+            Low < 0xE000) {
+          Pos += 6;
+          CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (Low - 0xDC00);
+        } else if (CodePoint >= 0xD800 && CodePoint < 0xE000) {
+          CodePoint = 0xFFFD;
+        }
+        char Buffer[UNI_MAX_UTF8_BYTES_PER_CODE_POINT];
+        char *End = Buffer;
+        if (!llvm::ConvertCodePointToUTF8(CodePoint, End))
+          return false;
+        Result.append(Buffer, End);
+        break;
+      }
+      default:
+        Result += Escaped;
+        break;
+      }
+    }
+    return false;
+  }
+
+  // Parses the four hex digits of a \u escape
+  static bool parseHex(StringRef Digits, unsigned &Result) {
+    return Digits.size() == 4 && !Digits.getAsInteger(16, Result);
+  }
+
+  // Moves past a string without decoding it
+  bool skipString() {
+    if (!consume('"'))
+      return false;
+    while (Pos < Text.size()) {
+      const char C = Text[Pos++];
+      if (C == '"')
+        return true;
+      if (C == '\\')
+        ++Pos;
+    }
+    return false;
+  }
+
+  bool readStrings(std::vector<std::string> &Result) {
+    if (!consume('['))
+      return false;
+    if (consume(']'))
+      return true;
+    do {
+      Result.emplace_back();
+      if (!readString(Result.back()))
+        return false;
+    } while (consume(','));
+    return consume(']');
+  }
+
+  // Skips a value of any kind
+  bool skipValue() {
+    skipSpace();
+    if (Pos == Text.size())
+      return false;
+    switch (Text[Pos]) {
+    case '"':
+      return skipString();
+    case '[':
+    case '{': {
+      const char Close = Text[Pos] == '[' ? ']' : '}';
+      ++Pos;
+      if (consume(Close))
+        return true;
+      do {
+        if (Close == '}' && (!skipString() || !consume(':')))
+          return false;
+        if (!skipValue())
+          return false;
+      } while (consume(','));
+      return consume(Close);
+    }
+    default:
+      // A number, true, false or null
+      while (Pos < Text.size() && Text[Pos] != ',' && Text[Pos] != ']' &&
+             Text[Pos] != '}' && Text[Pos] != ' ' && Text[Pos] != '\n')
+        ++Pos;
+      return true;
+    }
+  }
+
+  StringRef Text;
+  size_t Pos;
+};
+
+// Splits a shell command line into its arguments, like a POSIX shell would
+// without expanding anything.
+std::vector<std::string> splitCommandLine(StringRef Command) {
+  std::vector<std::string> Arguments;
+  std::string Argument;
+  bool InArgument = false;
+  for (size_t I = 0; I < Command.size(); ++I) {
+    const char C = Command[I];
+    if (C == ' ' || C == '\t' || C == '\n') {
+      if (InArgument)
+        Arguments.push_back(std::move(Argument));
+      Argument.clear();
+      InArgument = false;
+      continue;
+    }
+    InArgument = true;
+    if (C == '\\' && I + 1 < Command.size()) {
+      Argument += Command[++I];
+    } else if (C == '\'') {
+      const auto End = Command.find('\'', I + 1);
+      Argument += Command.slice(I + 1, End);
+      I = End == StringRef::npos ? Command.size() : End;
+    } else if (C == '"') {
+      for (++I; I < Command.size() && Command[I] != '"'; ++I) {
+        if (Command[I] == '\\' && I + 1 < Command.size() &&
+            StringRef("\"\\$`").find(Command[I + 1]) != StringRef::npos)
+          ++I;
+        Argument += Command[I];
+      }
+    } else {
+      Argument += C;
+    }
+  }
+  if (InArgument)
+    Arguments.push_back(std::move(Argument));
+  return Arguments;
+}
+
+CompileCommand toCompileCommand(Entry &Parsed) {
+  CompileCommand Command;
+  Command.Directory = std::move(Parsed.Directory);
+  Command.Filename = std::move(Parsed.File);
+  Command.CommandLine = Parsed.Arguments.empty()
+                            ? splitCommandLine(Parsed.Command)
+                            : std::move(Parsed.Arguments);
+  return Command;
+}
+
+// How an option whose arguments are dropped by normalizeArguments() is
+// spelled
+enum class Spelling {
+  // Exactly as given
+  Exact,
+  // Starting with the given prefix
+  Prefix,
+  // With a value, either separate or joined, like -o a.o or -oa.o
+  WithValue
+};
+
+struct IgnoredOption {
+  const char *Name;
+  Spelling Kind;
+};
+
+const IgnoredOption IgnoredOptions[] = {
+    {"-o", Spelling::WithValue},
+    {"-c", Spelling::Exact},
+    {"-pipe", Spelling::Exact},
+    // Dependency files
+    {"-M", Spelling::Exact},
+    {"-MM", Spelling::Exact},
+    {"-MD", Spelling::Exact},
+    {"-MMD", Spelling::Exact},
+    {"-MP", Spelling::Exact},
+    {"-MF", Spelling::WithValue},
+    {"-MT", Spelling::WithValue},
+    {"-MQ", Spelling::WithValue},
+    // Debug info
+    {"-g", Spelling::Exact},
+    {"-g0", Spelling::Exact},
+    {"-g1", Spelling::Exact},
+    {"-g2", Spelling::Exact},
+    {"-g3", Spelling::Exact},
+    {"-ggdb", Spelling::Exact},
+    {"-gline-tables-only", Spelling::Exact},
+    {"-gsplit-dwarf", Spelling::Exact},
+    {"-gdwarf", Spelling::Prefix},
+    // Diagnostics
+    {"-w", Spelling::Exact},
+    {"-fcolor-diagnostics", Spelling::Exact},
+    {"-fno-color-diagnostics", Spelling::Exact},
+    {"-fdiagnostics-", Spelling::Prefix},
+    {"-fmessage-length", Spelling::Prefix},
+};
+
+// Returns true if Value, joined to the name of an option, can't be the rest
+// of the name of another option, like bjcmt-... is for -objcmt-... The names
+// are made of lowercase letters, digits and dashes, up to an =, so a value
+// like a.o or /tmp/a has to have something else. Values that don't are left
+// alone, which only means the commands they're in aren't collapsed.
+bool isJoinedValue(StringRef Value) {
+  return Value.split('=').first.find_first_not_of(
+             "abcdefghijklmnopqrstuvwxyz0123456789-") != StringRef::npos;
+}
+
+bool isIgnored(StringRef Arg, const IgnoredOption &Option) {
+  switch (Option.Kind) {
+  case Spelling::Exact:
+    return Arg == Option.Name;
+  case Spelling::Prefix:
+    return Arg.startswith(Option.Name);
+  case Spelling::WithValue:
+    return Arg == Option.Name ||
+           (Arg.startswith(Option.Name) &&
+            isJoinedValue(Arg.drop_front(std::strlen(Option.Name))));
+  }
+  return false;
+}
+}
+
+LazyCompilationDatabase::LazyCompilationDatabase(
+    std::unique_ptr<llvm::MemoryBuffer> Buffer)
+    : Buffer(std::move(Buffer)), Deduplicate(false) {}
+
+std::unique_ptr<LazyCompilationDatabase>
+LazyCompilationDatabase::loadFromFile(StringRef Path,
+                                      std::string &ErrorMessage) {
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  if (!Buffer) {
+    ErrorMessage = "Can't read " + Path.str() + ": " +
+                   Buffer.getError().message();
+    return nullptr;
+  }
+  std::unique_ptr<LazyCompilationDatabase> Database(
+      new LazyCompilationDatabase(std::move(*Buffer)));
+  if (!Database->index(ErrorMessage)) {
+    ErrorMessage = Path.str() + ": " + ErrorMessage;
+    return nullptr;
+  }
+  return Database;
+}
+
+bool LazyCompilationDatabase::index(std::string &ErrorMessage) {
+  EntryReader Reader(Buffer->getBuffer());
+  if (!Reader.consume('[')) {
+    ErrorMessage = "expected an array of compile commands";
+    return false;
+  }
+  if (Reader.consume(']'))
+    return true;
+  do {
+    Entry Parsed;
+    StringRef Range;
+    if (!Reader.readEntry(Parsed, /*Full=*/false, &Range)) {
+      ErrorMessage = "expected a compile command object";
+      return false;
+    }
+    if (Parsed.File.empty() || Parsed.Directory.empty()) {
+      ErrorMessage = "a compile command has no file or directory";
+      return false;
+    }
+    auto Inserted = Entries.insert(
+        std::make_pair(makeAbsolute(Parsed.Directory, Parsed.File),
+                       llvm::SmallVector<StringRef, 1>()));
+    if (Inserted.second) {
+      const auto File = Inserted.first->getKey();
+      Files.push_back(File);
+      FileNames[llvm::sys::path::filename(File)].push_back(File);
+    }
+    Inserted.first->second.push_back(Range);
+  } while (Reader.consume(','));
+  if (!Reader.consume(']') || !Reader.atEnd()) {
+    ErrorMessage = "expected the end of the array";
+    return false;
+  }
+  return true;
+}
+
+std::vector<CompileCommand>
+LazyCompilationDatabase::getCompileCommands(StringRef FilePath) const {
+  std::vector<CompileCommand> Commands;
+  const auto Key = makeAbsolute("", FilePath);
+  auto Found = Entries.find(Key);
+  if (Found == Entries.end()) {
+    // The file may be named through a symlink, or differently, like
+    // FileMatchTrie finds it: it has the same name as exactly one file of the
+    // database that is the same file
+    const auto Candidates = FileNames.find(llvm::sys::path::filename(Key));
+    if (Candidates == FileNames.end())
+      return Commands;
+    for (const auto Candidate : Candidates->second) {
+      if (!llvm::sys::fs::equivalent(Candidate, Key))
+        continue;
+      if (Found != Entries.end())
+        return Commands;
+      Found = Entries.find(Candidate);
+    }
+    if (Found == Entries.end())
+      return Commands;
+  }
+  for (const auto &Text : Found->second) {
+    Entry Parsed;
+    EntryReader Reader(Text);
+    if (Reader.readEntry(Parsed, /*Full=*/true, /*Range=*/nullptr))
+      Commands.push_back(toCompileCommand(Parsed));
+  }
+  if (Deduplicate)
+    deduplicate(Commands);
+  return Commands;
+}
+
+std::vector<std::string> LazyCompilationDatabase::getAllFiles() const {
+  return std::vector<std::string>(Files.begin(), Files.end());
+}
+
+std::vector<CompileCommand>
+LazyCompilationDatabase::getAllCompileCommands() const {
+  std::vector<CompileCommand> Commands;
+  for (const auto &File : getAllFiles()) {
+    auto FileCommands = getCompileCommands(File);
+    std::move(FileCommands.begin(), FileCommands.end(),
+              std::back_inserter(Commands));
+  }
+  return Commands;
+}
+
+void LazyCompilationDatabase::deduplicate(
+    std::vector<CompileCommand> &Commands) const {
+  if (Commands.size() < 2)
+    return;
+  llvm::StringSet<> Seen;
+  Commands.erase(std::remove_if(Commands.begin(), Commands.end(),
+                                [&](const CompileCommand &Command) {
+                                  std::string Key = Command.Directory;
+                                  for (const auto &Arg :
+                                       normalizeArguments(Command)) {
+                                    Key += '\0';
+                                    Key += Arg;
+                                  }
+                                  return !Seen.insert(Key).second;
+                                }),
+                 Commands.end());
+}
+
+std::vector<std::string> normalizeArguments(const CompileCommand &Command) {
+  std::vector<std::string> Arguments;
+  const auto &Args = Command.CommandLine;
+  for (size_t I = 0; I < Args.size(); ++I) {
+    const StringRef Arg = Args[I];
+    // Warnings, except for -Wp, which passes options to the preprocessor
+    if (Arg.startswith("-W") && !Arg.startswith("-Wp,"))
+      continue;
+    const auto *Ignored =
+        std::find_if(std::begin(IgnoredOptions), std::end(IgnoredOptions),
+                     [&](const IgnoredOption &Option) {
+                       return isIgnored(Arg, Option);
+                     });
+    if (Ignored == std::end(IgnoredOptions))
+      Arguments.push_back(Arg);
+    else if (Ignored->Kind == Spelling::WithValue && Arg == Ignored->Name)
+      ++I;
+  }
+  return Arguments;
+}
+
+std::unique_ptr<CompilationDatabase>
+loadCompilationDatabase(StringRef BuildPath, StringRef SourcePath,
+                        bool Deduplicate, std::string &ErrorMessage) {
+  // The closest directory with a compile_commands.json
+  llvm::SmallString<256> Directory;
+  if (!BuildPath.empty()) {
+    Directory = BuildPath;
+  } else {
+    Directory = SourcePath;
+    llvm::sys::fs::make_absolute(Directory);
+    Directory.resize(llvm::sys::path::parent_path(Directory).size());
+    while (!Directory.empty()) {
+      llvm::SmallString<256> Candidate(Directory);
+      llvm::sys::path::append(Candidate, "compile_commands.json");
+      if (llvm::sys::fs::exists(Candidate))
+        break;
+      const auto Parent = llvm::sys::path::parent_path(Directory).size();
+      // The root is its own parent
+      Directory.resize(Parent < Directory.size() ? Parent : 0);
+    }
+  }
+
+  llvm::SmallString<256> JSONPath(Directory);
+  llvm::sys::path::append(JSONPath, "compile_commands.json");
+  if (!Directory.empty() && llvm::sys::fs::exists(JSONPath)) {
+    auto Database =
+        LazyCompilationDatabase::loadFromFile(JSONPath, ErrorMessage);
+    if (Database)
+      Database->setDeduplicate(Deduplicate);
+    return std::move(Database);
+  }
+  if (!BuildPath.empty())
+    return CompilationDatabase::autoDetectFromDirectory(BuildPath,
+                                                        ErrorMessage);
+  return CompilationDatabase::autoDetectFromSource(SourcePath, ErrorMessage);
+}
+}
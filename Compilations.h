@@ -0,0 +1,112 @@
+#pragma once
+
+#include <clang/Tooling/ArgumentsAdjusters.h>
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rn {
+
+// A compilation database read from a compile_commands.json without parsing
+// all of it. Loading the file (which is memory mapped) only finds where each
+// entry is and which file it compiles. An entry is parsed when the commands
+// of its file are asked for, so a rename that only looks at a few files
+// doesn't pay for the thousands of others.
+class LazyCompilationDatabase : public ::clang::tooling::CompilationDatabase {
+public:
+  // Returns nullptr, and sets ErrorMessage, if the file can't be read or
+  // isn't a JSON array of objects.
+  static std::unique_ptr<LazyCompilationDatabase>
+  loadFromFile(::llvm::StringRef Path, std::string &ErrorMessage);
+
+  // If set, the commands of a file that only differ in the arguments that
+  // can't change its AST (see normalizeArguments()) are collapsed into one,
+  // so the file isn't parsed once per command.
+  void setDeduplicate(bool Enable) { Deduplicate = Enable; }
+
+  std::vector<::clang::tooling::CompileCommand>
+  getCompileCommands(::llvm::StringRef FilePath) const override;
+
+  std::vector<std::string> getAllFiles() const override;
+
+  std::vector<::clang::tooling::CompileCommand>
+  getAllCompileCommands() const override;
+
+private:
+  explicit LazyCompilationDatabase(
+      std::unique_ptr<::llvm::MemoryBuffer> Buffer);
+
+  bool index(std::string &ErrorMessage);
+  void deduplicate(std::vector<::clang::tooling::CompileCommand> &Commands)
+      const;
+
+  std::unique_ptr<::llvm::MemoryBuffer> Buffer;
+  // The text of the entries of each file, by absolute path
+  ::llvm::StringMap<::llvm::SmallVector<::llvm::StringRef, 1>> Entries;
+  // The files, in the order they appear in
+  std::vector<::llvm::StringRef> Files;
+  // The files with each file name, to look up the files named differently
+  ::llvm::StringMap<::llvm::SmallVector<::llvm::StringRef, 1>> FileNames;
+  bool Deduplicate;
+};
+
+// Returns the arguments of Command without those that can't change the AST
+// of the file it compiles, as far as renaming is concerned: the output,
+// dependency files, warnings, debug info and diagnostics formatting. The
+// optimization level is kept, since code can be conditional on the
+// __OPTIMIZE__ macros.
+std::vector<std::string>
+normalizeArguments(const ::clang::tooling::CompileCommand &Command);
+
+// Adjusts the arguments of every command of another database
+class AdjustingCompilationDatabase
+    : public ::clang::tooling::CompilationDatabase {
+public:
+  AdjustingCompilationDatabase(
+      std::unique_ptr<::clang::tooling::CompilationDatabase> Compilations,
+      ::clang::tooling::ArgumentsAdjuster Adjuster)
+      : Compilations(std::move(Compilations)), Adjuster(std::move(Adjuster)) {}
+
+  std::vector<::clang::tooling::CompileCommand>
+  getCompileCommands(::llvm::StringRef FilePath) const override {
+    return adjust(Compilations->getCompileCommands(FilePath));
+  }
+
+  std::vector<std::string> getAllFiles() const override {
+    return Compilations->getAllFiles();
+  }
+
+  std::vector<::clang::tooling::CompileCommand>
+  getAllCompileCommands() const override {
+    return adjust(Compilations->getAllCompileCommands());
+  }
+
+private:
+  std::vector<::clang::tooling::CompileCommand>
+  adjust(std::vector<::clang::tooling::CompileCommand> Commands) const {
+    for (auto &Command : Commands)
+      Command.CommandLine = Adjuster(Command.CommandLine, Command.Filename);
+    return Commands;
+  }
+
+  std::unique_ptr<::clang::tooling::CompilationDatabase> Compilations;
+  ::clang::tooling::ArgumentsAdjuster Adjuster;
+};
+
+// Finds the compilation database for the sources, like CommonOptionsParser
+// does: the one in BuildPath if it's set, or else the closest one above the
+// first of the sources. A compile_commands.json is loaded lazily, and the
+// other kinds of databases are loaded through the registered plugins.
+// Returns nullptr, and sets ErrorMessage, if there is none.
+std::unique_ptr<::clang::tooling::CompilationDatabase>
+loadCompilationDatabase(::llvm::StringRef BuildPath,
+                        ::llvm::StringRef SourcePath, bool Deduplicate,
+                        std::string &ErrorMessage);
+}
@@ -0,0 +1,273 @@
+#include "Rename/Dependencies.h"
+#include "Rename/Parallel.h"
+#include "Rename/Utility.h"
+
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Lex/PreprocessorOptions.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <atomic>
+#include <limits>
+#include <tuple>
+
+using clang::FrontendAction;
+using clang::PreprocessOnlyAction;
+using clang::tooling::CompilationDatabase;
+using clang::tooling::FrontendActionFactory;
+
+using llvm::ArrayRef;
+using llvm::StringRef;
+
+namespace rn {
+
+// The layout of the graph file, which is text:
+//
+//   rn include graph <version>
+//   unit <command hash, in hex> <stamp time> <main file>
+//   <stamp> <path>    for the main file and every file it includes
+//   unit ...
+//
+// A unit that reads a precompiled header or modules starts with "precompiled"
+// instead of "unit".
+namespace {
+const char GraphHeader[] = "rn include graph 2";
+
+typedef std::vector<std::pair<FileStamp, std::string>> FileList;
+
+// Runs the preprocessor only, and stamps the files it entered
+class DependencyScanAction : public PreprocessOnlyAction {
+public:
+  DependencyScanAction(FileList &Files, bool &Precompiled)
+      : Files(Files), Precompiled(Precompiled) {}
+
+protected:
+  void EndSourceFileAction() override {
+    auto &Compiler = getCompilerInstance();
+    // The headers in a precompiled header or a module aren't entered
+    const auto &PreprocessorOpts = Compiler.getPreprocessorOpts();
+    Precompiled = !PreprocessorOpts.ImplicitPCHInclude.empty() ||
+                  !PreprocessorOpts.ImplicitPTHInclude.empty() ||
+                  Compiler.getLangOpts().Modules ||
+                  !Compiler.getFrontendOpts().ModuleFiles.empty();
+    const auto &SourceMgr = Compiler.getSourceManager();
+    for (auto I = SourceMgr.fileinfo_begin(), E = SourceMgr.fileinfo_end();
+         I != E; ++I) {
+      auto Name = getAbsoluteName(Compiler.getFileManager(), I->first);
+      FileStamp Stamp;
+      const auto *Buffer = I->second->getRawBuffer();
+      const bool Stamped = Buffer != nullptr
+                               ? stampFile(Name, Buffer->getBuffer(), Stamp)
+                               : stampFile(Name, Stamp);
+      // A file that is gone makes the unit stale
+      if (!Stamped) {
+        Stamp = FileStamp();
+        Stamp.Size = std::numeric_limits<uint64_t>::max();
+      }
+      Files.emplace_back(Stamp, std::move(Name));
+    }
+  }
+
+private:
+  FileList &Files;
+  bool &Precompiled;
+};
+
+class DependencyScanFactory : public FrontendActionFactory {
+public:
+  DependencyScanFactory(FileList &Files, bool &Precompiled)
+      : Files(Files), Precompiled(Precompiled) {}
+
+  FrontendAction *create() override {
+    return new DependencyScanAction(Files, Precompiled);
+  }
+
+private:
+  FileList &Files;
+  bool &Precompiled;
+};
+}
+
+IncludeGraph::IncludeGraph(std::string Path) : Path(std::move(Path)) {
+  load();
+  buildMaps();
+}
+
+int IncludeGraph::update(const CompilationDatabase &Compilations,
+                         const std::vector<std::string> &Files, unsigned Jobs,
+                         clang::DiagnosticConsumer *DiagConsumer) {
+  bool FileSkipped = false;
+  const auto Tasks = getCompileCommands(Compilations, Files, &FileSkipped);
+
+  // A translation unit is kept if it was scanned with the same compile
+  // command and none of its files changed since. The units of the files that
+  // weren't asked about are kept as they are.
+  std::vector<bool> Kept(Units.size(), false), Superseded(Units.size(), false);
+  std::vector<size_t> Scan;
+  std::vector<Digest> Commands;
+  for (size_t I = 0; I < Tasks.size(); ++I) {
+    Commands.push_back(hashCompileCommand(Tasks[I].second));
+    bool UpToDate = false;
+    const auto Existing = MainFileUnits.find(Tasks[I].first);
+    if (Existing != MainFileUnits.end()) {
+      for (const auto Unit : Existing->second) {
+        Superseded[Unit] = true;
+        if (!UpToDate && !Kept[Unit] && Units[Unit].Command == Commands[I] &&
+            isFresh(Units[Unit]))
+          Kept[Unit] = UpToDate = true;
+      }
+    }
+    if (!UpToDate)
+      Scan.push_back(I);
+  }
+  Checked.clear();
+  if (Scan.empty())
+    return FileSkipped ? 2 : 0;
+
+  std::vector<TranslationUnit> Scanned(Scan.size());
+  WorkStealingExecutor Executor(Jobs);
+  SynchronizedDiagConsumer Diagnostics(DiagConsumer);
+  Executor.run(Scan.size(), [&](size_t Index, unsigned) {
+    const auto &Task = Tasks[Scan[Index]];
+    auto &Unit = Scanned[Index];
+    Unit.MainFile = Task.first;
+    Unit.Command = Commands[Scan[Index]];
+    Unit.StampTime = getStampTime();
+    DependencyScanFactory Factory(Unit.Files, Unit.Precompiled);
+    // Marked as failed by its empty main file
+    if (!runOnCompileCommand(Task.second, Task.first, &Factory,
+                             Diagnostics.get()))
+      Unit.MainFile.clear();
+  });
+
+  // A unit that failed to scan may be missing some of its includes, so it's
+  // left out, and its main file is never ruled out
+  std::vector<TranslationUnit> NewUnits;
+  for (size_t Unit = 0; Unit < Units.size(); ++Unit) {
+    if (Kept[Unit] || !Superseded[Unit])
+      NewUnits.push_back(std::move(Units[Unit]));
+  }
+  bool ProcessingFailed = false;
+  for (auto &Unit : Scanned) {
+    if (Unit.MainFile.empty())
+      ProcessingFailed = true;
+    else
+      NewUnits.push_back(std::move(Unit));
+  }
+  Units = std::move(NewUnits);
+  buildMaps();
+
+  if (!write() || ProcessingFailed)
+    return 1;
+  return FileSkipped ? 2 : 0;
+}
+
+void IncludeGraph::getIncluders(ArrayRef<std::string> Headers,
+                                llvm::StringSet<> &MainFiles) const {
+  for (const auto &Header : Headers) {
+    const auto Found = Includers.find(Header);
+    if (Found == Includers.end())
+      continue;
+    for (const auto Unit : Found->second)
+      MainFiles.insert(Units[Unit].MainFile);
+  }
+}
+
+void IncludeGraph::load() {
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  if (!Buffer)
+    return;
+  auto Contents = (*Buffer)->getBuffer();
+  StringRef Line;
+  std::tie(Line, Contents) = Contents.split('\n');
+  if (Line != GraphHeader)
+    return;
+
+  bool Damaged = false;
+  while (!Damaged && !Contents.empty()) {
+    std::tie(Line, Contents) = Contents.split('\n');
+    if (Line.empty())
+      continue;
+    StringRef First, Rest;
+    std::tie(First, Rest) = Line.split(' ');
+    if (First == "unit" || First == "precompiled") {
+      StringRef Hash, StampTime, MainFile;
+      std::tie(Hash, Rest) = Rest.split(' ');
+      std::tie(StampTime, MainFile) = Rest.split(' ');
+      Units.emplace_back();
+      auto &Unit = Units.back();
+      Unit.MainFile = MainFile.str();
+      Unit.Precompiled = First == "precompiled";
+      Damaged = !parseDigest(Hash, Unit.Command) ||
+                StampTime.getAsInteger(10, Unit.StampTime) || MainFile.empty();
+      continue;
+    }
+    FileStamp Stamp;
+    Damaged = Units.empty() || !parseFileStamp(Line, Stamp, Rest) ||
+              Rest.empty();
+    if (!Damaged)
+      Units.back().Files.emplace_back(Stamp, Rest.str());
+  }
+  // A damaged graph is scanned again from scratch
+  if (Damaged)
+    Units.clear();
+}
+
+bool IncludeGraph::write() const {
+  std::string Contents;
+  llvm::raw_string_ostream OS(Contents);
+  OS << GraphHeader << '\n';
+  for (const auto &Unit : Units) {
+    OS << (Unit.Precompiled ? "precompiled " : "unit ");
+    writeDigest(OS, Unit.Command);
+    OS << ' ' << Unit.StampTime << ' ' << Unit.MainFile << '\n';
+    for (const auto &File : Unit.Files) {
+      writeFileStamp(OS, File.first);
+      OS << ' ' << File.second << '\n';
+    }
+  }
+  OS.flush();
+  return writeAtomically(Path, Contents);
+}
+
+bool IncludeGraph::isFresh(const TranslationUnit &Unit) {
+  for (const auto &File : Unit.Files) {
+    const auto &Stamp = File.first;
+    // Most headers are shared by many units, which stamped them the same
+    // unless they changed between scans
+    auto Found = Checked.find(File.second);
+    if (Found == Checked.end() ||
+        Found->second.Stamp.ModificationTime != Stamp.ModificationTime ||
+        Found->second.Stamp.Hash != Stamp.Hash) {
+      const CheckedFile Check = {
+          Stamp, hasChanged(File.second, Stamp, Unit.StampTime)};
+      Found = Checked.insert(std::make_pair(File.second, Check)).first;
+      Found->second = Check;
+    }
+    if (Found->second.Changed)
+      return false;
+  }
+  return true;
+}
+
+void IncludeGraph::buildMaps() {
+  MainFileUnits.clear();
+  Incomplete.clear();
+  Includers.clear();
+  for (unsigned Unit = 0; Unit < Units.size(); ++Unit) {
+    MainFileUnits[Units[Unit].MainFile].push_back(Unit);
+    if (Units[Unit].Precompiled)
+      Incomplete.insert(Units[Unit].MainFile);
+    for (const auto &File : Units[Unit].Files)
+      Includers[File.second].push_back(Unit);
+  }
+}
+}
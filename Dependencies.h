@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Rename/Digest.h"
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rn {
+
+// The files every translation unit includes, directly or not, found by running
+// only the preprocessor over it. The graph is kept in a file between runs,
+// and a translation unit is only scanned again once its compile command or
+// one of its files changes.
+class IncludeGraph {
+public:
+  // Reads the graph an earlier run wrote to Path, if any.
+  explicit IncludeGraph(std::string Path);
+
+  // Scans the translation units of Files that aren't up to date in the graph,
+  // in parallel, and writes the graph back.
+  // Returns 0 on success, like ClangTool::run().
+  int update(const ::clang::tooling::CompilationDatabase &Compilations,
+             const std::vector<std::string> &Files, unsigned Jobs,
+             ::clang::DiagnosticConsumer *DiagConsumer);
+
+  // Returns true if the translation units of the main file at the absolute
+  // Path were scanned, and none of them reads a precompiled header or modules,
+  // whose headers the preprocessor doesn't enter.
+  bool hasAllIncludes(::llvm::StringRef Path) const {
+    return MainFileUnits.count(Path) != 0 && Incomplete.count(Path) == 0;
+  }
+
+  // Adds the main files of the translation units that include one of the
+  // files at the absolute paths Headers, directly or not, to MainFiles.
+  void getIncluders(::llvm::ArrayRef<std::string> Headers,
+                    ::llvm::StringSet<> &MainFiles) const;
+
+private:
+  struct TranslationUnit {
+    std::string MainFile;
+    Digest Command;
+    // When the scan started, in nanoseconds since the epoch
+    uint64_t StampTime;
+    bool Precompiled;
+    // The stamp and the absolute path of the main file, and of every file it
+    // includes
+    std::vector<std::pair<FileStamp, std::string>> Files;
+  };
+
+  struct CheckedFile {
+    FileStamp Stamp;
+    bool Changed;
+  };
+
+  void load();
+  bool write() const;
+  bool isFresh(const TranslationUnit &Unit);
+  void buildMaps();
+
+  std::string Path;
+  std::vector<TranslationUnit> Units;
+  ::llvm::StringMap<::llvm::SmallVector<unsigned, 1>> MainFileUnits;
+  // The main files of the units that read a precompiled header or modules
+  ::llvm::StringSet<> Incomplete;
+  // The reverse graph: the translation units that include each file
+  ::llvm::StringMap<std::vector<unsigned>> Includers;
+  // The files isFresh() checked, since most headers are shared by many
+  // translation units
+  ::llvm::StringMap<CheckedFile> Checked;
+};
+}
@@ -0,0 +1,128 @@
+#include "Rename/Digest.h"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TimeValue.h>
+
+#include <algorithm>
+#include <iterator>
+#include <tuple>
+
+using clang::tooling::CompileCommand;
+
+using llvm::StringRef;
+
+namespace rn {
+
+namespace {
+Digest getDigest(llvm::MD5 &Hasher) {
+  llvm::MD5::MD5Result Result;
+  Hasher.final(Result);
+  Digest Hash;
+  std::copy(std::begin(Result), std::end(Result), Hash.begin());
+  return Hash;
+}
+
+const uint64_t NanosecondsPerSecond = 1000000000;
+
+uint64_t toNanoseconds(llvm::sys::TimeValue Time) {
+  return Time.toEpochTime() * NanosecondsPerSecond + Time.nanoseconds();
+}
+}
+
+Digest hashBuffer(StringRef Buffer) {
+  llvm::MD5 Hasher;
+  Hasher.update(Buffer);
+  return getDigest(Hasher);
+}
+
+void writeDigest(llvm::raw_ostream &OS, const Digest &Hash) {
+  for (const auto Byte : Hash)
+    OS << llvm::format("%02x", Byte);
+}
+
+bool parseDigest(StringRef Hex, Digest &Hash) {
+  if (Hex.size() != 2 * Hash.size())
+    return false;
+  for (size_t I = 0; I < Hash.size(); ++I) {
+    if (Hex.substr(2 * I, 2).getAsInteger(16, Hash[I]))
+      return false;
+  }
+  return true;
+}
+
+Digest hashCompileCommand(const CompileCommand &Command) {
+  llvm::MD5 Hasher;
+  Hasher.update(Command.Directory);
+  for (const auto &Arg : Command.CommandLine) {
+    // Separate the arguments, so they can't run into each other
+    Hasher.update(StringRef("", 1));
+    Hasher.update(Arg);
+  }
+  return getDigest(Hasher);
+}
+
+uint64_t getStampTime() { return toNanoseconds(llvm::sys::TimeValue::now()); }
+
+bool stampFile(StringRef Path, StringRef Contents, FileStamp &Stamp) {
+  llvm::sys::fs::file_status Status;
+  if (llvm::sys::fs::status(Path, Status))
+    return false;
+  // The size of what was read, so a file that changed since doesn't match
+  Stamp.Size = Contents.size();
+  Stamp.ModificationTime = toNanoseconds(Status.getLastModificationTime());
+  Stamp.Hash = hashBuffer(Contents);
+  return true;
+}
+
+bool stampFile(StringRef Path, FileStamp &Stamp) {
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  return Buffer && stampFile(Path, (*Buffer)->getBuffer(), Stamp);
+}
+
+bool hasChanged(StringRef Path, const FileStamp &Stamp, uint64_t StampTime) {
+  llvm::sys::fs::file_status Status;
+  if (llvm::sys::fs::status(Path, Status) || Status.getSize() != Stamp.Size)
+    return true;
+  // A file modified in the second it was stamped in can be modified again
+  // without its time changing, on the file systems that only keep seconds
+  if (toNanoseconds(Status.getLastModificationTime()) ==
+          Stamp.ModificationTime &&
+      Stamp.ModificationTime / NanosecondsPerSecond <
+          StampTime / NanosecondsPerSecond)
+    return false;
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  return !Buffer || hashBuffer((*Buffer)->getBuffer()) != Stamp.Hash;
+}
+
+void restampFile(StringRef Path, FileStamp &Stamp, uint64_t &StampTime) {
+  llvm::sys::fs::file_status Status;
+  if (llvm::sys::fs::status(Path, Status) || Status.getSize() != Stamp.Size ||
+      toNanoseconds(Status.getLastModificationTime()) ==
+          Stamp.ModificationTime)
+    return;
+  const auto Now = getStampTime();
+  FileStamp Touched;
+  if (stampFile(Path, Touched) && Touched.Hash == Stamp.Hash) {
+    Stamp = Touched;
+    StampTime = Now;
+  }
+}
+
+void writeFileStamp(llvm::raw_ostream &OS, const FileStamp &Stamp) {
+  OS << Stamp.Size << ' ' << Stamp.ModificationTime << ' ';
+  writeDigest(OS, Stamp.Hash);
+}
+
+bool parseFileStamp(StringRef Line, FileStamp &Stamp, StringRef &Rest) {
+  StringRef Size, ModificationTime, Hash;
+  std::tie(Size, Rest) = Line.split(' ');
+  std::tie(ModificationTime, Rest) = Rest.split(' ');
+  std::tie(Hash, Rest) = Rest.split(' ');
+  return !Size.getAsInteger(10, Stamp.Size) &&
+         !ModificationTime.getAsInteger(10, Stamp.ModificationTime) &&
+         parseDigest(Hash, Stamp.Hash);
+}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <array>
+#include <cstdint>
+
+namespace rn {
+
+// An MD5 digest
+typedef std::array<uint8_t, 16> Digest;
+
+Digest hashBuffer(::llvm::StringRef Buffer);
+
+// Writes Hash in hex, which parseDigest() reads back.
+void writeDigest(::llvm::raw_ostream &OS, const Digest &Hash);
+bool parseDigest(::llvm::StringRef Hex, Digest &Hash);
+
+// Hashes everything about Command that can change how a file is parsed.
+Digest hashCompileCommand(const ::clang::tooling::CompileCommand &Command);
+
+// What a file was like when it was read, to tell when it changes
+struct FileStamp {
+  uint64_t Size;
+  // In nanoseconds since the epoch
+  uint64_t ModificationTime;
+  Digest Hash;
+};
+
+// The current time, in nanoseconds since the epoch. Stamps are taken after it.
+uint64_t getStampTime();
+
+// Stamps the file at Path, which was read as Contents. Returns false if the
+// file doesn't exist anymore.
+bool stampFile(::llvm::StringRef Path, ::llvm::StringRef Contents,
+               FileStamp &Stamp);
+
+// Same as above, reading the file. Returns false if it can't be read.
+bool stampFile(::llvm::StringRef Path, FileStamp &Stamp);
+
+// Returns true if the file at Path isn't the one Stamp was taken of, at
+// StampTime. Its contents are only hashed again if its modification time
+// changed, or was too close to StampTime to tell whether it changed again.
+bool hasChanged(::llvm::StringRef Path, const FileStamp &Stamp,
+                uint64_t StampTime);
+
+// Stamps the file at Path again, and sets StampTime to when, if it was only
+// touched since Stamp was taken, so it isn't hashed again by hasChanged().
+void restampFile(::llvm::StringRef Path, FileStamp &Stamp, uint64_t &StampTime);
+
+// Writes Stamp as "<size> <modification time> <hash>".
+void writeFileStamp(::llvm::raw_ostream &OS, const FileStamp &Stamp);
+
+// Reads a stamp written by writeFileStamp() from the start of Line, and sets
+// Rest to what follows it and a space. Returns false if there is none.
+bool parseFileStamp(::llvm::StringRef Line, FileStamp &Stamp,
+                    ::llvm::StringRef &Rest);
+}
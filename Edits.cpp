@@ -0,0 +1,184 @@
+#include "Rename/Edits.h"
+
+#include <algorithm>
+
+using llvm::StringRef;
+using llvm::raw_ostream;
+
+namespace rn {
+
+namespace {
+// Returns true if the edits are sorted, don't overlap and are within Code
+bool areApplicable(FileEdits Edits, StringRef Code) {
+  size_t End = 0;
+  for (const auto &O : Edits) {
+    if (O.Offset < End || size_t(O.Offset) + O.Length > Code.size())
+      return false;
+    End = size_t(O.Offset) + O.Length;
+  }
+  return true;
+}
+
+// The offsets the lines of Code start at. The newline at the end of the file
+// doesn't start a line.
+std::vector<size_t> getLineStarts(StringRef Code) {
+  std::vector<size_t> Starts(1, 0);
+  for (size_t Newline = Code.find('\n');
+       Newline != StringRef::npos && Newline + 1 < Code.size();
+       Newline = Code.find('\n', Newline + 1))
+    Starts.push_back(Newline + 1);
+  return Starts;
+}
+
+// The lines in [FirstLine, LastLine] that some edits change, and what they
+// become
+struct Change {
+  size_t FirstLine;
+  size_t LastLine;
+  std::string NewText;
+};
+
+// Writes every line of Text, preceded by Prefix, and returns how many there
+// were.
+unsigned writeLines(raw_ostream &OS, char Prefix, StringRef Text) {
+  unsigned Lines = 0;
+  while (!Text.empty()) {
+    const auto Line = Text.split('\n');
+    OS << Prefix << Line.first << '\n';
+    if (Line.first.size() == Text.size())
+      OS << "\\ No newline at end of file\n";
+    Text = Line.second;
+    ++Lines;
+  }
+  return Lines;
+}
+
+// The start of a range of Count lines from Start, as a hunk header has it
+size_t getHunkStart(size_t Start, unsigned Count) {
+  return Count == 0 ? Start : Start + 1;
+}
+}
+
+std::vector<FileEdits> getFileEdits(const OccurrenceStore &Occurrences) {
+  const auto All = Occurrences.getOccurrences();
+  std::vector<FileEdits> Files;
+  for (size_t Begin = 0, End; Begin < All.size(); Begin = End) {
+    for (End = Begin + 1; End < All.size(); ++End) {
+      if (All[End].File != All[Begin].File)
+        break;
+    }
+    Files.push_back(All.slice(Begin, End - Begin));
+  }
+  return Files;
+}
+
+bool applyEdits(const OccurrenceStore &Occurrences, FileEdits Edits,
+                StringRef Code, std::string &Result) {
+  if (!areApplicable(Edits, Code))
+    return false;
+  size_t Size = Code.size();
+  for (const auto &O : Edits)
+    Size += Occurrences.getSpelling(O.Spelling).size() - O.Length;
+  Result.clear();
+  Result.reserve(Size);
+  size_t Last = 0;
+  for (const auto &O : Edits) {
+    Result.append(Code.data() + Last, O.Offset - Last);
+    const auto Spelling = Occurrences.getSpelling(O.Spelling);
+    Result.append(Spelling.data(), Spelling.size());
+    Last = size_t(O.Offset) + O.Length;
+  }
+  Result.append(Code.data() + Last, Code.size() - Last);
+  return true;
+}
+
+bool writeUnifiedDiff(const OccurrenceStore &Occurrences, FileEdits Edits,
+                      StringRef Name, StringRef Code, raw_ostream &OS,
+                      unsigned Context) {
+  if (!areApplicable(Edits, Code))
+    return false;
+  const auto Starts = getLineStarts(Code);
+  const auto LineEnd = [&](size_t Line) {
+    return Line + 1 < Starts.size() ? Starts[Line + 1] : Code.size();
+  };
+  const auto LineOf = [&](size_t Offset, size_t From) {
+    while (From + 1 < Starts.size() && Starts[From + 1] <= Offset)
+      ++From;
+    return From;
+  };
+
+  // The edits on the same or overlapping lines make up a single change
+  std::vector<Change> Changes;
+  size_t EditLine = 0;
+  for (size_t I = 0, End = 0; I < Edits.size(); I = End) {
+    Change C;
+    C.FirstLine = C.LastLine = EditLine = LineOf(Edits[I].Offset, EditLine);
+    do {
+      const auto &O = Edits[End++];
+      C.LastLine = LineOf(size_t(O.Offset) + std::max(O.Length, 1u) - 1,
+                          C.LastLine);
+    } while (End < Edits.size() &&
+             LineOf(Edits[End].Offset, C.LastLine) == C.LastLine);
+    size_t Last = Starts[C.FirstLine];
+    for (const auto &O : Edits.slice(I, End - I)) {
+      C.NewText.append(Code.data() + Last, O.Offset - Last);
+      const auto Spelling = Occurrences.getSpelling(O.Spelling);
+      C.NewText.append(Spelling.data(), Spelling.size());
+      Last = size_t(O.Offset) + O.Length;
+    }
+    C.NewText.append(Code.data() + Last, LineEnd(C.LastLine) - Last);
+    // Renaming to the same spelling doesn't change anything
+    if (C.NewText != Code.slice(Starts[C.FirstLine], LineEnd(C.LastLine)))
+      Changes.push_back(std::move(C));
+  }
+  if (Changes.empty())
+    return true;
+
+  OS << "--- " << Name << "\n+++ " << Name << "\n";
+  // The difference between the line numbers of the new file and of the old
+  long Delta = 0;
+  for (size_t I = 0, End; I < Changes.size(); I = End) {
+    // The changes whose context lines meet are in the same hunk
+    for (End = I + 1; End < Changes.size(); ++End) {
+      const auto Gap = Changes[End].FirstLine - Changes[End - 1].LastLine - 1;
+      if (Gap > 2 * Context)
+        break;
+    }
+    const auto OldStart =
+        Changes[I].FirstLine - std::min<size_t>(Changes[I].FirstLine, Context);
+    const auto OldEnd =
+        std::min(Starts.size(), Changes[End - 1].LastLine + Context + 1);
+    const auto NewStart = size_t(long(OldStart) + Delta);
+
+    std::string Hunk;
+    llvm::raw_string_ostream HunkOS(Hunk);
+    unsigned OldCount = 0;
+    unsigned NewCount = 0;
+    size_t Line = OldStart;
+    for (const auto &C : llvm::makeArrayRef(Changes).slice(I, End - I)) {
+      const auto Unchanged = writeLines(
+          HunkOS, ' ', Code.slice(Starts[Line], Starts[C.FirstLine]));
+      const auto Removed = writeLines(
+          HunkOS, '-', Code.slice(Starts[C.FirstLine], LineEnd(C.LastLine)));
+      const auto Added = writeLines(HunkOS, '+', C.NewText);
+      OldCount += Unchanged + Removed;
+      NewCount += Unchanged + Added;
+      Delta += long(Added) - long(Removed);
+      Line = C.LastLine + 1;
+    }
+    if (Line < OldEnd) {
+      const auto Unchanged = writeLines(
+          HunkOS, ' ', Code.slice(Starts[Line], LineEnd(OldEnd - 1)));
+      OldCount += Unchanged;
+      NewCount += Unchanged;
+    }
+    HunkOS.flush();
+
+    OS << "@@ -" << getHunkStart(OldStart, OldCount) << ',' << OldCount
+       << " +" << getHunkStart(NewStart, NewCount) << ',' << NewCount
+       << " @@\n"
+       << Hunk;
+  }
+  return true;
+}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Rename/Occurrences.h"
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <string>
+#include <vector>
+
+namespace rn {
+
+// The occurrences of a single file, sorted by offset
+using FileEdits = ::llvm::ArrayRef<OccurrenceStore::Occurrence>;
+
+// Splits the occurrences of a sorted store by file.
+std::vector<FileEdits> getFileEdits(const OccurrenceStore &Occurrences);
+
+// Sets Result to Code with Edits applied, building it in one pass instead of
+// editing it in place. Edits are the occurrences in Code's file, and their
+// spellings are looked up in Occurrences.
+// Returns false if an edit is out of Code's range, or overlaps the one before.
+bool applyEdits(const OccurrenceStore &Occurrences, FileEdits Edits,
+                ::llvm::StringRef Code, std::string &Result);
+
+// Writes the changes Edits make to Code as a unified diff of the file Name,
+// with Context lines around each change. Nothing is written if Code wouldn't
+// change.
+// Returns false, like applyEdits(), if the edits can't be applied.
+bool writeUnifiedDiff(const OccurrenceStore &Occurrences, FileEdits Edits,
+                      ::llvm::StringRef Name, ::llvm::StringRef Code,
+                      ::llvm::raw_ostream &OS, unsigned Context = 3);
+}
@@ -1,3 +1,7 @@
+#pragma once
+
+#include "Rename/Occurrences.h"
+#include "Rename/Targets.h"
 #include "Rename/Utility.h"
 
 #include <clang/AST/AST.h>
@@ -7,6 +11,9 @@
 
 #include <llvm/ADT/Optional.h>
 
+#include <string>
+#include <vector>
+
 namespace rn {
 
 // Data about the Symbol that the Matcher callbacks need
@@ -24,31 +31,42 @@ struct SymbolData {
   ::llvm::Optional<::clang::SourceLocation> Loc;
   std::string USR;
   std::string Spelling;
+  // If set instead of the USR, the declarations with this fully qualified
+  // name (like ns::Point) are renamed, which doesn't need a locate pass
+  std::string QualifiedName;
+  // Set by the locate pass to the main file of the translation unit the
+  // symbol was found in, if it can't be referred to from any other one
+  std::string LocalTo;
+  // Set by the locate pass to the headers the symbol is declared in, if any
+  std::vector<std::string> Headers;
 };
 
 template <typename AnnotatedNode>
 class RenameHandler : public ::clang::ast_matchers::MatchFinder::MatchCallback {
 public:
-  RenameHandler(::clang::tooling::Replacements *Replace, const SymbolData *Data)
-      : Replace(Replace), Data(Data) {}
+  RenameHandler(OccurrenceStore *Occurrences, const TargetDecls *Targets)
+      : Occurrences(Occurrences), Targets(Targets) {}
 
   void
   run(const ::clang::ast_matchers::MatchFinder::MatchResult &Result) override {
     // Rename the Node if there is a match
     const auto Node = Result.Nodes.getNodeAs<typename AnnotatedNode::NodeType>(
         AnnotatedNode::ID());
-    const auto Decl =
-        Result.Nodes.getNodeAs<::clang::NamedDecl>(declID(AnnotatedNode::ID()));
+    const auto Decl = Result.Nodes.getNodeAs<::clang::NamedDecl>(declID());
     if (Node == nullptr || Decl == nullptr)
       return;
-    Replace->insert(::clang::tooling::Replacement(
-        *(Result.SourceManager), AnnotatedNode::getLocation(Node),
-        AnnotatedNode::getSpelling(Node, Decl).size(), Data->NewSpelling));
+    // The matchers only let the targets through
+    const auto *Data = Targets->lookup(Decl);
+    if (Data == nullptr)
+      return;
+    Occurrences->add(*(Result.SourceManager), AnnotatedNode::getLocation(Node),
+                     AnnotatedNode::getSpellingLength(Node, Decl),
+                     Data->NewSpelling);
   }
 
 private:
-  ::clang::tooling::Replacements *Replace;
-  const SymbolData *Data;
+  OccurrenceStore *Occurrences;
+  const TargetDecls *Targets;
 };
 
 template <typename AnnotatedNode>
@@ -69,8 +87,7 @@ public:
     if (Node == nullptr)
       return;
     // and its NamedDecl
-    const auto Decl =
-        Result.Nodes.getNodeAs<clang::NamedDecl>(declID(AnnotatedNode::ID()));
+    const auto Decl = Result.Nodes.getNodeAs<clang::NamedDecl>(declID());
     if (Decl == nullptr)
       return;
     // See if it is at the location we are looking for
@@ -81,7 +98,7 @@ private:
   void check(const ::clang::SourceManager &SourceMgr,
              const ::clang::NamedDecl *Decl,
              const ::clang::SourceLocation &Start) {
-    const auto Length = Decl->getNameAsString().length();
+    const auto Length = getNameLength(Decl);
     if (Length == 0)
       return;
     const auto End = Start.getLocWithOffset(Length - 1);
@@ -97,6 +114,8 @@ private:
       return;
     Data->USR = getUSRForDecl(Decl);
     Data->Spelling = Decl->getNameAsString();
+    Data->LocalTo = getOwningMainFile(SourceMgr, Decl);
+    Data->Headers = getDeclaringHeaders(SourceMgr, Decl);
     AlreadyMatchedThisNode = true;
   }
 
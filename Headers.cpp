@@ -0,0 +1,100 @@
+#include "Rename/Headers.h"
+#include "Rename/Utility.h"
+
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/SourceManager.h>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/Path.h>
+
+#include <algorithm>
+#include <iterator>
+
+using clang::ASTContext;
+using clang::Decl;
+using clang::FileEntry;
+using clang::SourceLocation;
+using clang::SourceManager;
+using clang::tooling::CompileCommand;
+
+using clang::ast_matchers::MatchFinder;
+
+using llvm::StringRef;
+
+namespace rn {
+
+Digest hashConfiguration(const CompileCommand &Command, StringRef File) {
+  llvm::MD5 Hasher;
+  Hasher.update(Command.Directory);
+  const auto &Args = Command.CommandLine;
+  for (size_t I = 0; I < Args.size(); ++I) {
+    if (Args[I] == "-o") {
+      ++I;
+      continue;
+    }
+    if (StringRef(Args[I]).startswith("-o") ||
+        makeAbsolute(Command.Directory, Args[I]) == File)
+      continue;
+    // Separate the arguments, so they can't run into each other
+    Hasher.update(StringRef("", 1));
+    Hasher.update(Args[I]);
+  }
+  llvm::MD5::MD5Result Result;
+  Hasher.final(Result);
+  Digest Hash;
+  std::copy(std::begin(Result), std::end(Result), Hash.begin());
+  return Hash;
+}
+
+bool HeaderClaims::claim(StringRef Header, const Digest &Config) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return Claimed[Header].insert(Config).second;
+}
+
+SkippedFiles::SkippedFiles(ASTContext &Context, HeaderClaims &Claims,
+                           const Digest &Config)
+    : SourceMgr(Context.getSourceManager()) {
+  const auto *MainEntry =
+      SourceMgr.getFileEntryForID(SourceMgr.getMainFileID());
+  for (auto I = SourceMgr.fileinfo_begin(), E = SourceMgr.fileinfo_end();
+       I != E; ++I) {
+    if (I->first == MainEntry)
+      continue;
+    if (!Claims.claim(getAbsoluteName(SourceMgr.getFileManager(), I->first),
+                      Config))
+      Skipped.insert(I->first);
+  }
+}
+
+bool SkippedFiles::contains(SourceLocation Loc) {
+  if (Loc.isInvalid() || Skipped.empty())
+    return false;
+  const auto File = SourceMgr.getFileID(SourceMgr.getExpansionLoc(Loc));
+  auto Found = SkippedIDs.find(File.getHashValue());
+  if (Found != SkippedIDs.end())
+    return Found->second;
+  const auto *Entry = SourceMgr.getFileEntryForID(File);
+  const bool IsSkipped = Entry != nullptr && Skipped.count(Entry) != 0;
+  SkippedIDs.insert(std::make_pair(File.getHashValue(), IsSkipped));
+  return IsSkipped;
+}
+
+unsigned matchUnclaimedFiles(ASTContext &Context, MatchFinder &Finder,
+                             HeaderClaims &Claims, const Digest &Config) {
+  SkippedFiles Skipped(Context, Claims, Config);
+  if (Skipped.empty()) {
+    Finder.matchAST(Context);
+    return 0;
+  }
+  // The declarations in the skipped files aren't descended into
+  const auto InSkippedFile = [&](const Decl *D) {
+    return Skipped.contains(D->getLocation());
+  };
+  MatchingVisitor Matcher(Context, Finder, InSkippedFile);
+  Matcher.TraverseDecl(Context.getTranslationUnitDecl());
+  return Skipped.size();
+}
+}
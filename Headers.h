@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Rename/Digest.h"
+
+#include <clang/AST/ASTContext.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/SourceLocation.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <mutex>
+#include <set>
+
+namespace rn {
+
+// Hashes everything about Command that can change how the headers of File are
+// preprocessed: the working directory and the arguments, minus File itself
+// and the output. The translation units of a project built with the same
+// flags share a configuration.
+Digest hashConfiguration(const ::clang::tooling::CompileCommand &Command,
+                         ::llvm::StringRef File);
+
+// The headers that a translation unit has already been matched in, under
+// each configuration. A header included by hundreds of translation units is
+// then only matched in the first one, and skipped by the others.
+// Safe to share between threads.
+class HeaderClaims {
+public:
+  // Returns true if Header wasn't claimed under Config yet, in which case it
+  // now is, and the caller has to match it.
+  bool claim(::llvm::StringRef Header, const Digest &Config);
+
+private:
+  std::mutex Lock;
+  ::llvm::StringMap<std::set<Digest>> Claimed;
+};
+
+// The headers of a translation unit that another one, parsed with the same
+// configuration, has already claimed.
+class SkippedFiles {
+public:
+  // Claims the headers of Context under Config, and skips the ones that were
+  // claimed already.
+  SkippedFiles(::clang::ASTContext &Context, HeaderClaims &Claims,
+               const Digest &Config);
+
+  bool empty() const { return Skipped.empty(); }
+  unsigned size() const { return Skipped.size(); }
+
+  // Returns true if Loc, or the macro it was expanded from, is in one of the
+  // skipped headers.
+  bool contains(::clang::SourceLocation Loc);
+
+private:
+  const ::clang::SourceManager &SourceMgr;
+  ::llvm::SmallPtrSet<const ::clang::FileEntry *, 64> Skipped;
+  // Whether each FileID is skipped, since most declarations share a few
+  ::llvm::DenseMap<unsigned, bool> SkippedIDs;
+};
+
+// Runs the matchers of Finder over Context, except over the declarations in
+// the headers that another translation unit parsed with the same Config
+// has already claimed. Returns the number of headers that were skipped.
+unsigned matchUnclaimedFiles(::clang::ASTContext &Context,
+                             ::clang::ast_matchers::MatchFinder &Finder,
+                             HeaderClaims &Claims, const Digest &Config);
+}
@@ -0,0 +1,195 @@
+#include "Rename/Includes.h"
+#include "Rename/Parallel.h"
+#include "Rename/Utility.h"
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/DiagnosticIDs.h>
+#include <clang/Basic/DiagnosticOptions.h>
+#include <clang/Driver/Compilation.h>
+#include <clang/Driver/Driver.h>
+#include <clang/Driver/Job.h>
+#include <clang/Driver/Tool.h>
+
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/Path.h>
+
+#include <algorithm>
+#include <memory>
+
+using clang::DiagnosticIDs;
+using clang::DiagnosticOptions;
+using clang::DiagnosticsEngine;
+using clang::IgnoringDiagConsumer;
+using clang::tooling::CompileCommand;
+
+using llvm::StringRef;
+
+namespace rn {
+
+void scanIncludeDirectives(StringRef Buffer,
+                           llvm::function_ref<void(StringRef, bool)> Callback) {
+  while (!Buffer.empty()) {
+    auto Line = Buffer.substr(0, Buffer.find('\n'));
+    Buffer = Buffer.drop_front(std::min(Buffer.size(), Line.size() + 1));
+
+    Line = Line.ltrim();
+    if (!Line.startswith("#"))
+      continue;
+    Line = Line.drop_front().ltrim();
+    if (!Line.startswith("include") && !Line.startswith("import"))
+      continue;
+    Line = Line.substr(Line.find_first_of(" \t\"<")).ltrim();
+    if (Line.empty() || (Line.front() != '"' && Line.front() != '<')) {
+      Callback(StringRef(), false);
+      continue;
+    }
+    const bool Angled = Line.front() == '<';
+    Callback(Line.drop_front().split(Angled ? '>' : '"').first, Angled);
+  }
+}
+
+namespace {
+// Returns the arguments the driver would run the frontend with, or an empty
+// vector if it can't tell.
+std::vector<std::string> getFrontendArguments(const CompileCommand &Command) {
+  const auto Args = getSyntaxOnlyArgs(Command);
+  std::vector<const char *> Argv;
+  for (const auto &Arg : Args)
+    Argv.push_back(Arg.c_str());
+
+  IgnoringDiagConsumer DiagConsumer;
+  DiagnosticsEngine Diagnostics(
+      llvm::IntrusiveRefCntPtr<DiagnosticIDs>(new DiagnosticIDs()),
+      new DiagnosticOptions(), &DiagConsumer, false);
+  clang::driver::Driver Driver(Argv.front(),
+                               llvm::sys::getDefaultTargetTriple(),
+                               Diagnostics);
+  Driver.setCheckInputsExist(false);
+  std::unique_ptr<clang::driver::Compilation> Compilation(
+      Driver.BuildCompilation(Argv));
+  if (!Compilation)
+    return std::vector<std::string>();
+  // Same checks as ClangTool's
+  const auto &Jobs = Compilation->getJobs();
+  if (Jobs.size() != 1 || !llvm::isa<clang::driver::Command>(*Jobs.begin()))
+    return std::vector<std::string>();
+  const auto &Job = llvm::cast<clang::driver::Command>(*Jobs.begin());
+  if (StringRef(Job.getCreator().getName()) != "clang")
+    return std::vector<std::string>();
+  return std::vector<std::string>(Job.getArguments().begin(),
+                                  Job.getArguments().end());
+}
+
+// Returns the path Spelled refers to in Dir, if it exists
+std::string lookup(StringRef Dir, StringRef Spelled) {
+  auto Path = makeAbsolute(Dir, Spelled);
+  return llvm::sys::fs::exists(Path) ? Path : std::string();
+}
+}
+
+IncludePaths IncludePaths::fromCommand(const CompileCommand &Command) {
+  IncludePaths Paths;
+  Paths.Directory = Command.Directory;
+  std::vector<std::string> System;
+  std::vector<std::string> After;
+  auto Args = getFrontendArguments(Command);
+  if (Args.empty())
+    Args = Command.CommandLine;
+  for (size_t I = 0; I < Args.size(); ++I) {
+    const StringRef Arg = Args[I];
+    if (Arg == "-fmodules" || Arg.startswith("-fmodule-file=")) {
+      Paths.Precompiled = true;
+      continue;
+    }
+    std::vector<std::string> *Into = nullptr;
+    StringRef Flag;
+    bool IsPath = true;
+    if (Arg.startswith("-internal-isystem")) {
+      Into = &System;
+      Flag = "-internal-isystem";
+    } else if (Arg.startswith("-internal-externc-isystem")) {
+      Into = &System;
+      Flag = "-internal-externc-isystem";
+    } else if (Arg.startswith("-include-pch")) {
+      Paths.Precompiled = true;
+      ++I;
+      continue;
+    } else if (Arg.startswith("-include")) {
+      Into = &Paths.Forced;
+      Flag = "-include";
+      IsPath = false;
+    } else if (Arg.startswith("-imacros")) {
+      Into = &Paths.Forced;
+      Flag = "-imacros";
+      IsPath = false;
+    } else if (Arg.startswith("-iquote")) {
+      Into = &Paths.Quoted;
+      Flag = "-iquote";
+    } else if (Arg.startswith("-isystem")) {
+      Into = &Paths.Angled;
+      Flag = "-isystem";
+    } else if (Arg.startswith("-idirafter")) {
+      Into = &After;
+      Flag = "-idirafter";
+    } else if (Arg.startswith("-I")) {
+      Into = &Paths.Angled;
+      Flag = "-I";
+    } else {
+      continue;
+    }
+    // Both -I<dir> and -I <dir>
+    auto Value = Arg.drop_front(Flag.size());
+    if (Value.empty() && I + 1 < Args.size())
+      Value = Args[++I];
+    if (!Value.empty())
+      Into->push_back(IsPath ? makeAbsolute(Command.Directory, Value)
+                             : Value.str());
+  }
+  Paths.Angled.insert(Paths.Angled.end(), System.begin(), System.end());
+  Paths.Angled.insert(Paths.Angled.end(), After.begin(), After.end());
+  return Paths;
+}
+
+std::string IncludePaths::resolve(StringRef Includer, StringRef Spelled,
+                                  bool IsAngled) const {
+  if (Spelled.empty())
+    return std::string();
+  if (llvm::sys::path::is_absolute(Spelled))
+    return llvm::sys::fs::exists(Spelled) ? Spelled.str() : std::string();
+
+  if (!IsAngled) {
+    auto Path = lookup(llvm::sys::path::parent_path(Includer), Spelled);
+    if (!Path.empty())
+      return Path;
+    for (const auto &Dir : Quoted) {
+      Path = lookup(Dir, Spelled);
+      if (!Path.empty())
+        return Path;
+    }
+  }
+  for (const auto &Dir : Angled) {
+    auto Path = lookup(Dir, Spelled);
+    if (!Path.empty())
+      return Path;
+  }
+  return std::string();
+}
+
+std::string IncludePaths::resolveForced(StringRef Spelled) const {
+  if (Spelled.empty())
+    return std::string();
+  auto Path = lookup(Directory, Spelled);
+  if (!Path.empty())
+    return Path;
+  // The rest of the search is the same as for an #include "..."
+  for (const auto &Dir : Quoted) {
+    Path = lookup(Dir, Spelled);
+    if (!Path.empty())
+      return Path;
+  }
+  return resolve(StringRef(), Spelled, /*Angled=*/true);
+}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <string>
+#include <vector>
+
+namespace rn {
+
+// Calls Callback with the path spelled in every #include (or #import)
+// directive in Buffer, and whether it was spelled with angle brackets.
+// Directives that include a macro are reported with an empty path.
+// This is purely textual, so directives in inactive conditional blocks are
+// reported too.
+void scanIncludeDirectives(
+    ::llvm::StringRef Buffer,
+    ::llvm::function_ref<void(::llvm::StringRef, bool)> Callback);
+
+// The include paths of a compile command, made absolute
+struct IncludePaths {
+  IncludePaths() : Precompiled(false) {}
+
+  // The compiler driver is asked for the arguments it would run the frontend
+  // with, so the paths it adds itself, like those of the builtin headers and
+  // of the standard library, are known too. The command's own arguments are
+  // used if the driver can't be run.
+  static IncludePaths
+  fromCommand(const ::clang::tooling::CompileCommand &Command);
+
+  // Returns the path of the file that Spelled, as written in an #include in
+  // Includer, refers to, or an empty string if it can't be found.
+  std::string resolve(::llvm::StringRef Includer, ::llvm::StringRef Spelled,
+                      bool Angled) const;
+
+  // Same as above for a file given with -include, which is looked for in the
+  // working directory first.
+  std::string resolveForced(::llvm::StringRef Spelled) const;
+
+  std::string Directory;
+  // -iquote
+  std::vector<std::string> Quoted;
+  // -I, -isystem, the driver's system directories and -idirafter, in the
+  // order they are searched
+  std::vector<std::string> Angled;
+  // -include and -imacros, as spelled
+  std::vector<std::string> Forced;
+  // Whether a precompiled header or a module is used, which can't be scanned
+  bool Precompiled;
+};
+}
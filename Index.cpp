@@ -0,0 +1,673 @@
+#include "Rename/Index.h"
+#include "Rename/Nodes.h"
+#include "Rename/Parallel.h"
+
+#include <clang/AST/ASTConsumer.h>
+#include <clang/Basic/FileManager.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/EndianStream.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <iterator>
+#include <atomic>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+using clang::ASTConsumer;
+using clang::ASTContext;
+using clang::FileEntry;
+using clang::NamedDecl;
+using clang::SourceLocation;
+using clang::SourceManager;
+using clang::tooling::CompilationDatabase;
+using clang::tooling::CompileCommand;
+using clang::tooling::newFrontendActionFactory;
+
+using clang::ast_matchers::MatchFinder;
+
+using llvm::ArrayRef;
+using llvm::StringRef;
+using llvm::support::endian::read32le;
+using llvm::support::endian::read64le;
+
+namespace rn {
+
+// The layout of an index file. All the integers are little endian.
+//
+//   Header:       Magic, Version, NumFiles, NumUSRs, NumOccurrences,
+//                 NumTranslationUnits, NumDependencies, StringsSize (u32 each)
+//   Files:        { Name, NameSize (u32), Size, ModificationTime,
+//                   StampTime (u64), Hash (16 bytes) }, where the times are
+//                   in nanoseconds and StampTime is when the file's
+//                   translation unit started to be parsed
+//   USRs:         { Name, NameSize, FirstOccurrence, NumOccurrences (u32) },
+//                 sorted by name
+//   Occurrences:  { File, Offset, Length (u32) }, grouped by USR
+//   TUs:          { MainFile, FirstDependency, NumDependencies (u32),
+//                   CommandHash (16 bytes) }
+//   Dependencies: { File (u32) }
+//   Strings:      the names, which are referred to by offset
+namespace {
+const uint32_t IndexMagic = 0x58494e52; // "RNIX"
+const uint32_t IndexVersion = 3;
+
+const size_t HeaderSize = 8 * 4;
+const size_t FileEntrySize = 2 * 4 + 3 * 8 + 16;
+const size_t USREntrySize = 4 * 4;
+const size_t OccurrenceEntrySize = 3 * 4;
+const size_t TranslationUnitEntrySize = 3 * 4 + 16;
+const size_t DependencyEntrySize = 4;
+
+const unsigned NoUSR = ~0u;
+const unsigned NoFile = ~0u;
+
+Digest readDigest(const char *Data) {
+  Digest Hash;
+  std::copy(Data, Data + Hash.size(), Hash.begin());
+  return Hash;
+}
+
+// Reads the stamp of the file whose entry in the file table is Entry
+void readFileRecord(const char *Entry, FileStamp &Stamp, uint64_t &StampTime) {
+  Stamp.Size = read64le(Entry + 8);
+  Stamp.ModificationTime = read64le(Entry + 16);
+  StampTime = read64le(Entry + 24);
+  Stamp.Hash = readDigest(Entry + 32);
+}
+
+class IndexConsumer : public ASTConsumer {
+public:
+  IndexConsumer(IndexBuilder &Index, const Digest &Command, uint64_t StampTime)
+      : Index(Index), Command(Command), StampTime(StampTime) {}
+
+  void HandleTranslationUnit(ASTContext &Context) override {
+    Index.addTranslationUnit(Context, Command, StampTime);
+  }
+
+private:
+  IndexBuilder &Index;
+  const Digest &Command;
+  uint64_t StampTime;
+};
+
+struct IndexConsumerFactory {
+  IndexConsumerFactory(IndexBuilder &Index, const Digest &Command,
+                       uint64_t StampTime)
+      : Index(Index), Command(Command), StampTime(StampTime) {}
+
+  std::unique_ptr<ASTConsumer> newASTConsumer() {
+    return llvm::make_unique<IndexConsumer>(Index, Command, StampTime);
+  }
+
+  IndexBuilder &Index;
+  const Digest &Command;
+  uint64_t StampTime;
+};
+}
+
+void IndexBuilder::addTranslationUnit(ASTContext &Context,
+                                      const Digest &Command,
+                                      uint64_t StampTime) {
+  DeclUSRs.clear();
+  EntryIDs.clear();
+  this->StampTime = StampTime;
+
+  MatchFinder Finder;
+  NodeHandlers<IndexHandler> Handlers(this);
+  Handlers.addMatchers(Finder);
+  Finder.matchAST(Context);
+
+  // Remember what the translation unit was made of, to know when it's stale
+  const auto &SourceMgr = Context.getSourceManager();
+  const auto *MainEntry =
+      SourceMgr.getFileEntryForID(SourceMgr.getMainFileID());
+  if (MainEntry == nullptr)
+    return;
+  TranslationUnit TU;
+  TU.MainFile = getFileID(SourceMgr, MainEntry);
+  TU.Command = Command;
+  for (auto I = SourceMgr.fileinfo_begin(), E = SourceMgr.fileinfo_end();
+       I != E; ++I) {
+    if (I->first != MainEntry)
+      TU.Dependencies.push_back(getFileID(SourceMgr, I->first));
+  }
+  std::sort(TU.Dependencies.begin(), TU.Dependencies.end());
+  TranslationUnits.push_back(std::move(TU));
+}
+
+void IndexBuilder::addOccurrence(const SourceManager &SourceMgr,
+                                 const NamedDecl *Decl, SourceLocation Loc,
+                                 unsigned Length) {
+  // Occurrences in macros can't be renamed
+  if (Length == 0 || Loc.isInvalid() || Loc.isMacroID())
+    return;
+  const auto Decomposed = SourceMgr.getDecomposedLoc(Loc);
+  const auto *Entry = SourceMgr.getFileEntryForID(Decomposed.first);
+  if (Entry == nullptr)
+    return;
+
+  const auto *Canonical = Decl->getCanonicalDecl();
+  auto Found = DeclUSRs.find(Canonical);
+  if (Found == DeclUSRs.end()) {
+    const auto USR = getUSRForDecl(Decl);
+    Found = DeclUSRs
+                .insert(std::make_pair(Canonical,
+                                       USR.empty() ? NoUSR : getUSRID(USR)))
+                .first;
+  }
+  if (Found->second == NoUSR)
+    return;
+
+  Occurrence O;
+  O.USR = Found->second;
+  O.File = getFileID(SourceMgr, Entry);
+  O.Offset = Decomposed.second;
+  O.Length = Length;
+  Occurrences.push_back(O);
+}
+
+void IndexBuilder::merge(const IndexBuilder &Other) {
+  std::vector<unsigned> FileMap;
+  for (const auto &File : Other.Files)
+    FileMap.push_back(getFileID(File));
+  std::vector<unsigned> USRMap;
+  for (const auto &USR : Other.USRs)
+    USRMap.push_back(getUSRID(USR));
+
+  for (auto O : Other.Occurrences) {
+    O.USR = USRMap[O.USR];
+    O.File = FileMap[O.File];
+    Occurrences.push_back(O);
+  }
+  for (const auto &OtherTU : Other.TranslationUnits) {
+    TranslationUnit TU;
+    TU.MainFile = FileMap[OtherTU.MainFile];
+    TU.Command = OtherTU.Command;
+    for (const auto File : OtherTU.Dependencies)
+      TU.Dependencies.push_back(FileMap[File]);
+    std::sort(TU.Dependencies.begin(), TU.Dependencies.end());
+    TranslationUnits.push_back(std::move(TU));
+  }
+}
+
+unsigned IndexBuilder::getFileID(const SourceManager &SourceMgr,
+                                 const FileEntry *Entry) {
+  auto Found = EntryIDs.find(Entry);
+  if (Found != EntryIDs.end())
+    return Found->second;
+
+  FileRecord Record;
+  Record.Name = getAbsoluteName(SourceMgr.getFileManager(), Entry);
+  auto Known = FileIDs.find(Record.Name);
+  if (Known != FileIDs.end()) {
+    EntryIDs.insert(std::make_pair(Entry, Known->second));
+    return Known->second;
+  }
+  // The contents are already in memory, since the file was parsed
+  bool Invalid = false;
+  const auto *Buffer = SourceMgr.getMemoryBufferForFile(Entry, &Invalid);
+  const bool Stamped =
+      Buffer != nullptr && !Invalid
+          ? stampFile(Record.Name, Buffer->getBuffer(), Record.Stamp)
+          : stampFile(Record.Name, Record.Stamp);
+  // A file that is gone makes its translation units stale
+  if (!Stamped) {
+    Record.Stamp = FileStamp();
+    Record.Stamp.Size = std::numeric_limits<uint64_t>::max();
+  }
+  Record.StampTime = StampTime;
+  const auto ID = getFileID(Record);
+  EntryIDs.insert(std::make_pair(Entry, ID));
+  return ID;
+}
+
+unsigned IndexBuilder::getFileID(const FileRecord &Record) {
+  const auto Inserted = FileIDs.insert(
+      std::make_pair(Record.Name, static_cast<unsigned>(Files.size())));
+  if (Inserted.second)
+    Files.push_back(Record);
+  return Inserted.first->second;
+}
+
+void IndexBuilder::addFromIndex(const OccurrenceIndex &Old,
+                                ArrayRef<unsigned> Units,
+                                llvm::function_ref<bool(unsigned)> KeepFile) {
+  std::vector<unsigned> FileMap(Old.NumFiles, NoFile);
+  auto MapFile = [&](unsigned File) {
+    if (FileMap[File] != NoFile)
+      return FileMap[File];
+    const char *Entry = Old.FileTable + File * FileEntrySize;
+    FileRecord Record;
+    Record.Name = Old.getString(Entry);
+    readFileRecord(Entry, Record.Stamp, Record.StampTime);
+    // The file may have been touched without being changed, so remember when
+    // it was last modified to not have to hash it again next time
+    restampFile(Record.Name, Record.Stamp, Record.StampTime);
+    FileMap[File] = getFileID(Record);
+    return FileMap[File];
+  };
+
+  for (const auto Unit : Units) {
+    llvm::SmallVector<unsigned, 64> UnitFiles;
+    Old.getTranslationUnitFiles(Unit, UnitFiles);
+    TranslationUnit TU;
+    TU.MainFile = MapFile(UnitFiles.front());
+    TU.Command = Old.getCommandHash(Unit);
+    for (size_t I = 1; I < UnitFiles.size(); ++I)
+      TU.Dependencies.push_back(MapFile(UnitFiles[I]));
+    std::sort(TU.Dependencies.begin(), TU.Dependencies.end());
+    TranslationUnits.push_back(std::move(TU));
+  }
+
+  for (uint32_t I = 0; I < Old.NumUSRs; ++I) {
+    const char *Entry = Old.USRTable + I * USREntrySize;
+    unsigned USR = NoUSR;
+    const auto First = read32le(Entry + 8);
+    const auto Count = read32le(Entry + 12);
+    for (uint32_t J = First; J < First + Count && J < Old.NumOccurrences;
+         ++J) {
+      const char *O = Old.OccurrenceTable + J * OccurrenceEntrySize;
+      const auto File = read32le(O);
+      if (File >= Old.NumFiles || !KeepFile(File))
+        continue;
+      if (USR == NoUSR)
+        USR = getUSRID(Old.getString(Entry));
+      Occurrence Copy;
+      Copy.USR = USR;
+      Copy.File = MapFile(File);
+      Copy.Offset = read32le(O + 4);
+      Copy.Length = read32le(O + 8);
+      Occurrences.push_back(Copy);
+    }
+  }
+}
+
+unsigned IndexBuilder::getUSRID(StringRef USR) {
+  const auto Inserted =
+      USRIDs.insert(std::make_pair(USR, static_cast<unsigned>(USRs.size())));
+  if (Inserted.second)
+    USRs.push_back(USR);
+  return Inserted.first->second;
+}
+
+bool IndexBuilder::write(StringRef Path) const {
+  // The USRs are sorted so they can be binary searched, and the occurrences
+  // are grouped by USR. Headers are seen by many translation units, so their
+  // occurrences are deduplicated here.
+  std::vector<unsigned> Order(USRs.size());
+  std::iota(Order.begin(), Order.end(), 0);
+  std::sort(Order.begin(), Order.end(),
+            [&](unsigned L, unsigned R) { return USRs[L] < USRs[R]; });
+  std::vector<unsigned> Rank(USRs.size());
+  for (unsigned I = 0; I < Order.size(); ++I)
+    Rank[Order[I]] = I;
+
+  auto Sorted = Occurrences;
+  for (auto &O : Sorted)
+    O.USR = Rank[O.USR];
+  auto Key = [](const Occurrence &O) {
+    return std::make_tuple(O.USR, O.File, O.Offset, O.Length);
+  };
+  std::sort(Sorted.begin(), Sorted.end(),
+            [&](const Occurrence &L, const Occurrence &R) {
+              return Key(L) < Key(R);
+            });
+  Sorted.erase(std::unique(Sorted.begin(), Sorted.end(),
+                           [&](const Occurrence &L, const Occurrence &R) {
+                             return Key(L) == Key(R);
+                           }),
+               Sorted.end());
+
+  uint32_t NumDependencies = 0;
+  for (const auto &TU : TranslationUnits)
+    NumDependencies += TU.Dependencies.size();
+  uint32_t StringsSize = 0;
+  for (const auto &File : Files)
+    StringsSize += File.Name.size();
+  for (const auto &USR : USRs)
+    StringsSize += USR.size();
+
+  llvm::SmallString<128> TempPath;
+  int FD;
+  if (llvm::sys::fs::createUniqueFile(Path + ".tmp-%%%%%%", FD, TempPath))
+    return false;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    llvm::support::endian::Writer<llvm::support::little> Out(OS);
+
+    Out.write<uint32_t>(IndexMagic);
+    Out.write<uint32_t>(IndexVersion);
+    Out.write<uint32_t>(Files.size());
+    Out.write<uint32_t>(USRs.size());
+    Out.write<uint32_t>(Sorted.size());
+    Out.write<uint32_t>(TranslationUnits.size());
+    Out.write<uint32_t>(NumDependencies);
+    Out.write<uint32_t>(StringsSize);
+
+    uint32_t StringOffset = 0;
+    for (const auto &File : Files) {
+      Out.write<uint32_t>(StringOffset);
+      Out.write<uint32_t>(File.Name.size());
+      Out.write<uint64_t>(File.Stamp.Size);
+      Out.write<uint64_t>(File.Stamp.ModificationTime);
+      Out.write<uint64_t>(File.StampTime);
+      OS.write(reinterpret_cast<const char *>(File.Stamp.Hash.data()),
+               File.Stamp.Hash.size());
+      StringOffset += File.Name.size();
+    }
+    size_t Next = 0;
+    for (unsigned I = 0; I < Order.size(); ++I) {
+      const auto First = Next;
+      while (Next < Sorted.size() && Sorted[Next].USR == I)
+        ++Next;
+      Out.write<uint32_t>(StringOffset);
+      Out.write<uint32_t>(USRs[Order[I]].size());
+      Out.write<uint32_t>(First);
+      Out.write<uint32_t>(Next - First);
+      StringOffset += USRs[Order[I]].size();
+    }
+    for (const auto &O : Sorted) {
+      Out.write<uint32_t>(O.File);
+      Out.write<uint32_t>(O.Offset);
+      Out.write<uint32_t>(O.Length);
+    }
+    uint32_t FirstDependency = 0;
+    for (const auto &TU : TranslationUnits) {
+      Out.write<uint32_t>(TU.MainFile);
+      Out.write<uint32_t>(FirstDependency);
+      Out.write<uint32_t>(TU.Dependencies.size());
+      OS.write(reinterpret_cast<const char *>(TU.Command.data()),
+               TU.Command.size());
+      FirstDependency += TU.Dependencies.size();
+    }
+    for (const auto &TU : TranslationUnits) {
+      for (const auto File : TU.Dependencies)
+        Out.write<uint32_t>(File);
+    }
+    for (const auto &File : Files)
+      OS << File.Name;
+    for (const auto Index : Order)
+      OS << USRs[Index];
+
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      llvm::sys::fs::remove(TempPath);
+      return false;
+    }
+  }
+  return !llvm::sys::fs::rename(TempPath, Path);
+}
+
+int buildIndex(const CompilationDatabase &Compilations,
+               const std::vector<std::string> &Files, StringRef Path,
+               unsigned Jobs, bool Update,
+               clang::DiagnosticConsumer *DiagConsumer) {
+  bool FileSkipped = false;
+  const auto Tasks = getCompileCommands(Compilations, Files, &FileSkipped);
+  std::vector<Digest> Commands;
+  for (const auto &Task : Tasks)
+    Commands.push_back(hashCompileCommand(Task.second));
+
+  // Each worker builds its own index, and they are merged at the end
+  WorkStealingExecutor Executor(Jobs);
+  std::vector<IndexBuilder> Builders(Executor.getNumWorkers());
+
+  // When updating, a translation unit is kept if it was indexed with the same
+  // compile command and none of its files changed since
+  std::vector<size_t> Parse;
+  std::unique_ptr<OccurrenceIndex> Old;
+  if (Update)
+    Old = OccurrenceIndex::load(Path);
+  if (Old) {
+    const auto NumUnits = Old->getNumTranslationUnits();
+    std::vector<bool> Kept(NumUnits, false), Superseded(NumUnits, false);
+    std::vector<unsigned> TaskUnits(Tasks.size(), NoFile);
+    llvm::DenseSet<unsigned> ParsedMainFiles;
+    std::vector<unsigned> MainFiles(Tasks.size(), NoFile);
+    for (size_t I = 0; I < Tasks.size(); ++I) {
+      llvm::SmallVector<unsigned, 1> Units;
+      if (!Old->lookupFile(Tasks[I].first, &MainFiles[I]) ||
+          !Old->findTranslationUnits(MainFiles[I], Units))
+        continue;
+      for (const auto Unit : Units) {
+        Superseded[Unit] = true;
+        if (TaskUnits[I] == NoFile && !Kept[Unit] &&
+            Old->getCommandHash(Unit) == Commands[I] && Old->isFresh(Unit)) {
+          Kept[Unit] = true;
+          TaskUnits[I] = Unit;
+        }
+      }
+      if (TaskUnits[I] == NoFile)
+        ParsedMainFiles.insert(MainFiles[I]);
+    }
+    // The occurrences in a main file that is parsed again are all replaced,
+    // so the other compile commands of that file are parsed again too
+    for (size_t I = 0; I < Tasks.size(); ++I) {
+      if (TaskUnits[I] != NoFile && ParsedMainFiles.count(MainFiles[I])) {
+        Kept[TaskUnits[I]] = false;
+        TaskUnits[I] = NoFile;
+      }
+      if (TaskUnits[I] == NoFile)
+        Parse.push_back(I);
+    }
+
+    // The translation units that weren't asked about are kept as long as
+    // they're up to date. The index doesn't record which translation unit an
+    // occurrence came from, so only the occurrences in the files of the kept
+    // translation units are kept, and none of those in the files of the ones
+    // that are parsed again, which find them again.
+    std::vector<unsigned> KeptUnits;
+    llvm::DenseSet<unsigned> KeptFiles, ParsedFiles;
+    for (unsigned Unit = 0; Unit < NumUnits; ++Unit) {
+      llvm::SmallVector<unsigned, 64> UnitFiles;
+      Old->getTranslationUnitFiles(Unit, UnitFiles);
+      if (Kept[Unit] || (!Superseded[Unit] && Old->isFresh(Unit))) {
+        KeptUnits.push_back(Unit);
+        KeptFiles.insert(UnitFiles.begin(), UnitFiles.end());
+      } else if (ParsedMainFiles.count(UnitFiles.front())) {
+        ParsedFiles.insert(UnitFiles.begin(), UnitFiles.end());
+      }
+    }
+    Builders.front().addFromIndex(*Old, KeptUnits, [&](unsigned File) {
+      return KeptFiles.count(File) && !ParsedFiles.count(File);
+    });
+  } else {
+    for (size_t I = 0; I < Tasks.size(); ++I)
+      Parse.push_back(I);
+  }
+
+  std::atomic<bool> ProcessingFailed(false);
+  SynchronizedDiagConsumer Diagnostics(DiagConsumer);
+  Executor.run(Parse.size(), [&](size_t Index, unsigned Worker) {
+    const auto Task = Parse[Index];
+    // Taken before the files are read
+    IndexConsumerFactory Factory(Builders[Worker], Commands[Task],
+                                 getStampTime());
+    if (!runOnCompileCommand(Tasks[Task].second, Tasks[Task].first,
+                             newFrontendActionFactory(&Factory).get(),
+                             Diagnostics.get()))
+      ProcessingFailed = true;
+  });
+  for (size_t Worker = 1; Worker < Builders.size(); ++Worker)
+    Builders.front().merge(Builders[Worker]);
+
+  // A translation unit that failed to parse may have been indexed partly, so
+  // it would look up to date with some of its occurrences missing. An index
+  // that is already there is kept instead.
+  Old.reset();
+  if (ProcessingFailed && llvm::sys::fs::exists(Path)) {
+    llvm::errs() << "rn: kept the index at " << Path
+                 << ", since some files failed to parse.\n";
+    return 1;
+  }
+  // The new index replaces the old one in a single rename, so a rename
+  // running at the same time sees one or the other
+  if (!Builders.front().write(Path)) {
+    llvm::errs() << "rn: failed to write the index to " << Path << ".\n";
+    return 1;
+  }
+  return ProcessingFailed ? 1 : FileSkipped ? 2 : 0;
+}
+
+OccurrenceIndex::OccurrenceIndex(std::unique_ptr<llvm::MemoryBuffer> Buffer)
+    : Buffer(std::move(Buffer)), NumFiles(0), NumUSRs(0), NumOccurrences(0),
+      NumTranslationUnits(0), NumDependencies(0), StringsSize(0),
+      FileTable(nullptr), USRTable(nullptr), OccurrenceTable(nullptr),
+      TranslationUnitTable(nullptr), DependencyTable(nullptr),
+      Strings(nullptr) {}
+
+std::unique_ptr<OccurrenceIndex> OccurrenceIndex::load(StringRef Path) {
+  // Don't require a null terminator, so the file gets mmap'd
+  auto Buffer = llvm::MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                            /*RequiresNullTerminator=*/false);
+  if (!Buffer)
+    return nullptr;
+  std::unique_ptr<OccurrenceIndex> Index(
+      new OccurrenceIndex(std::move(*Buffer)));
+  if (!Index->parse())
+    return nullptr;
+  return Index;
+}
+
+bool OccurrenceIndex::parse() {
+  const char *Data = Buffer->getBufferStart();
+  const uint64_t Size = Buffer->getBufferSize();
+  if (Size < HeaderSize || read32le(Data) != IndexMagic ||
+      read32le(Data + 4) != IndexVersion)
+    return false;
+  NumFiles = read32le(Data + 8);
+  NumUSRs = read32le(Data + 12);
+  NumOccurrences = read32le(Data + 16);
+  NumTranslationUnits = read32le(Data + 20);
+  NumDependencies = read32le(Data + 24);
+  StringsSize = read32le(Data + 28);
+
+  uint64_t Offset = HeaderSize;
+  auto Table = [&](uint64_t EntrySize, uint64_t Count) {
+    const char *Start = Data + std::min(Offset, Size);
+    Offset += EntrySize * Count;
+    return Start;
+  };
+  FileTable = Table(FileEntrySize, NumFiles);
+  USRTable = Table(USREntrySize, NumUSRs);
+  OccurrenceTable = Table(OccurrenceEntrySize, NumOccurrences);
+  TranslationUnitTable = Table(TranslationUnitEntrySize, NumTranslationUnits);
+  DependencyTable = Table(DependencyEntrySize, NumDependencies);
+  Strings = Table(1, StringsSize);
+  return Offset == Size;
+}
+
+StringRef OccurrenceIndex::getString(const char *Entry) const {
+  const auto Offset = read32le(Entry);
+  const auto Length = read32le(Entry + 4);
+  if (uint64_t(Offset) + Length > StringsSize)
+    return StringRef();
+  return StringRef(Strings + Offset, Length);
+}
+
+void OccurrenceIndex::forEachOccurrence(
+    StringRef USR,
+    llvm::function_ref<void(unsigned, unsigned, unsigned)> Callback) const {
+  // Binary search the sorted USR table
+  uint32_t Low = 0, High = NumUSRs;
+  while (Low < High) {
+    const auto Middle = Low + (High - Low) / 2;
+    if (getString(USRTable + Middle * USREntrySize) < USR)
+      Low = Middle + 1;
+    else
+      High = Middle;
+  }
+  if (Low == NumUSRs)
+    return;
+  const char *Entry = USRTable + Low * USREntrySize;
+  if (getString(Entry) != USR)
+    return;
+
+  const auto First = read32le(Entry + 8);
+  const auto Count = read32le(Entry + 12);
+  for (uint32_t I = First; I < First + Count && I < NumOccurrences; ++I) {
+    const char *O = OccurrenceTable + I * OccurrenceEntrySize;
+    Callback(read32le(O), read32le(O + 4), read32le(O + 8));
+  }
+}
+
+StringRef OccurrenceIndex::getFileName(unsigned File) const {
+  if (File >= NumFiles)
+    return StringRef();
+  return getString(FileTable + File * FileEntrySize);
+}
+
+bool OccurrenceIndex::isStale(unsigned File) const {
+  if (File >= NumFiles)
+    return true;
+  auto Found = Staleness.find(File);
+  if (Found != Staleness.end())
+    return Found->second;
+
+  const char *Entry = FileTable + File * FileEntrySize;
+  FileStamp Stamp;
+  uint64_t StampTime;
+  readFileRecord(Entry, Stamp, StampTime);
+  const bool Stale = hasChanged(getString(Entry), Stamp, StampTime);
+  Staleness.insert(std::make_pair(File, Stale));
+  return Stale;
+}
+
+bool OccurrenceIndex::lookupFile(StringRef Path, unsigned *File) const {
+  if (FileIDs.empty()) {
+    for (uint32_t I = 0; I < NumFiles; ++I)
+      FileIDs.insert(std::make_pair(getFileName(I), I));
+  }
+  auto Found = FileIDs.find(Path);
+  if (Found == FileIDs.end())
+    return false;
+  *File = Found->second;
+  return true;
+}
+
+bool OccurrenceIndex::findTranslationUnits(
+    unsigned MainFile, llvm::SmallVectorImpl<unsigned> &Units) const {
+  if (MainFileTranslationUnits.empty()) {
+    for (uint32_t I = 0; I < NumTranslationUnits; ++I) {
+      const char *Entry = TranslationUnitTable + I * TranslationUnitEntrySize;
+      MainFileTranslationUnits[read32le(Entry)].push_back(I);
+    }
+  }
+  auto Found = MainFileTranslationUnits.find(MainFile);
+  if (Found == MainFileTranslationUnits.end())
+    return false;
+  Units.append(Found->second.begin(), Found->second.end());
+  return true;
+}
+
+Digest OccurrenceIndex::getCommandHash(unsigned Unit) const {
+  return readDigest(TranslationUnitTable + Unit * TranslationUnitEntrySize +
+                    12);
+}
+
+void OccurrenceIndex::getTranslationUnitFiles(
+    unsigned Unit, llvm::SmallVectorImpl<unsigned> &Files) const {
+  const char *Entry = TranslationUnitTable + Unit * TranslationUnitEntrySize;
+  Files.push_back(read32le(Entry));
+  const auto First = read32le(Entry + 4);
+  const auto Count = read32le(Entry + 8);
+  for (uint32_t I = First; I < First + Count && I < NumDependencies; ++I)
+    Files.push_back(read32le(DependencyTable + I * DependencyEntrySize));
+}
+
+bool OccurrenceIndex::isFresh(unsigned Unit) const {
+  llvm::SmallVector<unsigned, 64> Files;
+  getTranslationUnitFiles(Unit, Files);
+  return std::none_of(Files.begin(), Files.end(),
+                      [&](unsigned File) { return isStale(File); });
+}
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "Rename/Digest.h"
+#include "Rename/Utility.h"
+
+#include <clang/AST/AST.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rn {
+
+class OccurrenceIndex;
+
+// Collects every (USR, file, offset, length) occurrence of every symbol in the
+// translation units it is given, and writes them to an index file that
+// OccurrenceIndex can read back.
+class IndexBuilder {
+public:
+  IndexBuilder() : StampTime(0) {}
+
+  // Runs the index matchers over a translation unit, which was parsed with
+  // the compile command whose hash is Command, after StampTime.
+  void addTranslationUnit(::clang::ASTContext &Context, const Digest &Command,
+                          uint64_t StampTime);
+
+  // Records an occurrence of Decl at Loc, with the given length.
+  void addOccurrence(const ::clang::SourceManager &SourceMgr,
+                     const ::clang::NamedDecl *Decl,
+                     ::clang::SourceLocation Loc, unsigned Length);
+
+  // Copies the translation units Units of Old, and the occurrences in Old that
+  // are in the files for which KeepFile() returns true.
+  void addFromIndex(const OccurrenceIndex &Old, ::llvm::ArrayRef<unsigned> Units,
+                    ::llvm::function_ref<bool(unsigned)> KeepFile);
+
+  // Adds everything Other has collected to this index.
+  void merge(const IndexBuilder &Other);
+
+  // Writes the index to Path, replacing it atomically. Returns true on success.
+  bool write(::llvm::StringRef Path) const;
+
+private:
+  struct FileRecord {
+    std::string Name;
+    FileStamp Stamp;
+    // When the translation unit the file was stamped in started to be parsed
+    uint64_t StampTime;
+  };
+
+  struct Occurrence {
+    unsigned USR;
+    unsigned File;
+    unsigned Offset;
+    unsigned Length;
+  };
+
+  struct TranslationUnit {
+    unsigned MainFile;
+    Digest Command;
+    std::vector<unsigned> Dependencies;
+  };
+
+  unsigned getFileID(const ::clang::SourceManager &SourceMgr,
+                     const ::clang::FileEntry *Entry);
+  unsigned getFileID(const FileRecord &Record);
+  unsigned getUSRID(::llvm::StringRef USR);
+
+  std::vector<FileRecord> Files;
+  ::llvm::StringMap<unsigned> FileIDs;
+  std::vector<std::string> USRs;
+  ::llvm::StringMap<unsigned> USRIDs;
+  std::vector<Occurrence> Occurrences;
+  std::vector<TranslationUnit> TranslationUnits;
+
+  // The USR ID of every canonical declaration seen in the current
+  // translation unit, so each USR is only generated once per declaration
+  ::llvm::DenseMap<const ::clang::Decl *, unsigned> DeclUSRs;
+  // The file ID of every file entry seen in the current translation unit
+  ::llvm::DenseMap<const ::clang::FileEntry *, unsigned> EntryIDs;
+  // When the current translation unit started to be parsed
+  uint64_t StampTime;
+};
+
+// Builds the index for Files, and writes it to Path. With Update, the
+// translation units of the existing index at Path whose compile command and
+// files didn't change are kept, and only the others are parsed. If some
+// translation unit can't be parsed, an existing index is left as it is.
+// Returns 0 on success, like ClangTool::run().
+int buildIndex(const ::clang::tooling::CompilationDatabase &Compilations,
+               const std::vector<std::string> &Files, ::llvm::StringRef Path,
+               unsigned Jobs, bool Update,
+               ::clang::DiagnosticConsumer *DiagConsumer);
+
+// A memory mapped index file written by IndexBuilder.
+class OccurrenceIndex {
+public:
+  // Returns nullptr if the file can't be read or isn't an index.
+  static std::unique_ptr<OccurrenceIndex> load(::llvm::StringRef Path);
+
+  // Calls Callback(File, Offset, Length) for every occurrence of USR.
+  void forEachOccurrence(
+      ::llvm::StringRef USR,
+      ::llvm::function_ref<void(unsigned, unsigned, unsigned)> Callback) const;
+
+  ::llvm::StringRef getFileName(unsigned File) const;
+
+  // Returns true if the contents of File changed since it was indexed, like
+  // hasChanged() tells.
+  bool isStale(unsigned File) const;
+
+  // Returns the ID of the file at the absolute Path, if it was indexed.
+  bool lookupFile(::llvm::StringRef Path, unsigned *File) const;
+
+  unsigned getNumTranslationUnits() const { return NumTranslationUnits; }
+
+  // Adds the translation units with the given MainFile to Units. Returns
+  // false if MainFile wasn't indexed as a translation unit.
+  bool findTranslationUnits(unsigned MainFile,
+                            ::llvm::SmallVectorImpl<unsigned> &Units) const;
+
+  // The hash of the compile command the translation unit was parsed with.
+  Digest getCommandHash(unsigned Unit) const;
+
+  // Adds the files of the translation unit (its main file and everything it
+  // includes) to Files.
+  void getTranslationUnitFiles(unsigned Unit,
+                               ::llvm::SmallVectorImpl<unsigned> &Files) const;
+
+  // Returns true if none of the files of the translation unit are stale.
+  bool isFresh(unsigned Unit) const;
+
+private:
+  friend class IndexBuilder;
+
+  explicit OccurrenceIndex(std::unique_ptr<::llvm::MemoryBuffer> Buffer);
+  bool parse();
+
+  ::llvm::StringRef getString(const char *Entry) const;
+
+  std::unique_ptr<::llvm::MemoryBuffer> Buffer;
+  uint32_t NumFiles, NumUSRs, NumOccurrences, NumTranslationUnits,
+      NumDependencies, StringsSize;
+  const char *FileTable;
+  const char *USRTable;
+  const char *OccurrenceTable;
+  const char *TranslationUnitTable;
+  const char *DependencyTable;
+  const char *Strings;
+
+  // Built lazily
+  mutable ::llvm::StringMap<unsigned> FileIDs;
+  mutable ::llvm::DenseMap<unsigned, ::llvm::SmallVector<unsigned, 1>>
+      MainFileTranslationUnits;
+  mutable ::llvm::DenseMap<unsigned, bool> Staleness;
+};
+
+template <typename AnnotatedNode>
+class IndexHandler : public ::clang::ast_matchers::MatchFinder::MatchCallback {
+public:
+  IndexHandler(IndexBuilder *Index) : Index(Index) {}
+
+  void
+  run(const ::clang::ast_matchers::MatchFinder::MatchResult &Result) override {
+    const auto Node = Result.Nodes.getNodeAs<typename AnnotatedNode::NodeType>(
+        AnnotatedNode::ID());
+    const auto Decl = Result.Nodes.getNodeAs<::clang::NamedDecl>(declID());
+    if (Node == nullptr || Decl == nullptr || Result.SourceManager == nullptr)
+      return;
+    Index->addOccurrence(*Result.SourceManager, Decl,
+                         AnnotatedNode::getLocation(Node),
+                         AnnotatedNode::getSpellingLength(Node, Decl));
+  }
+
+private:
+  IndexBuilder *Index;
+};
+}
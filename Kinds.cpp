@@ -0,0 +1,70 @@
+#include "Rename/Kinds.h"
+#include "Rename/Targets.h"
+
+#include <clang/AST/Decl.h>
+#include <clang/AST/DeclTemplate.h>
+
+#include <llvm/ADT/STLExtras.h>
+
+using clang::Decl;
+using clang::NamespaceAliasDecl;
+using clang::NamespaceDecl;
+using clang::ParmVarDecl;
+using clang::TagDecl;
+using clang::TemplateDecl;
+using clang::TemplateTypeParmDecl;
+using clang::TypedefNameDecl;
+using clang::ValueDecl;
+
+using clang::ast_matchers::MatchFinder;
+
+namespace rn {
+
+NodeKinds getReferringKinds(const Decl *Decl) {
+  // A template is referred to like what it declares, and by its
+  // specializations
+  if (const auto *Template = llvm::dyn_cast<TemplateDecl>(Decl)) {
+    const auto *Templated = Template->getTemplatedDecl();
+    if (Templated == nullptr)
+      return NK_All;
+    return getReferringKinds(Templated) | NK_TemplateSpecializationType;
+  }
+  // The declarations of the same parameter in the other declarations of its
+  // function are found by the ParmVarDecl matcher
+  if (llvm::isa<ParmVarDecl>(Decl))
+    return NK_NamedDecl | NK_ParmVarDecl | NK_DeclRefExpr;
+  if (llvm::isa<NamespaceDecl>(Decl) || llvm::isa<NamespaceAliasDecl>(Decl))
+    return NK_NamedDecl | NK_UsingDirectiveDecl | NK_AliasedNamespace |
+           NK_NestedNameSpecifier;
+  if (llvm::isa<TemplateTypeParmDecl>(Decl))
+    return NK_NamedDecl | NK_TemplateTypeParmType;
+  // A class template's specializations are written with the name of the
+  // class, which may be the target instead of the template
+  if (llvm::isa<TagDecl>(Decl))
+    return NK_NamedDecl | NK_CXXConstructorDecl | NK_UsingDecl |
+           NK_NestedNameSpecifier | NK_TagType | NK_TemplateSpecializationType;
+  if (llvm::isa<TypedefNameDecl>(Decl))
+    return NK_NamedDecl | NK_UsingDecl | NK_TypedefType;
+  // Variables, functions, fields and enumerators
+  if (llvm::isa<ValueDecl>(Decl))
+    return NK_NamedDecl | NK_DeclRefExpr | NK_MemberExpr | NK_UsingDecl;
+  return NK_All;
+}
+
+NodeKinds getReferringKinds(const TargetDecls &Targets) {
+  NodeKinds Kinds = 0;
+  for (const auto &Target : Targets)
+    Kinds |= getReferringKinds(Target.first);
+  return Kinds;
+}
+
+MatchFinder &RenameMatchers::get(NodeKinds Kinds) {
+  auto &Matchers = ByKinds[Kinds];
+  if (!Matchers) {
+    Matchers = llvm::make_unique<KindMatchers>(Occurrences, Targets);
+    Matchers->Handlers.addMatchers(Matchers->Finder, isTargetDecl(Targets),
+                                   Kinds);
+  }
+  return Matchers->Finder;
+}
+}
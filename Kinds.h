@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Rename/Handlers.h"
+#include "Rename/Nodes.h"
+
+#include <clang/AST/DeclBase.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+
+#include <llvm/ADT/DenseMap.h>
+
+#include <memory>
+
+namespace rn {
+
+class TargetDecls;
+
+// Returns the kinds of nodes that can refer to Decl, or NK_All if it isn't a
+// kind of declaration that is known to be referred to in fewer ways.
+NodeKinds getReferringKinds(const ::clang::Decl *Decl);
+
+// Same as above for every one of Targets.
+NodeKinds getReferringKinds(const TargetDecls &Targets);
+
+// The rename matchers, with one MatchFinder for each set of node kinds they
+// have been asked for. A namespace can't be referred to by a MemberExpr, nor a
+// parameter by a NestedNameSpecifier, so there is no need to run those
+// matchers over every node.
+class RenameMatchers {
+public:
+  RenameMatchers(OccurrenceStore *Occurrences, const TargetDecls *Targets)
+      : Occurrences(Occurrences), Targets(Targets) {}
+
+  // Returns a MatchFinder with the matchers of the nodes in Kinds only, which
+  // is set up the first time it's asked for.
+  ::clang::ast_matchers::MatchFinder &get(NodeKinds Kinds);
+
+private:
+  struct KindMatchers {
+    KindMatchers(OccurrenceStore *Occurrences, const TargetDecls *Targets)
+        : Handlers(Occurrences, Targets) {}
+
+    ::clang::ast_matchers::MatchFinder Finder;
+    NodeHandlers<RenameHandler> Handlers;
+  };
+
+  OccurrenceStore *Occurrences;
+  const TargetDecls *Targets;
+  ::llvm::SmallDenseMap<NodeKinds, std::unique_ptr<KindMatchers>, 4> ByKinds;
+};
+}
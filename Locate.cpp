@@ -0,0 +1,268 @@
+#include "Rename/Locate.h"
+#include "Rename/Includes.h"
+#include "Rename/Nodes.h"
+#include "Rename/Utility.h"
+
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Lex/Lexer.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+using clang::ASTContext;
+using clang::Decl;
+using clang::Lexer;
+using clang::NestedNameSpecifierLoc;
+using clang::RecursiveASTVisitor;
+using clang::SourceLocation;
+using clang::SourceManager;
+using clang::SourceRange;
+using clang::Stmt;
+using clang::TypeLoc;
+using clang::tooling::CompilationDatabase;
+using clang::tooling::CompileCommand;
+using clang::tooling::getAbsolutePath;
+
+using clang::ast_matchers::MatchFinder;
+
+using llvm::ArrayRef;
+using llvm::StringRef;
+
+namespace rn {
+
+namespace {
+// Parsing is dominated by the headers a file pulls in, so each #include is
+// weighed like a typical header when estimating how expensive a file is.
+const uint64_t IncludeCost = 32 * 1024;
+
+// The #include directives of the files the includers of a header are looked
+// for in. Headers are included by many files, so each one is only read once.
+class IncludeScanner {
+public:
+  struct FileInfo {
+    uint64_t Size;
+    // As spelled, and whether they're angled
+    std::vector<std::pair<std::string, bool>> Includes;
+  };
+
+  // Returns nullptr if the file at Path can't be read.
+  const FileInfo *scan(StringRef Path) {
+    auto Found = Files.find(Path);
+    if (Found == Files.end()) {
+      std::unique_ptr<FileInfo> Info;
+      auto Buffer = llvm::MemoryBuffer::getFile(Path);
+      if (Buffer) {
+        Info = llvm::make_unique<FileInfo>();
+        Info->Size = (*Buffer)->getBufferSize();
+        scanIncludeDirectives((*Buffer)->getBuffer(),
+                              [&](StringRef Spelled, bool Angled) {
+                                Info->Includes.emplace_back(Spelled.str(),
+                                                            Angled);
+                              });
+      }
+      Found = Files.insert(std::make_pair(Path, std::move(Info))).first;
+    }
+    return Found->second.get();
+  }
+
+private:
+  llvm::StringMap<std::unique_ptr<FileInfo>> Files;
+};
+
+// How expensive the file is expected to be to parse
+uint64_t getCost(const IncludeScanner::FileInfo &Info) {
+  return Info.Size + Info.Includes.size() * IncludeCost;
+}
+
+// Returns true if Includer, parsed with Command, includes Header directly, or
+// through other headers if Indirect is set. The includes are resolved through
+// the include paths of the command, like the compiler would.
+bool includes(IncludeScanner &Scanner, const CompileCommand &Command,
+              StringRef Includer, StringRef Header, bool Indirect) {
+  const auto Paths = IncludePaths::fromCommand(Command);
+  const auto Name = llvm::sys::path::filename(Header);
+  llvm::StringSet<> Visited;
+  std::vector<std::string> Worklist{Includer.str()};
+  Visited.insert(Includer);
+  while (!Worklist.empty()) {
+    const auto Path = std::move(Worklist.back());
+    Worklist.pop_back();
+    const auto *Info = Scanner.scan(Path);
+    if (Info == nullptr)
+      continue;
+    for (const auto &Include : Info->Includes) {
+      // A direct include of Header is spelled with its name
+      if (!Indirect && llvm::sys::path::filename(Include.first) != Name)
+        continue;
+      auto Resolved = Paths.resolve(Path, Include.first, Include.second);
+      if (!Resolved.empty() && makeAbsolute("", Resolved) == Header)
+        return true;
+      if (Indirect && !Resolved.empty() && Visited.insert(Resolved).second)
+        Worklist.push_back(std::move(Resolved));
+    }
+  }
+  return false;
+}
+
+// Returns the files of the database that include Header, directly or not, by
+// how cheap they are to parse. Skip are left out.
+std::vector<std::string> findIncluders(const CompilationDatabase &Compilations,
+                                       StringRef Header, bool Indirect,
+                                       ArrayRef<std::string> Skip) {
+  const auto Name = llvm::sys::path::filename(Header);
+  IncludeScanner Scanner;
+  std::vector<std::pair<uint64_t, std::string>> Includers;
+  for (const auto &Candidate : Compilations.getAllFiles()) {
+    if (std::find(Skip.begin(), Skip.end(), Candidate) != Skip.end())
+      continue;
+    const auto *Info = Scanner.scan(Candidate);
+    // Cheap check before resolving the includes
+    if (Info == nullptr ||
+        (!Indirect &&
+         std::none_of(Info->Includes.begin(), Info->Includes.end(),
+                      [&](const std::pair<std::string, bool> &Include) {
+                        return llvm::sys::path::filename(Include.first) ==
+                               Name;
+                      })))
+      continue;
+    const auto Commands = Compilations.getCompileCommands(Candidate);
+    if (std::any_of(Commands.begin(), Commands.end(),
+                    [&](const CompileCommand &Command) {
+                      return includes(Scanner, Command, Candidate, Header,
+                                      Indirect);
+                    }))
+      Includers.emplace_back(getCost(*Info), Candidate);
+  }
+  std::stable_sort(Includers.begin(), Includers.end(),
+                   [](const std::pair<uint64_t, std::string> &LHS,
+                      const std::pair<uint64_t, std::string> &RHS) {
+                     return LHS.first < RHS.first;
+                   });
+  std::vector<std::string> Files;
+  for (auto &Includer : Includers)
+    Files.push_back(std::move(Includer.second));
+  return Files;
+}
+
+// Looks for the symbol under the cursor, only descending into the nodes whose
+// source range contains it. Each visited node is handed to the MatchFinder,
+// which runs the locate matchers on just that node.
+class PointLookup : public RecursiveASTVisitor<PointLookup> {
+public:
+  PointLookup(ASTContext &Context, const SymbolData &Data, MatchFinder &Finder)
+      : Context(Context), SourceMgr(Context.getSourceManager()), Data(Data),
+        Finder(Finder) {}
+
+  // Same as the MatchFinder's own traversal
+  bool shouldVisitTemplateInstantiations() const { return true; }
+  bool shouldVisitImplicitCode() const { return true; }
+
+  bool TraverseDecl(Decl *D) {
+    if (D == nullptr || !containsCursor(D->getSourceRange()))
+      return true;
+    return match(*D) && RecursiveASTVisitor<PointLookup>::TraverseDecl(D);
+  }
+
+  bool TraverseStmt(Stmt *S) {
+    if (S == nullptr || !containsCursor(S->getSourceRange()))
+      return true;
+    return match(*S) && RecursiveASTVisitor<PointLookup>::TraverseStmt(S);
+  }
+
+  bool TraverseTypeLoc(TypeLoc TL) {
+    if (TL.isNull() || !containsCursor(TL.getSourceRange()))
+      return true;
+    return match(TL) && RecursiveASTVisitor<PointLookup>::TraverseTypeLoc(TL);
+  }
+
+  bool TraverseNestedNameSpecifierLoc(NestedNameSpecifierLoc NNS) {
+    if (!NNS || !containsCursor(NNS.getSourceRange()))
+      return true;
+    return match(NNS) &&
+           RecursiveASTVisitor<PointLookup>::TraverseNestedNameSpecifierLoc(NNS);
+  }
+
+private:
+  // Returns false once the symbol has been found, to stop the traversal.
+  template <typename T> bool match(const T &Node) {
+    Finder.match(Node, Context);
+    return Data.USR.empty();
+  }
+
+  // Returns true if the cursor might be within Range. Nodes without a valid
+  // range (like the TranslationUnitDecl) are always descended into.
+  bool containsCursor(SourceRange Range) const {
+    if (Range.isInvalid())
+      return true;
+    const auto Begin = SourceMgr.getExpansionLoc(Range.getBegin());
+    auto End = SourceMgr.getExpansionRange(Range.getEnd()).second;
+    if (Begin.isInvalid() || End.isInvalid())
+      return true;
+    // The range ends at the start of its last token
+    End = End.getLocWithOffset(
+        Lexer::MeasureTokenLength(End, SourceMgr, Context.getLangOpts()));
+    const auto Cursor = *Data.Loc;
+    return !SourceMgr.isBeforeInTranslationUnit(Cursor, Begin) &&
+           !SourceMgr.isBeforeInTranslationUnit(End, Cursor);
+  }
+
+  ASTContext &Context;
+  const SourceManager &SourceMgr;
+  const SymbolData &Data;
+  MatchFinder &Finder;
+};
+}
+
+std::vector<std::string>
+selectLocateFiles(const CompilationDatabase &Compilations, StringRef File) {
+  const auto Path = getAbsolutePath(File);
+  if (!Compilations.getCompileCommands(Path).empty())
+    return {Path};
+  auto Files = findIncluders(Compilations, makeAbsolute("", Path),
+                             /*Indirect=*/false, {});
+  if (Files.empty())
+    Files.push_back(Path);
+  return Files;
+}
+
+std::vector<std::string>
+findIndirectIncluders(const CompilationDatabase &Compilations, StringRef File,
+                      ArrayRef<std::string> Tried) {
+  return findIncluders(Compilations, makeAbsolute("", File),
+                       /*Indirect=*/true, Tried);
+}
+
+bool isInTranslationUnit(ASTContext &Context, StringRef File) {
+  const auto &SourceMgr = Context.getSourceManager();
+  // The file manager knows a file by its unique ID, whatever it's named
+  const auto *Entry = SourceMgr.getFileManager().getFile(File);
+  return Entry != nullptr && SourceMgr.translateFile(Entry).isValid();
+}
+
+void locateSymbol(ASTContext &Context, SymbolData &Data) {
+  const auto &SourceMgr = Context.getSourceManager();
+  const auto *FileEntry = SourceMgr.getFileManager().getFile(Data.File);
+  if (FileEntry == nullptr)
+    return;
+  Data.Loc = SourceMgr.translateFileLineCol(FileEntry, Data.Line, Data.Column);
+  if (!Data.Loc->isValid())
+    return;
+
+  MatchFinder Finder;
+  NodeHandlers<SourceLocationHandler> Handlers(&Data);
+  Handlers.addMatchers(Finder);
+  PointLookup Lookup(Context, Data, Finder);
+  Lookup.TraverseDecl(Context.getTranslationUnitDecl());
+}
+}
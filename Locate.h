@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Rename/Handlers.h"
+
+#include <clang/AST/ASTContext.h>
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <string>
+#include <vector>
+
+namespace rn {
+
+// Returns the absolute paths of the files to parse in order to locate a symbol
+// in File, in the order to try them in. If File has no compile command of its
+// own (e.g. it is a header), these are the files in the compilation database
+// that include it directly, the cheapest to parse first. Falls back to File
+// itself.
+std::vector<std::string>
+selectLocateFiles(const ::clang::tooling::CompilationDatabase &Compilations,
+                  ::llvm::StringRef File);
+
+// Returns the files in the compilation database that include File through
+// other headers, the cheapest to parse first, except for those in Tried.
+// This is where a symbol in a header is located when none of the files
+// selectLocateFiles() returned did include it.
+std::vector<std::string>
+findIndirectIncluders(const ::clang::tooling::CompilationDatabase &Compilations,
+                      ::llvm::StringRef File,
+                      ::llvm::ArrayRef<std::string> Tried);
+
+// Returns true if File is part of the translation unit Context was parsed
+// from.
+bool isInTranslationUnit(::clang::ASTContext &Context, ::llvm::StringRef File);
+
+// Finds the symbol at Data's cursor in Context, and fills in Data.USR and
+// Data.Spelling. Only the nodes whose source range contains the cursor are
+// visited, and the search stops as soon as the symbol is found.
+void locateSymbol(::clang::ASTContext &Context, SymbolData &Data);
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Rename/Targets.h"
 #include "Rename/utility.h"
 
 #include <clang/AST/AST.h>
@@ -17,6 +18,12 @@ AST_MATCHER_P(clang::NamedDecl, sameUSR, std::string, USR) {
   return getUSRForDecl(&Node) == USR;
 }
 
+// This matcher matches the NamedDecl's that were resolved as targets of the
+// rename, by pointer instead of by USR
+AST_MATCHER_P(clang::NamedDecl, isTargetDecl, const TargetDecls *, Targets) {
+  return Targets->contains(&Node);
+}
+
 // Cant use `AST_TYPE_MATCHER(clang::TagType, tagType);` because bad namespacing
 const clang::ast_matchers::internal::VariadicDynCastAllOfMatcher<
     clang::Type, clang::TagType> tagType;
@@ -73,42 +80,8 @@ AST_MATCHER_P(clang::ParmVarDecl, anySameParmVarDecl,
 AST_MATCHER_P(clang::ParmVarDecl, bestParmVarDecl,
               clang::ast_matchers::internal::Matcher<clang::ParmVarDecl>,
               InnerMatcher) {
-  const auto Name = Node.getNameAsString();
-  if (Name.empty())
-    return false;
-  const auto *Function = llvm::dyn_cast_or_null<clang::FunctionDecl>(
-      Node.getParentFunctionOrMethod());
-  if (Function == nullptr)
-    return InnerMatcher.matches(Node, Finder, Builder);
-
-  const clang::ParmVarDecl *BestDecl = nullptr;
-  // Otherwise get the first function decl w/ named parameter
-  // Note: Can't use Function->redecls(), since order differs depending
-  // on which node you call it on.
-  const auto *Redecl = Function->getMostRecentDecl();
-  while (Redecl != nullptr) {
-    if (Redecl->isFunctionTemplateSpecialization()) {
-      Redecl = Redecl->getPreviousDecl();
-      continue;
-    }
-    if (const clang::ParmVarDecl *OtherDecl =
-            Redecl->getParamDecl(Node.getFunctionScopeIndex())) {
-      if (OtherDecl->getNameAsString() == Name) {
-        if (BestDecl == nullptr) {
-          BestDecl = OtherDecl;
-        } else if (Redecl->doesThisDeclarationHaveABody()) {
-          BestDecl = OtherDecl;
-          break;
-        }
-      }
-    }
-    Redecl = Redecl->getPreviousDecl();
-  }
-
-  if (BestDecl == nullptr) {
-    return false;
-  }
-
-  return InnerMatcher.matches(*BestDecl, Finder, Builder);
+  const auto *BestDecl = getBestParmVarDecl(&Node);
+  return BestDecl != nullptr &&
+         InnerMatcher.matches(*BestDecl, Finder, Builder);
 }
 }
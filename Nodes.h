@@ -4,46 +4,50 @@
 #include "Rename/Utility.h"
 
 #include <clang/AST/AST.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
 #include <clang/ASTMatchers/ASTMatchers.h>
 
-namespace rn {
+#include <cassert>
+#include <vector>
 
-#define RN_ADD_SOURCE_LOCATION_MATCHER(Type)                                   \
-  ::rn::SourceLocationHandler<::rn::Type##Node> Type##Handler(&Data);          \
-  Finder.addMatcher(                                                           \
-      ::rn::Type##Node::matchNode(::clang::ast_matchers::namedDecl().bind(     \
-          ::rn::declID(::rn::Type##Node::ID()))),                              \
-      &Type##Handler)
-
-#define RN_ADD_RENAME_MATCHER(Type)                                            \
-  ::rn::RenameHandler<::rn::Type##Node> Type##Handler(Replace, &Data);         \
-  Finder.addMatcher(                                                           \
-      ::rn::Type##Node::matchNode(                                             \
-          ::clang::ast_matchers::namedDecl(::rn::sameUSR(Data.USR))            \
-              .bind(::rn::declID(::rn::Type##Node::ID()))),                    \
-      &Type##Handler)
-
-#define RN_ADD_ALL_MATCHERS(ADD_MATCHER)                                       \
-  ADD_MATCHER(NamedDecl);                                                      \
-  ADD_MATCHER(DeclRefExpr);                                                    \
-  ADD_MATCHER(CXXConstructorDecl);                                             \
-  ADD_MATCHER(UsingDirectiveDecl);                                             \
-  ADD_MATCHER(UsingDecl);                                                      \
-  ADD_MATCHER(AliasedNamespace);                                               \
-  ADD_MATCHER(NestedNameSpecifier);                                            \
-  ADD_MATCHER(TypeWithDeclaration);                                            \
-  ADD_MATCHER(MemberExpr);                                                     \
-  ADD_MATCHER(ParmVarDecl);                                                    \
-  ; /* Just for easy copy/pasting */
+namespace rn {
 
 using namespace ::clang::ast_matchers;
 using namespace ::clang::ast_matchers::internal;
 
+// The kinds of nodes that can refer to a declaration, as a set of bits. There
+// is one for each of the nodes below, except TypeWithDeclarationNode, which has
+// one for each kind of type it matches.
+using NodeKinds = unsigned;
+enum : NodeKinds {
+  NK_NamedDecl = 1 << 0,
+  NK_DeclRefExpr = 1 << 1,
+  NK_CXXConstructorDecl = 1 << 2,
+  NK_UsingDirectiveDecl = 1 << 3,
+  NK_UsingDecl = 1 << 4,
+  NK_AliasedNamespace = 1 << 5,
+  NK_NestedNameSpecifier = 1 << 6,
+  NK_MemberExpr = 1 << 7,
+  NK_ParmVarDecl = 1 << 8,
+  NK_TagType = 1 << 9,
+  NK_TypedefType = 1 << 10,
+  NK_TemplateTypeParmType = 1 << 11,
+  NK_TemplateSpecializationType = 1 << 12,
+  NK_TypeWithDeclaration = NK_TagType | NK_TypedefType |
+                           NK_TemplateTypeParmType |
+                           NK_TemplateSpecializationType,
+  NK_All = (1 << 13) - 1
+};
+
+// The IDs the nodes are bound to are the keys of a std::map<std::string> that
+// every match inserts them in, and looks them up from, so they're kept short
+// enough for the strings not to be allocated.
 struct Node {
+  // The length of the name of Decl at the node
   template <typename Node>
-  static ::llvm::StringRef getSpelling(const Node *,
-                                       const ::clang::NamedDecl *Decl) {
-    return Decl->getNameAsString();
+  static unsigned getSpellingLength(const Node *,
+                                    const ::clang::NamedDecl *Decl) {
+    return getNameLength(Decl);
   }
 };
 
@@ -51,6 +55,7 @@ struct NamedDeclNode : Node {
   using NodeType = ::clang::NamedDecl;
   using MatcherType = DeclarationMatcher;
   static constexpr const char *ID() { return "NamedDecl"; }
+  static constexpr NodeKinds Kinds() { return NK_NamedDecl; }
 
   static ::clang::SourceLocation getLocation(const NodeType *Node) {
     return Node->getLocation();
@@ -66,6 +71,7 @@ struct DeclRefExprNode : Node {
   using NodeType = ::clang::DeclRefExpr;
   using MatcherType = StatementMatcher;
   static constexpr const char *ID() { return "DeclRefExpr"; }
+  static constexpr NodeKinds Kinds() { return NK_DeclRefExpr; }
 
   static ::clang::SourceLocation getLocation(const NodeType *Node) {
     return Node->getLocation();
@@ -80,7 +86,8 @@ struct DeclRefExprNode : Node {
 struct CXXConstructorDeclNode : Node {
   using NodeType = ::clang::CXXConstructorDecl;
   using MatcherType = DeclarationMatcher;
-  static constexpr const char *ID() { return "CXXConstructorDecl"; }
+  static constexpr const char *ID() { return "Constructor"; }
+  static constexpr NodeKinds Kinds() { return NK_CXXConstructorDecl; }
 
   static ::clang::SourceLocation getLocation(const NodeType *Node) {
     return Node->getLocation();
@@ -95,7 +102,8 @@ struct CXXConstructorDeclNode : Node {
 struct NestedNameSpecifierNode : Node {
   using NodeType = ::clang::NestedNameSpecifierLoc;
   using MatcherType = NestedNameSpecifierLocMatcher;
-  static constexpr const char *ID() { return "NestedNameSpecifier"; }
+  static constexpr const char *ID() { return "NameSpecifier"; }
+  static constexpr NodeKinds Kinds() { return NK_NestedNameSpecifier; }
 
   static ::clang::SourceLocation getLocation(const NodeType *Node) {
     return Node->getLocalBeginLoc();
@@ -113,7 +121,8 @@ struct NestedNameSpecifierNode : Node {
 struct UsingDirectiveDeclNode : Node {
   using NodeType = ::clang::UsingDirectiveDecl;
   using MatcherType = DeclarationMatcher;
-  static constexpr const char *ID() { return "UsingDirectiveDecl"; }
+  static constexpr const char *ID() { return "UsingDirective"; }
+  static constexpr NodeKinds Kinds() { return NK_UsingDirectiveDecl; }
 
   static ::clang::SourceLocation getLocation(const NodeType *Node) {
     return Node->getIdentLocation();
@@ -129,6 +138,7 @@ struct UsingDeclNode : Node {
   using NodeType = ::clang::UsingDecl;
   using MatcherType = DeclarationMatcher;
   static constexpr const char *ID() { return "UsingDecl"; }
+  static constexpr NodeKinds Kinds() { return NK_UsingDecl; }
 
   static ::clang::SourceLocation getLocation(const NodeType *Node) {
     return Node->getNameInfo().getLoc();
@@ -145,7 +155,8 @@ struct UsingDeclNode : Node {
 struct AliasedNamespaceNode : Node {
   using NodeType = ::clang::NamespaceAliasDecl;
   using MatcherType = DeclarationMatcher;
-  static constexpr const char *ID() { return "AliasedNamespace"; }
+  static constexpr const char *ID() { return "NamespaceAlias"; }
+  static constexpr NodeKinds Kinds() { return NK_AliasedNamespace; }
 
   static ::clang::SourceLocation getLocation(const NodeType *Node) {
     return Node->getTargetNameLoc();
@@ -160,19 +171,33 @@ struct AliasedNamespaceNode : Node {
 struct TypeWithDeclarationNode : Node {
   using NodeType = ::clang::TypeLoc;
   using MatcherType = TypeLocMatcher;
-  static constexpr const char *ID() { return "TypeWithDeclaration"; }
+  static constexpr const char *ID() { return "TypeWithDecl"; }
+  static constexpr NodeKinds Kinds() { return NK_TypeWithDeclaration; }
 
   static ::clang::SourceLocation getLocation(const NodeType *Node) {
     return Node->getBeginLoc();
   }
 
+  // Only the kinds of types in Kinds are matched, of which there has to be
+  // at least one
   static const MatcherType
-  matchNode(const Matcher<clang::Decl> &InnerMatcher = anything()) {
+  matchNode(const Matcher<clang::Decl> &InnerMatcher = anything(),
+            NodeKinds Kinds = NK_TypeWithDeclaration) {
     const auto DeclMatcher = hasDeclaration(InnerMatcher);
-    return loc(type(anyOf(tagType(DeclMatcher), typedefType(DeclMatcher),
-                          templateTypeParmType(DeclMatcher),
-                          templateSpecializationType(DeclMatcher))))
-        .bind(ID());
+    std::vector<Matcher<clang::Type>> Types;
+    if (Kinds & NK_TagType)
+      Types.push_back(tagType(DeclMatcher));
+    if (Kinds & NK_TypedefType)
+      Types.push_back(typedefType(DeclMatcher));
+    if (Kinds & NK_TemplateTypeParmType)
+      Types.push_back(templateTypeParmType(DeclMatcher));
+    if (Kinds & NK_TemplateSpecializationType)
+      Types.push_back(templateSpecializationType(DeclMatcher));
+    assert(!Types.empty() && "No kind of type to match");
+    Matcher<clang::Type> TypeMatcher = Types.front();
+    for (size_t I = 1; I < Types.size(); ++I)
+      TypeMatcher = anyOf(TypeMatcher, Types[I]);
+    return loc(type(TypeMatcher)).bind(ID());
   }
 };
 
@@ -180,6 +205,7 @@ struct MemberExprNode : Node {
   using NodeType = ::clang::MemberExpr;
   using MatcherType = StatementMatcher;
   static constexpr const char *ID() { return "MemberExpr"; }
+  static constexpr NodeKinds Kinds() { return NK_MemberExpr; }
 
   static ::clang::SourceLocation getLocation(const NodeType *Node) {
     return Node->getMemberLoc();
@@ -199,10 +225,11 @@ struct ParmVarDeclNode : Node {
   using NodeType = ::clang::ParmVarDecl;
   using MatcherType = DeclarationMatcher;
   static constexpr const char *ID() { return "ParmVarDecl"; }
+  static constexpr NodeKinds Kinds() { return NK_ParmVarDecl; }
 
-  static ::llvm::StringRef getSpelling(const NodeType *Node,
-                                       const ::clang::NamedDecl *) {
-    return Node->getNameAsString();
+  static unsigned getSpellingLength(const NodeType *Node,
+                                    const ::clang::NamedDecl *) {
+    return getNameLength(Node);
   }
 
   static ::clang::SourceLocation getLocation(const NodeType *Node) {
@@ -221,4 +248,72 @@ struct ParmVarDeclNode : Node {
     };
   }
 };
+
+// Returns the matcher of AnnotatedNode, narrowed to the node kinds in Kinds if
+// it matches more than one
+template <typename AnnotatedNode>
+typename AnnotatedNode::MatcherType
+matchNodeOfKinds(const Matcher<clang::Decl> &InnerMatcher, NodeKinds) {
+  return AnnotatedNode::matchNode(InnerMatcher);
+}
+
+template <>
+inline TypeWithDeclarationNode::MatcherType
+matchNodeOfKinds<TypeWithDeclarationNode>(
+    const Matcher<clang::Decl> &InnerMatcher, NodeKinds Kinds) {
+  return TypeWithDeclarationNode::matchNode(InnerMatcher,
+                                            Kinds & NK_TypeWithDeclaration);
+}
+
+template <typename... Nodes> struct NodeList {};
+
+// Every kind of node the matchers look for. Adding a kind of node only takes
+// adding it here, once it has a node kind bit.
+using AllNodes =
+    NodeList<NamedDeclNode, DeclRefExprNode, CXXConstructorDeclNode,
+             UsingDirectiveDeclNode, UsingDeclNode, AliasedNamespaceNode,
+             NestedNameSpecifierNode, TypeWithDeclarationNode, MemberExprNode,
+             ParmVarDeclNode>;
+
+// A Handler<Node> for every Node of List, all constructed with the same
+// arguments. The handlers are members, not allocated one by one.
+template <template <typename> class Handler, typename List = AllNodes>
+class NodeHandlers;
+
+template <template <typename> class Handler>
+class NodeHandlers<Handler, NodeList<>> {
+public:
+  template <typename... Args> explicit NodeHandlers(Args...) {}
+
+  void addMatchers(::clang::ast_matchers::MatchFinder &,
+                   const Matcher<clang::NamedDecl> &, NodeKinds) {}
+};
+
+template <template <typename> class Handler, typename AnnotatedNode,
+          typename... Rest>
+class NodeHandlers<Handler, NodeList<AnnotatedNode, Rest...>>
+    : NodeHandlers<Handler, NodeList<Rest...>> {
+  using Base = NodeHandlers<Handler, NodeList<Rest...>>;
+
+public:
+  template <typename... Args>
+  explicit NodeHandlers(Args... HandlerArgs)
+      : Base(HandlerArgs...), First(HandlerArgs...) {}
+
+  // Adds the matchers of the nodes in Kinds to Finder, for the nodes that
+  // refer to a declaration DeclMatcher matches. The declaration is bound to
+  // declID().
+  void addMatchers(::clang::ast_matchers::MatchFinder &Finder,
+                   const Matcher<clang::NamedDecl> &DeclMatcher = anything(),
+                   NodeKinds Kinds = NK_All) {
+    if (Kinds & AnnotatedNode::Kinds())
+      Finder.addMatcher(matchNodeOfKinds<AnnotatedNode>(
+                            namedDecl(DeclMatcher).bind(declID()), Kinds),
+                        &First);
+    Base::addMatchers(Finder, DeclMatcher, Kinds);
+  }
+
+private:
+  Handler<AnnotatedNode> First;
+};
 }
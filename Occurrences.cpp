@@ -0,0 +1,117 @@
+#include "Rename/Occurrences.h"
+#include "Rename/Utility.h"
+
+#include <algorithm>
+#include <tuple>
+
+using clang::FileEntry;
+using clang::SourceLocation;
+using clang::SourceManager;
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+
+using llvm::StringRef;
+
+namespace rn {
+
+namespace {
+bool isBefore(const OccurrenceStore::Occurrence &LHS,
+              const OccurrenceStore::Occurrence &RHS) {
+  return std::tie(LHS.File, LHS.Offset, LHS.Length, LHS.Spelling) <
+         std::tie(RHS.File, RHS.Offset, RHS.Length, RHS.Spelling);
+}
+
+bool isSame(const OccurrenceStore::Occurrence &LHS,
+            const OccurrenceStore::Occurrence &RHS) {
+  return std::tie(LHS.File, LHS.Offset, LHS.Length, LHS.Spelling) ==
+         std::tie(RHS.File, RHS.Offset, RHS.Length, RHS.Spelling);
+}
+}
+
+void OccurrenceStore::add(const SourceManager &SourceMgr, SourceLocation Loc,
+                          unsigned Length, StringRef NewSpelling) {
+  if (Loc.isInvalid() || Loc.isMacroID())
+    return;
+  const auto Decomposed = SourceMgr.getDecomposedLoc(Loc);
+  const auto *Entry = SourceMgr.getFileEntryForID(Decomposed.first);
+  if (Entry == nullptr)
+    return;
+  // Most occurrences are in a few files, whose names are only looked up once.
+  // They are named like the index names them, so the occurrences it has of a
+  // file are deduplicated with the ones parsed from it.
+  auto Found = EntryIDs.find(Entry);
+  if (Found == EntryIDs.end())
+    Found = EntryIDs
+                .insert(std::make_pair(
+                    Entry, getFileID(getAbsoluteName(
+                               SourceMgr.getFileManager(), Entry))))
+                .first;
+  Occurrence O;
+  O.File = Found->second;
+  O.Offset = Decomposed.second;
+  O.Length = Length;
+  O.Spelling = getSpellingID(NewSpelling);
+  Occurrences.push_back(O);
+  Sorted = false;
+}
+
+void OccurrenceStore::add(StringRef File, unsigned Offset, unsigned Length,
+                          StringRef NewSpelling) {
+  Occurrence O;
+  O.File = getFileID(File);
+  O.Offset = Offset;
+  O.Length = Length;
+  O.Spelling = getSpellingID(NewSpelling);
+  Occurrences.push_back(O);
+  Sorted = false;
+}
+
+void OccurrenceStore::merge(const OccurrenceStore &Other) {
+  std::vector<unsigned> FileMap;
+  for (const auto &File : Other.Files)
+    FileMap.push_back(getFileID(File));
+  std::vector<unsigned> SpellingMap;
+  for (const auto &Spelling : Other.Spellings)
+    SpellingMap.push_back(getSpellingID(Spelling));
+
+  Occurrences.reserve(Occurrences.size() + Other.Occurrences.size());
+  for (auto O : Other.Occurrences) {
+    O.File = FileMap[O.File];
+    O.Spelling = SpellingMap[O.Spelling];
+    Occurrences.push_back(O);
+  }
+  Sorted = Other.Occurrences.empty() && Sorted;
+}
+
+void OccurrenceStore::sort() {
+  if (Sorted)
+    return;
+  std::sort(Occurrences.begin(), Occurrences.end(), isBefore);
+  Occurrences.erase(
+      std::unique(Occurrences.begin(), Occurrences.end(), isSame),
+      Occurrences.end());
+  Sorted = true;
+}
+
+void OccurrenceStore::addTo(Replacements &Replaces) const {
+  for (const auto &O : Occurrences)
+    Replaces.insert(
+        Replacement(Files[O.File], O.Offset, O.Length, Spellings[O.Spelling]));
+}
+
+unsigned OccurrenceStore::getFileID(StringRef File) {
+  const auto Inserted = FileIDs.insert(
+      std::make_pair(File, static_cast<unsigned>(Files.size())));
+  if (Inserted.second)
+    Files.push_back(Inserted.first->getKey());
+  return Inserted.first->second;
+}
+
+unsigned OccurrenceStore::getSpellingID(StringRef Spelling) {
+  const auto Inserted = SpellingIDs.insert(
+      std::make_pair(Spelling, static_cast<unsigned>(Spellings.size())));
+  if (Inserted.second)
+    Spellings.push_back(Inserted.first->getKey());
+  return Inserted.first->second;
+}
+}
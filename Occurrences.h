@@ -0,0 +1,84 @@
+#pragma once
+
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/SourceLocation.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Tooling/Refactoring.h>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <vector>
+
+namespace rn {
+
+// The occurrences a rename collects, until they are turned into Replacements.
+// A Replacement owns a copy of its file's path and of its new spelling, and
+// is kept in an ordered set. Here each path and each new spelling is stored
+// once, and an occurrence is four integers in a flat array, which is sorted
+// and deduplicated once, when all of them have been collected.
+class OccurrenceStore {
+public:
+  struct Occurrence {
+    unsigned File;
+    unsigned Offset;
+    unsigned Length;
+    unsigned Spelling;
+  };
+
+  OccurrenceStore() : Sorted(true) {}
+  // The names are referred to by the maps' keys
+  OccurrenceStore(const OccurrenceStore &) = delete;
+  OccurrenceStore &operator=(const OccurrenceStore &) = delete;
+  OccurrenceStore(OccurrenceStore &&) = default;
+  OccurrenceStore &operator=(OccurrenceStore &&) = default;
+
+  // Has to be called before the occurrences of a translation unit are added
+  // by SourceLocation, since the files are remembered by their entries.
+  void startTranslationUnit() { EntryIDs.clear(); }
+
+  // Adds an occurrence at Loc, unless it's in a macro expansion or not in a
+  // file, where it couldn't be replaced.
+  void add(const ::clang::SourceManager &SourceMgr, ::clang::SourceLocation Loc,
+           unsigned Length, ::llvm::StringRef NewSpelling);
+
+  void add(::llvm::StringRef File, unsigned Offset, unsigned Length,
+           ::llvm::StringRef NewSpelling);
+
+  // Adds everything Other has collected.
+  void merge(const OccurrenceStore &Other);
+
+  // Sorts the occurrences by file and offset, and removes the duplicates,
+  // like the same occurrence in a header seen by several translation units.
+  void sort();
+
+  bool empty() const { return Occurrences.empty(); }
+  size_t size() const { return Occurrences.size(); }
+
+  ::llvm::ArrayRef<Occurrence> getOccurrences() const { return Occurrences; }
+  ::llvm::StringRef getFileName(unsigned File) const { return Files[File]; }
+  ::llvm::StringRef getSpelling(unsigned Spelling) const {
+    return Spellings[Spelling];
+  }
+
+  // Adds a Replacement for every occurrence to Replaces.
+  void addTo(::clang::tooling::Replacements &Replaces) const;
+
+private:
+  unsigned getFileID(::llvm::StringRef File);
+  unsigned getSpellingID(::llvm::StringRef Spelling);
+
+  // The keys of FileIDs and SpellingIDs, by ID
+  std::vector<::llvm::StringRef> Files;
+  std::vector<::llvm::StringRef> Spellings;
+  ::llvm::StringMap<unsigned> FileIDs;
+  ::llvm::StringMap<unsigned> SpellingIDs;
+  std::vector<Occurrence> Occurrences;
+  bool Sorted;
+
+  // Reset for every translation unit
+  ::llvm::DenseMap<const ::clang::FileEntry *, unsigned> EntryIDs;
+};
+}
@@ -0,0 +1,166 @@
+#include "Rename/Parallel.h"
+
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/FileSystemOptions.h>
+
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <thread>
+
+using clang::DiagnosticConsumer;
+using clang::DiagnosticsEngine;
+using clang::FileManager;
+using clang::FileSystemOptions;
+using clang::LangOptions;
+using clang::Preprocessor;
+using clang::tooling::CompilationDatabase;
+using clang::tooling::CompileCommand;
+using clang::tooling::ToolAction;
+using clang::tooling::ToolInvocation;
+using clang::tooling::getAbsolutePath;
+
+using llvm::StringRef;
+
+namespace rn {
+
+WorkStealingExecutor::WorkStealingExecutor(unsigned NumWorkers)
+    : NumWorkers(NumWorkers != 0
+                     ? NumWorkers
+                     : std::max(1u, std::thread::hardware_concurrency())) {
+  for (unsigned I = 0; I < this->NumWorkers; ++I)
+    Queues.emplace_back(new Queue);
+}
+
+bool WorkStealingExecutor::pop(unsigned Worker, size_t *Task) {
+  {
+    auto &Own = *Queues[Worker];
+    std::lock_guard<std::mutex> Guard(Own.Lock);
+    if (!Own.Tasks.empty()) {
+      *Task = Own.Tasks.front();
+      Own.Tasks.pop_front();
+      return true;
+    }
+  }
+  // Steal from the back, away from where the owner is working
+  for (unsigned I = 1; I < NumWorkers; ++I) {
+    auto &Victim = *Queues[(Worker + I) % NumWorkers];
+    std::lock_guard<std::mutex> Guard(Victim.Lock);
+    if (!Victim.Tasks.empty()) {
+      *Task = Victim.Tasks.back();
+      Victim.Tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingExecutor::run(size_t NumTasks,
+                               std::function<void(size_t, unsigned)> Task) {
+  for (size_t I = 0; I < NumTasks; ++I)
+    Queues[I % NumWorkers]->Tasks.push_back(I);
+
+  // No tasks are added while running, so a worker is done once every queue
+  // is empty.
+  auto Work = [&](unsigned Worker) {
+    size_t Index;
+    while (pop(Worker, &Index))
+      Task(Index, Worker);
+  };
+  std::vector<std::thread> Threads;
+  for (unsigned Worker = 1; Worker < NumWorkers; ++Worker)
+    Threads.emplace_back(Work, Worker);
+  Work(0);
+  for (auto &Thread : Threads)
+    Thread.join();
+}
+
+void SynchronizedDiagConsumer::BeginSourceFile(const LangOptions &LangOpts,
+                                               const Preprocessor *PP) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  Target->BeginSourceFile(LangOpts, PP);
+}
+
+void SynchronizedDiagConsumer::EndSourceFile() {
+  std::lock_guard<std::mutex> Guard(Lock);
+  Target->EndSourceFile();
+}
+
+void SynchronizedDiagConsumer::finish() {
+  std::lock_guard<std::mutex> Guard(Lock);
+  Target->finish();
+}
+
+bool SynchronizedDiagConsumer::IncludeInDiagnosticCounts() const {
+  std::lock_guard<std::mutex> Guard(Lock);
+  return Target->IncludeInDiagnosticCounts();
+}
+
+void SynchronizedDiagConsumer::HandleDiagnostic(
+    DiagnosticsEngine::Level Level, const clang::Diagnostic &Info) {
+  std::lock_guard<std::mutex> Guard(Lock);
+  // Keeps this consumer's own counts too
+  DiagnosticConsumer::HandleDiagnostic(Level, Info);
+  Target->HandleDiagnostic(Level, Info);
+}
+
+std::vector<std::pair<std::string, CompileCommand>>
+getCompileCommands(const CompilationDatabase &Compilations,
+                   const std::vector<std::string> &Files, bool *FileSkipped) {
+  std::vector<std::pair<std::string, CompileCommand>> Commands;
+  for (const auto &File : Files) {
+    const auto Path = getAbsolutePath(File);
+    const auto FileCommands = Compilations.getCompileCommands(Path);
+    if (FileCommands.empty()) {
+      llvm::errs() << "Skipping " << File << ". Compile command not found.\n";
+      *FileSkipped = true;
+    }
+    for (const auto &Command : FileCommands)
+      Commands.emplace_back(Path, Command);
+  }
+  return Commands;
+}
+
+std::vector<std::string> getSyntaxOnlyArgs(const CompileCommand &Command) {
+  // Find the builtin headers relative to this binary, like ClangTool does
+  static int StaticSymbol;
+  const auto MainExecutable =
+      llvm::sys::fs::getMainExecutable("rn", &StaticSymbol);
+
+  // Same adjustments as ClangTool's default ones: only parse, and don't
+  // write any output.
+  std::vector<std::string> Args;
+  Args.push_back(MainExecutable);
+  Args.push_back("-working-directory=" + Command.Directory);
+  for (size_t I = 1; I < Command.CommandLine.size(); ++I) {
+    const StringRef Arg = Command.CommandLine[I];
+    if (Arg == "-o") {
+      ++I;
+      continue;
+    }
+    if (Arg.startswith("-fcolor-diagnostics") ||
+        Arg.startswith("-fdiagnostics-color"))
+      continue;
+    Args.push_back(Arg);
+  }
+  Args.push_back("-fsyntax-only");
+  return Args;
+}
+
+bool runOnCompileCommand(const CompileCommand &Command, StringRef File,
+                         ToolAction *Action,
+                         clang::DiagnosticConsumer *DiagConsumer) {
+  FileSystemOptions FileSystemOpts;
+  FileSystemOpts.WorkingDir = Command.Directory;
+  llvm::IntrusiveRefCntPtr<FileManager> Files(new FileManager(FileSystemOpts));
+  ToolInvocation Invocation(getSyntaxOnlyArgs(Command), Action, Files.get());
+  Invocation.setDiagnosticConsumer(DiagConsumer);
+  if (!Invocation.run()) {
+    llvm::errs() << "Error while processing " << File << ".\n";
+    return false;
+  }
+  return true;
+}
+}
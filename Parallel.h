@@ -0,0 +1,92 @@
+#pragma once
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/StringRef.h>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace rn {
+
+// Runs tasks on a fixed number of threads. Each worker has its own queue and
+// steals from the back of the other queues once its own is empty, so the load
+// stays balanced even though the cost of parsing varies a lot between
+// translation units.
+class WorkStealingExecutor {
+public:
+  // 0 means one worker per hardware thread
+  explicit WorkStealingExecutor(unsigned NumWorkers);
+
+  unsigned getNumWorkers() const { return NumWorkers; }
+
+  // Calls Task(Index, Worker) for every Index in [0, NumTasks), where Worker
+  // is the index of the worker running it, and returns once all are done.
+  void run(size_t NumTasks, std::function<void(size_t, unsigned)> Task);
+
+private:
+  struct Queue {
+    std::mutex Lock;
+    std::deque<size_t> Tasks;
+  };
+
+  bool pop(unsigned Worker, size_t *Task);
+
+  unsigned NumWorkers;
+  std::vector<std::unique_ptr<Queue>> Queues;
+};
+
+// Passes the diagnostics of the translation units several threads parse at
+// once to a single consumer, one callback at a time.
+class SynchronizedDiagConsumer : public ::clang::DiagnosticConsumer {
+public:
+  explicit SynchronizedDiagConsumer(::clang::DiagnosticConsumer *Target)
+      : Target(Target) {}
+
+  // Returns the consumer to parse with: this one, or null if there is no
+  // Target, so each translation unit gets a diagnostic printer of its own.
+  ::clang::DiagnosticConsumer *get() { return Target ? this : nullptr; }
+
+  void BeginSourceFile(const ::clang::LangOptions &LangOpts,
+                       const ::clang::Preprocessor *PP) override;
+  void EndSourceFile() override;
+  void finish() override;
+  bool IncludeInDiagnosticCounts() const override;
+  void HandleDiagnostic(::clang::DiagnosticsEngine::Level Level,
+                        const ::clang::Diagnostic &Info) override;
+
+private:
+  ::clang::DiagnosticConsumer *Target;
+  mutable std::mutex Lock;
+};
+
+// Returns every compile command of every file, along with the file's absolute
+// path. Sets *FileSkipped if a file has no compile command.
+std::vector<std::pair<std::string, ::clang::tooling::CompileCommand>>
+getCompileCommands(const ::clang::tooling::CompilationDatabase &Compilations,
+                   const std::vector<std::string> &Files, bool *FileSkipped);
+
+// Returns the arguments to parse a file with Command, starting with the path
+// of this binary: the working directory is passed as -working-directory, the
+// output is dropped, and only the syntax is checked.
+std::vector<std::string>
+getSyntaxOnlyArgs(const ::clang::tooling::CompileCommand &Command);
+
+// Runs Action over File with the given compile command, like ClangTool::run()
+// does. Unlike ClangTool, the process' working directory is never changed
+// (the compiler is told about the command's directory instead), so this can be
+// called from several threads at once. The DiagConsumer has to be safe to
+// share between the threads calling this.
+// Returns true on success.
+bool runOnCompileCommand(const ::clang::tooling::CompileCommand &Command,
+                         ::llvm::StringRef File,
+                         ::clang::tooling::ToolAction *Action,
+                         ::clang::DiagnosticConsumer *DiagConsumer);
+}
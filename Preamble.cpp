@@ -0,0 +1,288 @@
+#include "Rename/Preamble.h"
+#include "Rename/Digest.h"
+#include "Rename/Utility.h"
+
+#include <clang/Basic/SourceManager.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Lex/Lexer.h>
+#include <clang/Lex/PreprocessorOptions.h>
+
+#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+using clang::CompilerInstance;
+using clang::CompilerInvocation;
+using clang::FileManager;
+using clang::GeneratePCHAction;
+using clang::Lexer;
+using clang::PCHContainerOperations;
+using clang::tooling::CompileCommand;
+
+using llvm::StringRef;
+
+namespace rn {
+
+// A preamble is kept in the directory as three files, named after its key:
+//
+//   <key>.pch   the preamble
+//   <key>.deps  "rn preamble 2", the time the files were stamped at, and the
+//               stamp and path of every file the preamble includes, one per
+//               line. Written after the preamble, and touched whenever it's
+//               used.
+//   <key>.seen  written the first time the preamble is asked for
+namespace {
+const char DependenciesHeader[] = "rn preamble 2";
+
+// Even the empty files take a block
+const uint64_t MinFileSize = 4096;
+
+// Sets the modification time of Path to now
+void touch(StringRef Path) {
+  int FD;
+  if (llvm::sys::fs::openFileForWrite(Path, FD, llvm::sys::fs::F_Append))
+    return;
+  llvm::sys::fs::setLastModificationAndAccessTime(FD,
+                                                  llvm::sys::TimeValue::now());
+  llvm::sys::Process::SafelyCloseFileDescriptor(FD);
+}
+}
+
+PreambleCache::PreambleCache(std::string Directory, uint64_t MaxSize)
+    : Directory(std::move(Directory)), MaxSize(MaxSize), NumBuilt(0),
+      NumReused(0) {}
+
+void PreambleCache::apply(
+    const CompileCommand &Command, CompilerInvocation &Invocation,
+    std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+    clang::DiagnosticConsumer *DiagConsumer, bool Build) {
+  // A command that already includes a PCH can't have a preamble on top
+  const auto &Inputs = Invocation.getFrontendOpts().Inputs;
+  if (Inputs.size() != 1 || !Inputs.front().isFile() ||
+      !Invocation.getPreprocessorOpts().ImplicitPCHInclude.empty())
+    return;
+  llvm::SmallString<256> MainFile(Inputs.front().getFile());
+  if (!Command.Directory.empty() && llvm::sys::path::is_relative(MainFile)) {
+    llvm::SmallString<256> Absolute(Command.Directory);
+    llvm::sys::path::append(Absolute, MainFile);
+    MainFile = Absolute;
+  }
+  auto Buffer = llvm::MemoryBuffer::getFile(MainFile);
+  if (!Buffer)
+    return;
+  const auto Bounds =
+      Lexer::ComputePreamble((*Buffer)->getBuffer(), *Invocation.getLangOpts());
+  if (Bounds.first == 0)
+    return;
+  const auto Preamble = (*Buffer)->getBuffer().take_front(Bounds.first);
+
+  // The same preamble parsed with another command can mean something else
+  llvm::MD5 Hasher;
+  const auto CommandHash = hashCompileCommand(Command);
+  Hasher.update(
+      llvm::ArrayRef<uint8_t>(CommandHash.data(), CommandHash.size()));
+  Hasher.update(MainFile);
+  Hasher.update(Preamble);
+  llvm::MD5::MD5Result Result;
+  Hasher.final(Result);
+  llvm::SmallString<32> Key;
+  llvm::MD5::stringifyResult(Result, Key);
+
+  llvm::SmallString<256> PCHPath(Directory);
+  llvm::sys::path::append(PCHPath, Key);
+  auto DependenciesPath = PCHPath;
+  auto SeenPath = PCHPath;
+  PCHPath += ".pch";
+  DependenciesPath += ".deps";
+  SeenPath += ".seen";
+  if (llvm::sys::fs::exists(PCHPath) && !isStale(DependenciesPath)) {
+    touch(DependenciesPath);
+    ++NumReused;
+  } else {
+    if (!Build)
+      return;
+    if (!llvm::sys::fs::exists(SeenPath)) {
+      if (!llvm::sys::fs::create_directories(Directory))
+        writeAtomically(SeenPath, "");
+      return;
+    }
+    if (!build(Invocation, MainFile, Preamble, PCHPath, DependenciesPath,
+               PCHContainerOps, DiagConsumer))
+      return;
+    ++NumBuilt;
+    evict(Key);
+  }
+
+  // Same as what ASTUnit does with its own preambles. The preamble is checked
+  // against its dependencies above, and the main file it was built from is
+  // only a prefix of the real one, so clang mustn't validate it again.
+  auto &PreprocessorOpts = Invocation.getPreprocessorOpts();
+  PreprocessorOpts.ImplicitPCHInclude = PCHPath.str();
+  PreprocessorOpts.PrecompiledPreambleBytes = Bounds;
+  PreprocessorOpts.DisablePCHValidation = true;
+}
+
+bool PreambleCache::isStale(StringRef DependenciesPath) const {
+  // Written after the preamble, so a preamble without them is incomplete
+  auto Buffer = llvm::MemoryBuffer::getFile(DependenciesPath);
+  if (!Buffer)
+    return true;
+  auto Contents = (*Buffer)->getBuffer();
+  StringRef Header, Time;
+  std::tie(Header, Contents) = Contents.split('\n');
+  std::tie(Time, Contents) = Contents.split('\n');
+  uint64_t StampTime;
+  if (Header != DependenciesHeader || Time.getAsInteger(10, StampTime))
+    return true;
+  while (!Contents.empty()) {
+    StringRef Line;
+    std::tie(Line, Contents) = Contents.split('\n');
+    if (Line.empty())
+      continue;
+    FileStamp Stamp;
+    StringRef Path;
+    if (!parseFileStamp(Line, Stamp, Path) || Path.empty() ||
+        hasChanged(Path, Stamp, StampTime))
+      return true;
+  }
+  return false;
+}
+
+bool PreambleCache::build(
+    const CompilerInvocation &Invocation, StringRef MainFile,
+    StringRef Preamble, StringRef PCHPath, StringRef DependenciesPath,
+    std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+    clang::DiagnosticConsumer *DiagConsumer) const {
+  if (llvm::sys::fs::create_directories(Directory))
+    return false;
+  llvm::SmallString<256> TempPath;
+  int FD;
+  if (llvm::sys::fs::createUniqueFile(PCHPath + ".tmp-%%%%%%", FD, TempPath))
+    return false;
+  llvm::sys::Process::SafelyCloseFileDescriptor(FD);
+
+  // The main file is replaced by its preamble, and precompiled on its own
+  llvm::IntrusiveRefCntPtr<CompilerInvocation> PreambleInvocation(
+      new CompilerInvocation(Invocation));
+  auto &FrontendOpts = PreambleInvocation->getFrontendOpts();
+  FrontendOpts.ProgramAction = clang::frontend::GeneratePCH;
+  FrontendOpts.OutputFile = TempPath.str();
+  FrontendOpts.SkipFunctionBodies = false;
+  auto &PreprocessorOpts = PreambleInvocation->getPreprocessorOpts();
+  PreprocessorOpts.PrecompiledPreambleBytes = std::make_pair(0u, false);
+  PreprocessorOpts.RetainRemappedFileBuffers = false;
+  PreprocessorOpts.addRemappedFile(
+      MainFile, llvm::MemoryBuffer::getMemBufferCopy(Preamble, MainFile)
+                    .release());
+
+  // The files are stamped with what was read from them, so one that changes
+  // while the preamble is built is seen as changed
+  const auto StampTime = getStampTime();
+  CompilerInstance Clang(std::move(PCHContainerOps));
+  Clang.setInvocation(PreambleInvocation.get());
+  Clang.createDiagnostics(DiagConsumer, /*ShouldOwnClient=*/false);
+  GeneratePCHAction Action;
+  if (!Clang.ExecuteAction(Action) ||
+      Clang.getDiagnostics().hasErrorOccurred()) {
+    llvm::sys::fs::remove(TempPath);
+    return false;
+  }
+
+  std::string Dependencies;
+  llvm::raw_string_ostream OS(Dependencies);
+  OS << DependenciesHeader << '\n' << StampTime << '\n';
+  const auto &SourceMgr = Clang.getSourceManager();
+  for (auto I = SourceMgr.fileinfo_begin(), E = SourceMgr.fileinfo_end();
+       I != E; ++I) {
+    llvm::SmallString<256> Path(I->first->getName());
+    Clang.getFileManager().makeAbsolutePath(Path);
+    // The main file's preamble is part of the key already
+    if (Path == MainFile)
+      continue;
+    FileStamp Stamp;
+    const auto *Contents = I->second->getRawBuffer();
+    if (Contents != nullptr ? !stampFile(Path, Contents->getBuffer(), Stamp)
+                            : !stampFile(Path, Stamp)) {
+      llvm::sys::fs::remove(TempPath);
+      return false;
+    }
+    writeFileStamp(OS, Stamp);
+    OS << ' ' << Path << '\n';
+  }
+  OS.flush();
+
+  if (llvm::sys::fs::rename(TempPath, PCHPath)) {
+    llvm::sys::fs::remove(TempPath);
+    return false;
+  }
+  return writeAtomically(DependenciesPath, Dependencies);
+}
+
+void PreambleCache::evict(StringRef Key) const {
+  // The size of the files of every preamble, and when it was last used
+  llvm::StringMap<std::pair<uint64_t, uint64_t>> Entries;
+  uint64_t TotalSize = 0;
+  std::error_code EC;
+  for (llvm::sys::fs::directory_iterator I(Directory, EC), E; I != E && !EC;
+       I.increment(EC)) {
+    const auto Name = llvm::sys::path::filename(I->path());
+    const auto Extension = llvm::sys::path::extension(Name);
+    llvm::sys::fs::file_status Status;
+    if ((Extension != ".pch" && Extension != ".deps" &&
+         Extension != ".seen") ||
+        I->status(Status))
+      continue;
+    auto &Entry = Entries[llvm::sys::path::stem(Name)];
+    const auto Size = std::max<uint64_t>(Status.getSize(), MinFileSize);
+    Entry.first += Size;
+    TotalSize += Size;
+    if (Extension != ".pch")
+      Entry.second =
+          std::max(Entry.second,
+                   Status.getLastModificationTime().toEpochTime());
+  }
+  if (TotalSize <= MaxSize)
+    return;
+
+  std::vector<std::tuple<uint64_t, StringRef, uint64_t>> Order;
+  for (const auto &Entry : Entries) {
+    if (Entry.first() != Key)
+      Order.emplace_back(Entry.second.second, Entry.first(),
+                         Entry.second.first);
+  }
+  std::sort(Order.begin(), Order.end());
+  for (const auto &Entry : Order) {
+    if (TotalSize <= MaxSize)
+      break;
+    llvm::SmallString<256> Path(Directory);
+    llvm::sys::path::append(Path, std::get<1>(Entry));
+    // Without its dependencies, a preamble is stale, so they go first
+    for (const auto *Extension : {".deps", ".pch", ".seen"}) {
+      llvm::SmallString<256> File(Path);
+      File += Extension;
+      llvm::sys::fs::remove(File);
+    }
+    TotalSize -= std::get<2>(Entry);
+  }
+}
+
+bool PreambleAction::runInvocation(
+    CompilerInvocation *Invocation, FileManager *Files,
+    std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+    clang::DiagnosticConsumer *DiagConsumer) {
+  Cache.apply(Command, *Invocation, PCHContainerOps, DiagConsumer, Build);
+  return Action->runInvocation(Invocation, Files, std::move(PCHContainerOps),
+                               DiagConsumer);
+}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/FileManager.h>
+#include <clang/Frontend/CompilerInvocation.h>
+#include <clang/Frontend/PCHContainerOperations.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/StringRef.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace rn {
+
+// Keeps the precompiled preambles (the #includes at the top of a main file)
+// in a directory, so they outlive the process. Each one is keyed by the
+// compile command and the text of the preamble, and is rebuilt once one of
+// the files it includes changes. A main file whose preamble was built by an
+// earlier rename only has what follows its #includes parsed again.
+// Once the directory holds more than MaxSize bytes, the preambles that were
+// used the longest ago are removed.
+// Preambles are built and looked up through the file system only, so a cache
+// can be used from several threads (and processes) at once.
+class PreambleCache {
+public:
+  PreambleCache(std::string Directory, uint64_t MaxSize);
+
+  // Makes Invocation, which parses a main file with Command, use the
+  // preamble of the file if it's up to date. With Build, a missing or stale
+  // preamble is built first, but only once the file has been asked for with
+  // the same preamble before: building one takes longer than parsing the
+  // file, so it's only worth it for the files that are parsed again and
+  // again. Invocation is left as it was if the file has no preamble or it
+  // can't be built.
+  void apply(const ::clang::tooling::CompileCommand &Command,
+             ::clang::CompilerInvocation &Invocation,
+             std::shared_ptr<::clang::PCHContainerOperations> PCHContainerOps,
+             ::clang::DiagnosticConsumer *DiagConsumer, bool Build);
+
+  // The number of preambles built, and used without building them
+  unsigned getNumBuilt() const { return NumBuilt; }
+  unsigned getNumReused() const { return NumReused; }
+
+private:
+  bool isStale(::llvm::StringRef DependenciesPath) const;
+  bool build(const ::clang::CompilerInvocation &Invocation,
+             ::llvm::StringRef MainFile, ::llvm::StringRef Preamble,
+             ::llvm::StringRef PCHPath, ::llvm::StringRef DependenciesPath,
+             std::shared_ptr<::clang::PCHContainerOperations> PCHContainerOps,
+             ::clang::DiagnosticConsumer *DiagConsumer) const;
+  // Removes the least recently used preambles but Key's, until the directory
+  // is small enough.
+  void evict(::llvm::StringRef Key) const;
+
+  std::string Directory;
+  uint64_t MaxSize;
+  std::atomic<unsigned> NumBuilt;
+  std::atomic<unsigned> NumReused;
+};
+
+// Runs Action on the invocations it is given, once they were made to use the
+// preamble of their main file, which is built if Build is set.
+class PreambleAction : public ::clang::tooling::ToolAction {
+public:
+  PreambleAction(PreambleCache &Cache,
+                 const ::clang::tooling::CompileCommand &Command,
+                 ::clang::tooling::ToolAction *Action, bool Build)
+      : Cache(Cache), Command(Command), Action(Action), Build(Build) {}
+
+  bool runInvocation(
+      ::clang::CompilerInvocation *Invocation, ::clang::FileManager *Files,
+      std::shared_ptr<::clang::PCHContainerOperations> PCHContainerOps,
+      ::clang::DiagnosticConsumer *DiagConsumer) override;
+
+private:
+  PreambleCache &Cache;
+  const ::clang::tooling::CompileCommand &Command;
+  ::clang::tooling::ToolAction *Action;
+  bool Build;
+};
+}
@@ -0,0 +1,132 @@
+#include "Rename/Prefilter.h"
+#include "Rename/Includes.h"
+
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/MathExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using clang::tooling::CompilationDatabase;
+using clang::tooling::CompileCommand;
+using clang::tooling::getAbsolutePath;
+
+using llvm::StringRef;
+
+namespace rn {
+
+bool containsSubstring(StringRef Haystack, StringRef Needle) {
+  if (Needle.empty())
+    return true;
+  if (Haystack.size() < Needle.size())
+    return false;
+#if defined(__SSE2__)
+  // Compare 16 candidate positions at a time against the first and last
+  // characters of the needle, and only memcmp where both of them match.
+  const auto Last = Needle.size() - 1;
+  const auto First = _mm_set1_epi8(Needle.front());
+  const auto Final = _mm_set1_epi8(Needle.back());
+  const char *const Data = Haystack.data();
+  size_t I = 0;
+  for (; I + Last + 16 <= Haystack.size(); I += 16) {
+    const auto BlockFirst =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + I));
+    const auto BlockLast =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(Data + I + Last));
+    auto Mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(First, BlockFirst), _mm_cmpeq_epi8(Final, BlockLast))));
+    while (Mask != 0) {
+      const auto Offset = llvm::countTrailingZeros(Mask);
+      if (std::memcmp(Data + I + Offset, Needle.data(), Needle.size()) == 0)
+        return true;
+      Mask &= Mask - 1;
+    }
+  }
+  Haystack = Haystack.drop_front(I);
+#endif
+  return Haystack.find(Needle) != StringRef::npos;
+}
+
+TextPrefilter::TextPrefilter(const CompilationDatabase &Compilations,
+                             std::vector<std::string> Spellings)
+    : Compilations(Compilations), Spellings(std::move(Spellings)) {}
+
+bool TextPrefilter::mayReference(StringRef File) {
+  const auto Path = getAbsolutePath(File);
+  const auto Commands = Compilations.getCompileCommands(Path);
+  // Let the tool report the missing compile command
+  if (Commands.empty())
+    return true;
+  for (const auto &Command : Commands) {
+    if (reaches(Command, Path))
+      return true;
+  }
+  return false;
+}
+
+const TextPrefilter::FileInfo &TextPrefilter::scan(StringRef Path) {
+  auto Found = Files.find(Path);
+  if (Found != Files.end())
+    return Found->second;
+
+  FileInfo Info;
+  // Don't require a null terminator, so large files are mmap'd
+  auto Buffer = llvm::MemoryBuffer::getFile(Path, /*FileSize=*/-1,
+                                            /*RequiresNullTerminator=*/false);
+  // If the file can't be read, let the parser deal with it
+  Info.Mentions = !Buffer;
+  if (Buffer) {
+    const auto Contents = (*Buffer)->getBuffer();
+    Info.Mentions = std::any_of(
+        Spellings.begin(), Spellings.end(), [&](const std::string &Spelling) {
+          return containsSubstring(Contents, Spelling);
+        });
+    if (!Info.Mentions) {
+      scanIncludeDirectives(Contents, [&](StringRef Spelled, bool Angled) {
+        Info.Includes.emplace_back(Spelled.str(), Angled);
+      });
+    }
+  }
+  return Files.insert(std::make_pair(Path, std::move(Info))).first->second;
+}
+
+bool TextPrefilter::reaches(const CompileCommand &Command, StringRef File) {
+  const auto Paths = IncludePaths::fromCommand(Command);
+  if (Paths.Precompiled)
+    return true;
+  llvm::StringSet<> Visited;
+  std::vector<std::string> Worklist{File.str()};
+  Visited.insert(File);
+  for (const auto &Forced : Paths.Forced) {
+    auto Resolved = Paths.resolveForced(Forced);
+    if (Resolved.empty())
+      return true;
+    if (Visited.insert(Resolved).second)
+      Worklist.push_back(std::move(Resolved));
+  }
+  while (!Worklist.empty()) {
+    const auto Path = std::move(Worklist.back());
+    Worklist.pop_back();
+    const auto &Info = scan(Path);
+    if (Info.Mentions)
+      return true;
+    for (const auto &Include : Info.Includes) {
+      // An include of a macro could be anything, and so could a header that
+      // can't be found, like one that is generated
+      auto Resolved = Paths.resolve(Path, Include.first, Include.second);
+      if (Resolved.empty())
+        return true;
+      if (Visited.insert(Resolved).second)
+        Worklist.push_back(std::move(Resolved));
+    }
+  }
+  return false;
+}
+}
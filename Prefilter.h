@@ -0,0 +1,50 @@
+#pragma once
+
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <string>
+#include <vector>
+
+namespace rn {
+
+// Returns true if Needle occurs in Haystack. The search is vectorized when
+// SSE2 is available.
+bool containsSubstring(::llvm::StringRef Haystack, ::llvm::StringRef Needle);
+
+// Decides, without parsing, whether a translation unit can refer to one of a
+// set of symbols. It can't if none of their spellings appear in its main file
+// or in any file it includes, directly or not.
+// Includes are followed textually through the include paths the compiler
+// would search. A file that can't be found (like a generated header, or one
+// only included in a block for another platform), a precompiled header or a
+// module is assumed to mention the symbol.
+class TextPrefilter {
+public:
+  TextPrefilter(const ::clang::tooling::CompilationDatabase &Compilations,
+                std::vector<std::string> Spellings);
+
+  // Returns false if none of the compile commands for File can reach one of
+  // the spellings.
+  bool mayReference(::llvm::StringRef File);
+
+private:
+  // What a scan of one file found
+  struct FileInfo {
+    bool Mentions;
+    // The #include directives, as spelled (and whether they were angled)
+    std::vector<std::pair<std::string, bool>> Includes;
+  };
+
+  const FileInfo &scan(::llvm::StringRef Path);
+  bool reaches(const ::clang::tooling::CompileCommand &Command,
+               ::llvm::StringRef File);
+
+  const ::clang::tooling::CompilationDatabase &Compilations;
+  std::vector<std::string> Spellings;
+  // Files are shared by many translation units, so they are only scanned once
+  ::llvm::StringMap<FileInfo> Files;
+};
+}
@@ -1,21 +1,29 @@
+#include <Rename/Batch.h>
+#include <Rename/Compilations.h>
+#include <Rename/Dependencies.h>
 #include <Rename/Handlers.h>
-#include <Rename/Matchers.h>
-#include <Rename/Nodes.h>
+#include <Rename/Index.h>
 #include <Rename/Options.h>
+#include <Rename/Preamble.h>
+#include <Rename/Rules.h>
+#include <Rename/Server.h>
+#include <Rename/Tool.h>
 
-#include <clang/ASTMatchers/ASTMatchFinder.h>
-#include <clang/Tooling/CommonOptionsParser.h>
+#include <clang/Tooling/ArgumentsAdjusters.h>
+#include <clang/Tooling/CompilationDatabase.h>
 #include <clang/Tooling/Refactoring.h>
 
-#include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/raw_ostream.h>
 
-using clang::IgnoringDiagConsumer;
-using clang::tooling::CommonOptionsParser;
-using clang::tooling::RefactoringTool;
-using clang::tooling::newFrontendActionFactory;
+#include <cstring>
+#include <iostream>
+#include <vector>
 
-using clang::ast_matchers::MatchFinder;
+using clang::IgnoringDiagConsumer;
+using clang::tooling::CompilationDatabase;
+using clang::tooling::FixedCompilationDatabase;
+using clang::tooling::Replacements;
 
 using llvm::errs;
 using llvm::outs;
@@ -23,21 +31,163 @@ using llvm::outs;
 namespace rn {
 llvm::cl::OptionCategory RenameCategory{"rn options"};
 // Command line options
+// The same as CommonOptionsParser's
+static llvm::cl::opt<std::string> BuildPath{
+    "p", llvm::cl::desc("Build path"), llvm::cl::Optional,
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::list<std::string> SourcePaths{
+    llvm::cl::Positional, llvm::cl::desc("<source0> [... <sourceN>]"),
+    llvm::cl::ZeroOrMore, llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::list<std::string> ArgsAfter{
+    "extra-arg",
+    llvm::cl::desc("Additional argument to append to the compiler command "
+                   "line"),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::list<std::string> ArgsBefore{
+    "extra-arg-before",
+    llvm::cl::desc("Additional argument to prepend to the compiler command "
+                   "line"),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<bool> DedupCommands{
+    "dedup-commands",
+    llvm::cl::desc("Parse a file once for each distinct set of flags that "
+                   "can change its AST, instead of once for each of its "
+                   "compile commands."),
+    llvm::cl::cat(RenameCategory)};
+
 static llvm::cl::opt<std::string> NewSpelling{
     "new-name", llvm::cl::desc("The new name to change the symbol to."),
-    llvm::cl::cat(RenameCategory), llvm::cl::Required};
+    llvm::cl::cat(RenameCategory)};
 
 static llvm::cl::opt<unsigned>
     Line{"line", llvm::cl::desc("The line the symbol is located on."),
-         llvm::cl::cat(RenameCategory), llvm::cl::Required};
+         llvm::cl::cat(RenameCategory)};
 
 static llvm::cl::opt<unsigned>
     Column{"column", llvm::cl::desc("The column the symbol is located in."),
-           llvm::cl::cat(RenameCategory), llvm::cl::Required};
+           llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<std::string> USR{
+    "usr",
+    llvm::cl::desc("The USR of the symbol to rename, instead of its "
+                   "location."),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<std::string> QualifiedName{
+    "qualified-name",
+    llvm::cl::desc("The fully qualified name (like ns::Point) of the symbol "
+                   "to rename, instead of its location. Every declaration "
+                   "with that name is renamed, overloads included."),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<std::string> BatchPath{
+    "batch",
+    llvm::cl::desc("A file listing the symbols to rename, one per line, as "
+                   "'<file>:<line>:<column> <new name>' or "
+                   "'usr:<USR> <new name>'. They are all renamed in a single "
+                   "pass over the sources."),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<std::string> RulesPath{
+    "rules",
+    llvm::cl::desc("A file of rules selecting the declarations to rename by "
+                   "kind, name and scope, one per line, as "
+                   "'<kind> <name regex> <new name> [in <scope>] "
+                   "[case <style>]'. Every selected declaration is renamed "
+                   "in a single pass over the sources."),
+    llvm::cl::cat(RenameCategory)};
 
 static llvm::cl::opt<bool>
     Rewrite{"rewrite", llvm::cl::desc("Should the files be rewritten."),
-            llvm::cl::cat(RenameCategory), llvm::cl::Required};
+            llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<bool> Diff{
+    "diff",
+    llvm::cl::desc("Print the changes as unified diffs instead of the "
+                   "replacements, if the files aren't rewritten."),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<bool> Prefilter{
+    "prefilter",
+    llvm::cl::desc("Don't parse the files that can't refer to the symbol, "
+                   "because neither they nor the files they include contain "
+                   "its name."),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<bool> DedupHeaders{
+    "dedup-headers",
+    llvm::cl::desc("Only look for the symbol in each header once, in the "
+                   "first translation unit that includes it, of those "
+                   "compiled with the same flags."),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<std::string> IncludeGraphPath{
+    "include-graph",
+    llvm::cl::desc("The file to keep the include graph of the translation "
+                   "units in. A symbol declared in a header is then only "
+                   "looked for in the translation units that include it, "
+                   "and with -rewrite, the files no other translation unit "
+                   "includes are written as soon as they are parsed."),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<unsigned>
+    Jobs{"j",
+         llvm::cl::desc("The number of translation units to process, and of "
+                        "files to rewrite, in parallel (0 for one per "
+                        "hardware thread)."),
+         llvm::cl::init(1), llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<RenameEngine> Engine{
+    "engine",
+    llvm::cl::desc("How to find the references to the symbol in the parsed "
+                   "files."),
+    llvm::cl::values(clEnumValN(RenameEngine::Matchers, "matchers",
+                                "With an AST matcher for each kind of node "
+                                "(the default)."),
+                     clEnumValN(RenameEngine::Visitor, "visitor",
+                                "With a single traversal of the AST."),
+                     clEnumValEnd),
+    llvm::cl::init(RenameEngine::Matchers), llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<std::string> IndexPath{
+    "index",
+    llvm::cl::desc("The occurrence index to read the unchanged translation "
+                   "units from. With 'rn index', the file to write it to."),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<bool> Update{
+    "update",
+    llvm::cl::desc("With 'rn index', only parse the translation units whose "
+                   "compile command or files changed since the index was "
+                   "written."),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<unsigned> ASTCacheSize{
+    "ast-cache-size",
+    llvm::cl::desc("With 'rn serve', the number of files whose ASTs are kept "
+                   "between requests."),
+    llvm::cl::init(32), llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<std::string> PreambleCacheDir{
+    "preamble-cache",
+    llvm::cl::desc("The directory to keep the precompiled preambles of the "
+                   "parsed files in, so the next renames only parse what "
+                   "follows their #includes."),
+    llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<unsigned> PreambleCacheSize{
+    "preamble-cache-size",
+    llvm::cl::desc("The size the preamble cache is kept under, in megabytes. "
+                   "The least recently used preambles are removed first."),
+    llvm::cl::init(1024), llvm::cl::cat(RenameCategory)};
+
+static llvm::cl::opt<bool>
+    Stats{"stats", llvm::cl::desc("Print statistics about the rename."),
+          llvm::cl::cat(RenameCategory)};
 
 // The tool version to display
 const std::string RENAME_RN_VERSION = "0.0.1";
@@ -50,14 +200,314 @@ inline void PrintVersion() {
 const char RenameUsage[] = "A tool to rename symbols in C/C++ code.\n\
                             rn renames every occurrence of a symbol found at\
                            < offset >\
-                           in\n<source>.The results are written to stdout.\n ";
+                           in\n<source>.The results are written to stdout.\n\
+                           With -usr or -qualified-name, the symbol is\
+                           given directly, and isn't looked for first.\n\
+                           rn index -index=<file> <source>... indexes every\
+                           symbol in the sources, so later renames don't\
+                           have to parse them again. With --update, only\
+                           the translation units that changed are parsed.\n\
+                           rn serve <source>... answers locate and rename\
+                           requests sent as JSON lines on stdin.\n\
+                           rn -batch=<file> <source>... renames every\
+                           symbol listed in the file at once.\n\
+                           rn -rules=<file> <source>... renames every\
+                           declaration selected by the rules in the file at\
+                           once.\n ";
+
+// The compilation database and the sources, as CommonOptionsParser gives
+// them, except that a compile_commands.json isn't parsed all at once, which
+// takes long for a large project before any work is done.
+class RenameOptions {
+public:
+  RenameOptions(int &argc, const char **argv) {
+    llvm::cl::HideUnrelatedOptions(RenameCategory);
+    Compilations.reset(
+        FixedCompilationDatabase::loadFromCommandLine(argc, argv));
+    llvm::cl::ParseCommandLineOptions(argc, argv, RenameUsage);
+    SourcePathList = SourcePaths;
+
+    if (!Compilations) {
+      std::string ErrorMessage;
+      Compilations = loadCompilationDatabase(
+          BuildPath, SourcePathList.empty() ? "." : SourcePathList.front(),
+          DedupCommands, ErrorMessage);
+      if (!Compilations) {
+        errs() << "Error while trying to load a compilation database:\n"
+               << ErrorMessage << "\nRunning without flags.\n";
+        Compilations.reset(
+            new FixedCompilationDatabase(".", std::vector<std::string>()));
+      }
+    }
+    if (!ArgsBefore.empty() || !ArgsAfter.empty()) {
+      Compilations = llvm::make_unique<AdjustingCompilationDatabase>(
+          std::move(Compilations),
+          clang::tooling::combineAdjusters(
+              clang::tooling::getInsertArgumentAdjuster(
+                  ArgsBefore, clang::tooling::ArgumentInsertPosition::BEGIN),
+              clang::tooling::getInsertArgumentAdjuster(
+                  ArgsAfter, clang::tooling::ArgumentInsertPosition::END)));
+    }
+  }
+
+  const CompilationDatabase &getCompilations() const { return *Compilations; }
+
+  const std::vector<std::string> &getSourcePathList() const {
+    return SourcePathList;
+  }
+
+private:
+  std::unique_ptr<CompilationDatabase> Compilations;
+  std::vector<std::string> SourcePathList;
+};
+
+// Runs 'rn index'
+int runIndex(RenameOptions &OP) {
+  if (IndexPath.empty()) {
+    errs() << "rn: no index file provided.\n\n";
+    llvm::cl::PrintHelpMessage();
+    return 1;
+  }
+  IgnoringDiagConsumer DiagConsumer;
+  if (int Result = buildIndex(OP.getCompilations(), OP.getSourcePathList(),
+                              IndexPath, Jobs, Update, &DiagConsumer)) {
+    errs() << "rn: failed to index some files.\n";
+    return Result;
+  }
+  return 0;
+}
+
+// Runs 'rn serve'
+int runServer(RenameOptions &OP) {
+  std::unique_ptr<OccurrenceIndex> Index;
+  if (!IndexPath.empty()) {
+    Index = OccurrenceIndex::load(IndexPath);
+    if (!Index)
+      errs() << "rn: can't read the index " << IndexPath
+             << ", parsing every file.\n";
+  }
+
+  RenameServer Server(OP.getCompilations(), OP.getSourcePathList(),
+                      ASTCacheSize);
+  IgnoringDiagConsumer DiagConsumer;
+  Server.setDiagnosticConsumer(&DiagConsumer);
+  Server.setPrefilter(Prefilter);
+  Server.setJobs(Jobs);
+  Server.setIndex(Index.get());
+  Server.run(std::cin, outs());
+  return 0;
+}
+
+// What the options give the tool, which has to outlive it
+struct ToolResources {
+  std::unique_ptr<OccurrenceIndex> Index;
+  std::unique_ptr<PreambleCache> Preambles;
+  std::unique_ptr<IncludeGraph> Graph;
+  IgnoringDiagConsumer DiagConsumer;
+};
+
+// Applies the options shared by every rename to Tool
+void configureTool(RenameTool &Tool, ToolResources &Resources) {
+  if (!IndexPath.empty()) {
+    Resources.Index = OccurrenceIndex::load(IndexPath);
+    if (!Resources.Index)
+      errs() << "rn: can't read the index " << IndexPath
+             << ", parsing every file.\n";
+  }
+  if (!PreambleCacheDir.empty())
+    Resources.Preambles = llvm::make_unique<PreambleCache>(
+        PreambleCacheDir, uint64_t(PreambleCacheSize) << 20);
+  if (!IncludeGraphPath.empty())
+    Resources.Graph = llvm::make_unique<IncludeGraph>(IncludeGraphPath);
+
+  Tool.setDiagnosticConsumer(&Resources.DiagConsumer);
+  Tool.setPrefilter(Prefilter);
+  Tool.setJobs(Jobs);
+  Tool.setDeduplicateHeaders(DedupHeaders);
+  Tool.setIndex(Resources.Index.get());
+  Tool.setPreambleCache(Resources.Preambles.get());
+  Tool.setIncludeGraph(Resources.Graph.get());
+  Tool.setSaveAsParsed(Rewrite);
+  Tool.setEngine(Engine);
+}
+
+// Names is how the names that were looked for are described
+void printStats(const RenameStats &ToolStats, const std::string &Names,
+                const PreambleCache *Preambles) {
+  errs() << "rn: " << ToolStats.PrefilteredFiles
+         << " files were not parsed, since they can't contain " << Names
+         << ".\n";
+  errs() << "rn: " << ToolStats.SkippedTranslationUnits << " of "
+         << ToolStats.TranslationUnits << " translation units never mention "
+         << Names << " and were skipped.\n";
+  errs() << "rn: " << ToolStats.IndexedTranslationUnits
+         << " translation units were read from the index.\n";
+  errs() << "rn: " << ToolStats.SkippedHeaders
+         << " headers were skipped, since another translation unit "
+            "already looked at them.\n";
+  errs() << "rn: " << ToolStats.OutOfScopeFiles
+         << " files were not parsed, since they can't see " << Names << ".\n";
+  errs() << "rn: " << ToolStats.ScopedTranslationUnits
+         << " translation units were only searched where " << Names
+         << " can be referred to.\n";
+  errs() << "rn: " << ToolStats.UnreachedFiles
+         << " files were not parsed, since they don't include a header that "
+            "declares "
+         << Names << ".\n";
+  errs() << "rn: " << ToolStats.NarrowedTranslationUnits
+         << " translation units were only searched for the kinds of "
+            "references "
+         << Names << " can have.\n";
+  if (Preambles != nullptr)
+    errs() << "rn: " << Preambles->getNumReused()
+           << " preambles were reused, and " << Preambles->getNumBuilt()
+           << " were built.\n";
+}
+
+// Prints the replacements
+void printReplacements(const Replacements &Replaces) {
+  llvm::outs() << "Replacements collected by the tool:\n";
+  for (auto &r : Replaces) {
+    llvm::outs() << r.toString() << "\n";
+  }
+}
+
+// Rewrites the files, or prints the replacements or the diffs
+void writeReplacements(const Replacements &Replaces) {
+  if (Rewrite) {
+    if (saveReplacements(Replaces, Jobs))
+      errs() << "Failed to rewrite the files.\n";
+  } else if (Diff) {
+    if (diffReplacements(Replaces, llvm::outs()))
+      errs() << "Failed to diff some files.\n";
+  } else {
+    printReplacements(Replaces);
+  }
+}
+
+// Same as above, but with the occurrences the tool collected
+void writeReplacements(RenameTool &Tool) {
+  if (Rewrite) {
+    if (Tool.save())
+      errs() << "Failed to rewrite the files.\n";
+  } else if (Diff) {
+    if (Tool.diff(llvm::outs()))
+      errs() << "Failed to diff some files.\n";
+  } else {
+    printReplacements(Tool.getReplacements());
+  }
+}
+
+// Runs 'rn -batch=<file>'
+int runBatch(RenameOptions &OP) {
+  auto Buffer = llvm::MemoryBuffer::getFile(BatchPath);
+  if (!Buffer) {
+    errs() << "rn: can't read " << BatchPath << ".\n";
+    return 1;
+  }
+  std::vector<SymbolData> Symbols;
+  auto Error = parseRenameList((*Buffer)->getBuffer(), Symbols);
+  if (!Error.empty()) {
+    errs() << "rn: " << BatchPath << ": " << Error << ".\n";
+    return 1;
+  }
+
+  const auto &Files = OP.getSourcePathList();
+  if (Files.empty()) {
+    errs() << "rn: no files provided.\n\n";
+    llvm::cl::PrintHelpMessage();
+    return 1;
+  }
+
+  RenameTool Tool(OP.getCompilations(), Files);
+  ToolResources Resources;
+  configureTool(Tool, Resources);
+
+  // The symbols given by location are located first, all of them before any
+  // is renamed, so the whole project is only parsed once
+  for (auto &Data : Symbols) {
+    if (!Data.USR.empty())
+      continue;
+    if (Tool.locate(Data)) {
+      errs() << "Failed to find symbol at location: " << Data.File << ":"
+             << Data.Line << ":" << Data.Column << ".\n";
+      return 1;
+    }
+    if (Data.USR.empty()) {
+      errs() << "Unable to determine USR at location: " << Data.File << ":"
+             << Data.Line << ":" << Data.Column << ".\n";
+      return 1;
+    }
+  }
+  Error = removeDuplicateSymbols(Symbols);
+  if (!Error.empty()) {
+    errs() << "rn: " << Error << ".\n";
+    return 1;
+  }
+
+  if (Tool.rename(Symbols))
+    errs() << "Failed to rename some symbols.\n";
+  if (Stats)
+    printStats(Tool.getStats(), "the symbols' names",
+               Resources.Preambles.get());
+  writeReplacements(Tool);
+  return 0;
+}
+
+// Runs 'rn -rules=<file>'
+int runRules(RenameOptions &OP) {
+  auto Buffer = llvm::MemoryBuffer::getFile(RulesPath);
+  if (!Buffer) {
+    errs() << "rn: can't read " << RulesPath << ".\n";
+    return 1;
+  }
+  std::vector<RenameRule> Rules;
+  const auto Error = parseRenameRules((*Buffer)->getBuffer(), Rules);
+  if (!Error.empty()) {
+    errs() << "rn: " << RulesPath << ": " << Error << ".\n";
+    return 1;
+  }
+
+  const auto &Files = OP.getSourcePathList();
+  if (Files.empty()) {
+    errs() << "rn: no files provided.\n\n";
+    llvm::cl::PrintHelpMessage();
+    return 1;
+  }
+
+  Replacements Replaces;
+  IgnoringDiagConsumer DiagConsumer;
+  if (renameByRules(OP.getCompilations(), Files, Rules, Jobs, &DiagConsumer,
+                    Replaces))
+    errs() << "Failed to rename in some files.\n";
+  writeReplacements(Replaces);
+  return 0;
+}
 }
 
 int main(int argc, const char **argv) {
   using namespace rn;
 
+  // 'rn index' and 'rn serve' are subcommands, which the option parser
+  // doesn't know about
+  std::vector<const char *> Args(argv, argv + argc);
+  const bool IndexMode = argc > 1 && std::strcmp(argv[1], "index") == 0;
+  const bool ServerMode = argc > 1 && std::strcmp(argv[1], "serve") == 0;
+  if (IndexMode || ServerMode)
+    Args.erase(Args.begin() + 1);
+  int NumArgs = Args.size();
+
   llvm::cl::SetVersionPrinter(PrintVersion);
-  CommonOptionsParser OP(argc, argv, RenameCategory, RenameUsage);
+  RenameOptions OP(NumArgs, Args.data());
+
+  if (IndexMode)
+    return runIndex(OP);
+  if (ServerMode)
+    return runServer(OP);
+  if (!BatchPath.empty())
+    return runBatch(OP);
+  if (!RulesPath.empty())
+    return runRules(OP);
 
   if (NewSpelling.empty()) {
     errs() << "rn: no new name provided.\n\n";
@@ -65,6 +515,17 @@ int main(int argc, const char **argv) {
     return 1;
   }
 
+  if (!USR.empty() && !QualifiedName.empty()) {
+    errs() << "rn: only one of -usr and -qualified-name can be given.\n";
+    return 1;
+  }
+  const bool Located = USR.empty() && QualifiedName.empty();
+  if (Located && (Line == 0 || Column == 0)) {
+    errs() << "rn: no location provided.\n\n";
+    llvm::cl::PrintHelpMessage();
+    return 1;
+  }
+
   auto Files = OP.getSourcePathList();
   if (Files.empty()) {
     errs() << "rn: no files provided.\n\n";
@@ -74,19 +535,34 @@ int main(int argc, const char **argv) {
 
   SymbolData Data(Files.front(), Line, Column, NewSpelling);
 
-  RefactoringTool Tool(OP.getCompilations(), Files);
-  IgnoringDiagConsumer DiagConsumer;
-  Tool.setDiagnosticConsumer(&DiagConsumer);
+  RenameTool Tool(OP.getCompilations(), Files);
+  ToolResources Resources;
+  configureTool(Tool, Resources);
+
+  // The symbol is already known, so the rename phase can start right away.
+  // Its spelling is read from its USR, or is the last component of its name.
+  if (!Located) {
+    Data.USR = USR;
+    Data.QualifiedName = QualifiedName;
+    Data.Spelling = USR.empty() ? getUnqualifiedName(QualifiedName).str()
+                                : getSpellingFromUSR(USR);
+    if (Tool.rename(Data))
+      errs() << "Failed to rename symbol "
+             << (USR.empty() ? QualifiedName : USR) << ".\n";
+    if (Stats)
+      printStats(Tool.getStats(), Data.Spelling.empty()
+                                      ? "the symbol's name"
+                                      : "'" + Data.Spelling + "'",
+                 Resources.Preambles.get());
+    writeReplacements(Tool);
+    return 0;
+  }
 
   // Find the source location
-  {
-    MatchFinder Finder;
-    RN_ADD_ALL_MATCHERS(RN_ADD_SOURCE_LOCATION_MATCHER)
-    if (Tool.run(newFrontendActionFactory(&Finder).get())) {
-      errs() << "Failed to find symbol at location: " << Files.front() << ":"
-             << Line << ":" << Column << ".\n";
-      return 1;
-    }
+  if (Tool.locate(Data)) {
+    errs() << "Failed to find symbol at location: " << Files.front() << ":"
+           << Line << ":" << Column << ".\n";
+    return 1;
   }
   if (Data.USR.empty()) {
     errs() << "Unable to determine USR.\n";
@@ -94,28 +570,13 @@ int main(int argc, const char **argv) {
   }
 
   // Find all references and rename them
-  {
-    auto Replace = &Tool.getReplacements();
-
-    MatchFinder Finder;
-    RN_ADD_ALL_MATCHERS(RN_ADD_RENAME_MATCHER)
-    bool Result;
-    if (Rewrite) {
-      Result = Tool.runAndSave(newFrontendActionFactory(&Finder).get());
-    } else {
-      Result = Tool.run(newFrontendActionFactory(&Finder).get());
-    }
-    if (Result) {
-      errs() << "Failed to rename symbol at location: " << Files.front() << ":"
-             << Line << ":" << Column << ".\n";
-    }
+  if (Tool.rename(Data)) {
+    errs() << "Failed to rename symbol at location: " << Files.front() << ":"
+           << Line << ":" << Column << ".\n";
   }
-  if (!Rewrite) {
-    llvm::outs() << "Replacements collected by the tool:\n";
-    for (auto &r : Tool.getReplacements()) {
-      llvm::outs() << r.toString() << "\n";
-    }
-  }
-
+  if (Stats)
+    printStats(Tool.getStats(), "'" + Data.Spelling + "'",
+               Resources.Preambles.get());
+  writeReplacements(Tool);
   return 0;
 }
@@ -0,0 +1,298 @@
+#include "Rename/Rules.h"
+#include "Rename/Nodes.h"
+#include "Rename/Parallel.h"
+
+#include <clang/AST/ASTConsumer.h>
+#include <clang/Basic/CharInfo.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringSwitch.h>
+#include <llvm/ADT/Twine.h>
+
+#include <atomic>
+#include <tuple>
+
+using clang::ASTConsumer;
+using clang::ASTContext;
+using clang::CXXMethodDecl;
+using clang::NamedDecl;
+using clang::SourceLocation;
+using clang::SourceManager;
+using clang::tooling::CompilationDatabase;
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+using clang::tooling::newFrontendActionFactory;
+
+using clang::ast_matchers::MatchFinder;
+
+using llvm::StringRef;
+
+namespace rn {
+
+namespace {
+class RuleConsumer : public ASTConsumer {
+public:
+  explicit RuleConsumer(RuleRenamer &Renamer) : Renamer(Renamer) {}
+
+  void HandleTranslationUnit(ASTContext &Context) override {
+    Renamer.addTranslationUnit(Context);
+  }
+
+private:
+  RuleRenamer &Renamer;
+};
+
+struct RuleConsumerFactory {
+  explicit RuleConsumerFactory(RuleRenamer &Renamer) : Renamer(Renamer) {}
+
+  std::unique_ptr<ASTConsumer> newASTConsumer() {
+    return llvm::make_unique<RuleConsumer>(Renamer);
+  }
+
+  RuleRenamer &Renamer;
+};
+
+// Returns true if Decl is within the namespace, class or function whose
+// qualified name is Scope.
+bool isWithin(const NamedDecl *Decl, StringRef Scope) {
+  for (const auto *Context = Decl->getDeclContext(); Context != nullptr;
+       Context = Context->getParent()) {
+    const auto *Named = llvm::dyn_cast<NamedDecl>(Context);
+    if (Named != nullptr && Named->getQualifiedNameAsString() == Scope)
+      return true;
+  }
+  return false;
+}
+
+// Returns true if Kind is what Decl::getDeclKindName() returns for some
+// declarations, or Named
+bool isDeclKind(StringRef Kind) {
+  return llvm::StringSwitch<bool>(Kind)
+#define ABSTRACT_DECL(DECL)
+#define DECL(DERIVED, BASE) .Case(#DERIVED, true)
+#include <clang/AST/DeclNodes.inc>
+      .Case("Named", true)
+      .Default(false);
+}
+}
+
+std::string applyCaseStyle(StringRef Name, CaseStyle Style) {
+  if (Style == CaseStyle::AsIs)
+    return Name.str();
+
+  llvm::SmallVector<std::string, 4> Words;
+  std::string Word;
+  for (size_t I = 0; I < Name.size(); ++I) {
+    const char C = Name[I];
+    if (C == '_') {
+      if (!Word.empty())
+        Words.push_back(std::move(Word));
+      Word.clear();
+      continue;
+    }
+    // fooBar, and HTTPServer
+    const bool Boundary =
+        !Word.empty() && clang::isUppercase(C) &&
+        (!clang::isUppercase(Word.back()) ||
+         (I + 1 < Name.size() && clang::isLowercase(Name[I + 1])));
+    if (Boundary) {
+      Words.push_back(std::move(Word));
+      Word.clear();
+    }
+    Word += C;
+  }
+  if (!Word.empty())
+    Words.push_back(std::move(Word));
+
+  std::string Result;
+  for (size_t I = 0; I < Words.size(); ++I) {
+    const auto Lower = StringRef(Words[I]).lower();
+    switch (Style) {
+    case CaseStyle::UpperCamel:
+    case CaseStyle::LowerCamel:
+      if (I == 0 && Style == CaseStyle::LowerCamel) {
+        Result += Lower;
+      } else {
+        Result += clang::toUppercase(Lower.front());
+        Result += Lower.substr(1);
+      }
+      break;
+    case CaseStyle::Snake:
+      Result += (I == 0 ? "" : "_") + Lower;
+      break;
+    case CaseStyle::UpperSnake:
+      Result += (I == 0 ? "" : "_") + StringRef(Words[I]).upper();
+      break;
+    case CaseStyle::AsIs:
+      break;
+    }
+  }
+  return Result;
+}
+
+bool RenameRule::apply(const NamedDecl *Decl, std::string &NewSpelling) const {
+  if (Kind != "Named" && Kind != Decl->getDeclKindName())
+    return false;
+  // Only the declarations named by a plain identifier can be renamed
+  if (!Decl->getDeclName().isIdentifier())
+    return false;
+  const auto Spelling = Decl->getName();
+  llvm::SmallVector<StringRef, 10> Matches;
+  if (!Name->match(Spelling, &Matches) || Matches.front() != Spelling)
+    return false;
+  if (!Scope.empty() && !isWithin(Decl, Scope))
+    return false;
+  NewSpelling = applyCaseStyle(Name->sub(NewName, Spelling), Style);
+  return isIdentifier(NewSpelling) && NewSpelling != Spelling;
+}
+
+std::string parseRenameRules(StringRef Buffer,
+                             std::vector<RenameRule> &Rules) {
+  unsigned LineNumber = 0;
+  while (!Buffer.empty()) {
+    StringRef Line;
+    std::tie(Line, Buffer) = Buffer.split('\n');
+    ++LineNumber;
+    Line = Line.trim();
+    if (Line.empty() || Line.startswith("#"))
+      continue;
+
+    const auto Error = [&](const llvm::Twine &Message) {
+      return ("line " + llvm::Twine(LineNumber) + ": " + Message).str();
+    };
+    llvm::SmallVector<StringRef, 7> Fields;
+    Line.split(Fields, " ", /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    if (Fields.size() < 3)
+      return Error("expected <kind> <name> <new name>");
+
+    RenameRule Rule;
+    // Both ParmVarDecl and ParmVar, like Decl::getDeclKindName()
+    Rule.Kind = Fields[0];
+    if (StringRef(Rule.Kind).endswith("Decl"))
+      Rule.Kind.resize(Rule.Kind.size() - 4);
+    if (!isDeclKind(Rule.Kind))
+      return Error("unknown kind '" + Fields[0] + "'");
+    Rule.Name = llvm::make_unique<llvm::Regex>(Fields[1]);
+    std::string RegexError;
+    if (!Rule.Name->isValid(RegexError))
+      return Error("invalid name '" + Fields[1] + "': " + RegexError);
+    Rule.NewName = Fields[2];
+    Rule.Style = CaseStyle::AsIs;
+
+    for (size_t I = 3; I < Fields.size(); I += 2) {
+      if (I + 1 == Fields.size())
+        return Error("no value for '" + Fields[I] + "'");
+      const auto Value = Fields[I + 1];
+      if (Fields[I] == "in") {
+        Rule.Scope = Value;
+      } else if (Fields[I] == "case") {
+        if (Value == "UpperCamel")
+          Rule.Style = CaseStyle::UpperCamel;
+        else if (Value == "lowerCamel")
+          Rule.Style = CaseStyle::LowerCamel;
+        else if (Value == "snake_case")
+          Rule.Style = CaseStyle::Snake;
+        else if (Value == "UPPER_SNAKE")
+          Rule.Style = CaseStyle::UpperSnake;
+        else
+          return Error("unknown case style '" + Value + "'");
+      } else {
+        return Error("unknown option '" + Fields[I] + "'");
+      }
+    }
+    Rules.push_back(std::move(Rule));
+  }
+  return std::string();
+}
+
+void RuleRenamer::addTranslationUnit(ASTContext &Context) {
+  Selected.clear();
+
+  MatchFinder Finder;
+  NodeHandlers<RuleHandler> Handlers(this);
+  Handlers.addMatchers(Finder);
+  Finder.matchAST(Context);
+}
+
+void RuleRenamer::addOccurrence(const SourceManager &SourceMgr,
+                                const NamedDecl *Decl, SourceLocation Loc,
+                                unsigned Length) {
+  // Occurrences in macros can't be renamed
+  if (Length == 0 || Loc.isInvalid() || Loc.isMacroID())
+    return;
+
+  const auto *NewSpelling = select(SourceMgr, Decl);
+  if (NewSpelling != nullptr)
+    Replaces.insert(Replacement(SourceMgr, Loc, Length, *NewSpelling));
+}
+
+const std::string *RuleRenamer::select(const SourceManager &SourceMgr,
+                                       const NamedDecl *Decl) {
+  const auto *Canonical = Decl->getCanonicalDecl();
+  const auto Found = Selected.find(Canonical);
+  if (Found != Selected.end())
+    return Found->second;
+
+  const std::string *NewSpelling = nullptr;
+  const auto *Method = llvm::dyn_cast<CXXMethodDecl>(Canonical);
+  if (Method != nullptr && Method->size_overridden_methods() != 0) {
+    // An override keeps the name of the methods it overrides, so it's renamed
+    // along with them, and only if they are all renamed the same way
+    bool Agree = true;
+    for (auto I = Method->begin_overridden_methods(),
+              E = Method->end_overridden_methods();
+         I != E; ++I) {
+      const auto *Spelling = select(SourceMgr, *I);
+      if (I == Method->begin_overridden_methods())
+        NewSpelling = Spelling;
+      else if (Spelling == nullptr || NewSpelling == nullptr ||
+               *Spelling != *NewSpelling)
+        Agree = false;
+    }
+    if (!Agree)
+      NewSpelling = nullptr;
+  } else if (!SourceMgr.isInSystemHeader(Canonical->getLocation())) {
+    // The system headers can't be changed
+    std::string Spelling;
+    for (const auto &Rule : Rules) {
+      if (Rule.apply(Canonical, Spelling)) {
+        NewSpellings.push_back(llvm::make_unique<std::string>(Spelling));
+        NewSpelling = NewSpellings.back().get();
+        break;
+      }
+    }
+  }
+  Selected[Canonical] = NewSpelling;
+  return NewSpelling;
+}
+
+int renameByRules(const CompilationDatabase &Compilations,
+                  const std::vector<std::string> &Files,
+                  const std::vector<RenameRule> &Rules, unsigned Jobs,
+                  clang::DiagnosticConsumer *DiagConsumer,
+                  Replacements &Replaces) {
+  bool FileSkipped = false;
+  const auto Tasks = getCompileCommands(Compilations, Files, &FileSkipped);
+
+  // Each worker collects its own replacements, and they are merged at the end
+  WorkStealingExecutor Executor(Jobs);
+  std::vector<std::unique_ptr<RuleRenamer>> Renamers;
+  for (unsigned Worker = 0; Worker < Executor.getNumWorkers(); ++Worker)
+    Renamers.push_back(llvm::make_unique<RuleRenamer>(Rules));
+  std::atomic<bool> ProcessingFailed(false);
+  SynchronizedDiagConsumer Diagnostics(DiagConsumer);
+  Executor.run(Tasks.size(), [&](size_t Index, unsigned Worker) {
+    RuleConsumerFactory Factory(*Renamers[Worker]);
+    if (!runOnCompileCommand(Tasks[Index].second, Tasks[Index].first,
+                             newFrontendActionFactory(&Factory).get(),
+                             Diagnostics.get()))
+      ProcessingFailed = true;
+  });
+  for (const auto &Renamer : Renamers)
+    Replaces.insert(Renamer->getReplacements().begin(),
+                    Renamer->getReplacements().end());
+  return ProcessingFailed ? 1 : FileSkipped ? 2 : 0;
+}
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Rename/Utility.h"
+
+#include <clang/AST/AST.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/Refactoring.h>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Regex.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rn {
+
+// How the words of a name are joined
+enum class CaseStyle { AsIs, UpperCamel, LowerCamel, Snake, UpperSnake };
+
+// Splits Name into words, at underscores and where the case changes, and
+// joins them again in the given style.
+std::string applyCaseStyle(::llvm::StringRef Name, CaseStyle Style);
+
+// Selects declarations by kind, name and scope, and says what they should be
+// renamed to. A rule is written on a line of its own:
+//
+//   <kind> <name> <new name> [in <scope>] [case <style>]
+//
+// <kind> is the kind of declaration, like ParmVarDecl or EnumConstantDecl, or
+// NamedDecl for any. <name> is a regular expression that has to match the
+// whole name, and <new name> is what it's replaced with, where \1 to \9 are
+// the groups of <name>. With <scope>, only the declarations within the
+// namespace, class or function with that qualified name are selected. The
+// <style> (UpperCamel, lowerCamel, snake_case or UPPER_SNAKE) is applied
+// last. For example:
+//
+//   ParmVarDecl m_(.*) \1
+//   EnumConstantDecl .* \0 in X case UpperCamel
+struct RenameRule {
+  std::string Kind;
+  std::unique_ptr<::llvm::Regex> Name;
+  std::string NewName;
+  std::string Scope;
+  CaseStyle Style;
+
+  // Sets NewSpelling and returns true if the rule selects Decl.
+  bool apply(const ::clang::NamedDecl *Decl, std::string &NewSpelling) const;
+};
+
+// Reads the rules, one per line. Blank lines and lines starting with '#' are
+// ignored, and a kind clang doesn't have is an error. Returns an error
+// message, or an empty string on success.
+std::string parseRenameRules(::llvm::StringRef Buffer,
+                             std::vector<RenameRule> &Rules);
+
+// Collects a Replacement for every occurrence of every declaration that one
+// of the rules selects. The first rule that selects a declaration is the one
+// that renames it. Since whether a rule selects a declaration only depends on
+// the declaration, each translation unit is parsed once, and nothing has to
+// be known about the other ones. The rules aren't applied to the overrides
+// of virtual methods, which are renamed along with the methods they override.
+class RuleRenamer {
+public:
+  explicit RuleRenamer(const std::vector<RenameRule> &Rules) : Rules(Rules) {}
+
+  // Runs the rule matchers over a translation unit.
+  void addTranslationUnit(::clang::ASTContext &Context);
+
+  // Records an occurrence of Decl at Loc, with the given length, if a rule
+  // selects it.
+  void addOccurrence(const ::clang::SourceManager &SourceMgr,
+                     const ::clang::NamedDecl *Decl,
+                     ::clang::SourceLocation Loc, unsigned Length);
+
+  ::clang::tooling::Replacements &getReplacements() { return Replaces; }
+
+private:
+  // Returns the new spelling of Decl, or nullptr if it isn't renamed
+  const std::string *select(const ::clang::SourceManager &SourceMgr,
+                            const ::clang::NamedDecl *Decl);
+
+  const std::vector<RenameRule> &Rules;
+  ::clang::tooling::Replacements Replaces;
+
+  // The new spelling of every canonical declaration seen in the current
+  // translation unit, or nullptr if no rule selects it, so the rules are
+  // only evaluated once per declaration
+  ::llvm::DenseMap<const ::clang::Decl *, const std::string *> Selected;
+  std::vector<std::unique_ptr<std::string>> NewSpellings;
+};
+
+// Renames the declarations selected by Rules in Files, parsing each
+// translation unit once, and adds the replacements to Replaces.
+// Returns 0 on success, like ClangTool::run().
+int renameByRules(const ::clang::tooling::CompilationDatabase &Compilations,
+                  const std::vector<std::string> &Files,
+                  const std::vector<RenameRule> &Rules, unsigned Jobs,
+                  ::clang::DiagnosticConsumer *DiagConsumer,
+                  ::clang::tooling::Replacements &Replaces);
+
+template <typename AnnotatedNode>
+class RuleHandler : public ::clang::ast_matchers::MatchFinder::MatchCallback {
+public:
+  RuleHandler(RuleRenamer *Renamer) : Renamer(Renamer) {}
+
+  void
+  run(const ::clang::ast_matchers::MatchFinder::MatchResult &Result) override {
+    const auto Node = Result.Nodes.getNodeAs<typename AnnotatedNode::NodeType>(
+        AnnotatedNode::ID());
+    const auto Decl = Result.Nodes.getNodeAs<::clang::NamedDecl>(declID());
+    if (Node == nullptr || Decl == nullptr || Result.SourceManager == nullptr)
+      return;
+    Renamer->addOccurrence(*Result.SourceManager, Decl,
+                           AnnotatedNode::getLocation(Node),
+                           AnnotatedNode::getSpellingLength(Node, Decl));
+  }
+
+private:
+  RuleRenamer *Renamer;
+};
+}
@@ -0,0 +1,174 @@
+#include "Rename/Scopes.h"
+#include "Rename/Targets.h"
+#include "Rename/Utility.h"
+
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/DeclTemplate.h>
+
+#include <llvm/ADT/SmallPtrSet.h>
+
+using clang::ASTContext;
+using clang::CXXRecordDecl;
+using clang::ClassTemplateDecl;
+using clang::ClassTemplatePartialSpecializationDecl;
+using clang::ClassTemplateSpecializationDecl;
+using clang::Decl;
+using clang::DeclContext;
+using clang::FunctionDecl;
+using clang::FunctionTemplateDecl;
+using clang::NamedDecl;
+using clang::ParmVarDecl;
+using clang::TemplateDecl;
+using clang::VarTemplateDecl;
+using clang::VarTemplatePartialSpecializationDecl;
+
+using clang::ast_matchers::MatchFinder;
+
+using llvm::ArrayRef;
+using llvm::SmallVectorImpl;
+
+namespace rn {
+
+namespace {
+// Returns the outermost function Context is within, or nullptr
+const Decl *getOutermostFunction(const DeclContext *Context) {
+  const Decl *Function = nullptr;
+  for (; Context != nullptr; Context = Context->getParent()) {
+    if (Context->isFunctionOrMethod())
+      Function = llvm::cast<Decl>(Context);
+  }
+  return Function;
+}
+
+void addOutOfLineMembers(const CXXRecordDecl *Record,
+                         SmallVectorImpl<const Decl *> &Scopes);
+
+// Adds the declarations of Member that are written outside of Record
+void addOutOfLineDecls(const Decl *Member, const CXXRecordDecl *Record,
+                       SmallVectorImpl<const Decl *> &Scopes) {
+  for (const auto *Redecl : Member->redecls()) {
+    if (Redecl->getLexicalDeclContext() != Record)
+      Scopes.push_back(Redecl);
+  }
+}
+
+// Adds the specializations of a member template of Record that are written
+// outside of it, like template <> void A::f<int>() {}, and the out-of-line
+// members of the class specializations.
+void addOutOfLineSpecializations(const TemplateDecl *Template,
+                                 const CXXRecordDecl *Record,
+                                 SmallVectorImpl<const Decl *> &Scopes) {
+  if (const auto *Functions = llvm::dyn_cast<FunctionTemplateDecl>(Template)) {
+    for (const auto *Specialization : Functions->specializations())
+      addOutOfLineDecls(Specialization, Record, Scopes);
+  } else if (const auto *Classes =
+                 llvm::dyn_cast<ClassTemplateDecl>(Template)) {
+    llvm::SmallVector<const CXXRecordDecl *, 4> Specializations(
+        Classes->specializations().begin(), Classes->specializations().end());
+    llvm::SmallVector<ClassTemplatePartialSpecializationDecl *, 4> Partial;
+    const_cast<ClassTemplateDecl *>(Classes)->getPartialSpecializations(
+        Partial);
+    Specializations.append(Partial.begin(), Partial.end());
+    for (const auto *Specialization : Specializations) {
+      addOutOfLineDecls(Specialization, Record, Scopes);
+      if (Specialization->hasDefinition())
+        addOutOfLineMembers(Specialization->getDefinition(), Scopes);
+    }
+  } else if (const auto *Variables =
+                 llvm::dyn_cast<VarTemplateDecl>(Template)) {
+    for (const auto *Specialization : Variables->specializations())
+      addOutOfLineDecls(Specialization, Record, Scopes);
+    llvm::SmallVector<VarTemplatePartialSpecializationDecl *, 4> Partial;
+    const_cast<VarTemplateDecl *>(Variables)->getPartialSpecializations(
+        Partial);
+    for (const auto *Specialization : Partial)
+      addOutOfLineDecls(Specialization, Record, Scopes);
+  }
+}
+
+// Adds the declarations of Record's members, and of the members of its nested
+// classes, that are written outside of them, like void A::f() {}
+void addOutOfLineMembers(const CXXRecordDecl *Record,
+                         SmallVectorImpl<const Decl *> &Scopes) {
+  for (const auto *Member : Record->decls()) {
+    if (const auto *Template = llvm::dyn_cast<TemplateDecl>(Member)) {
+      addOutOfLineSpecializations(Template, Record, Scopes);
+      Member = Template->getTemplatedDecl();
+    }
+    if (Member == nullptr)
+      continue;
+    const auto *Nested = llvm::dyn_cast<CXXRecordDecl>(Member);
+    if (Nested != nullptr && Nested->isInjectedClassName())
+      continue;
+    addOutOfLineDecls(Member, Record, Scopes);
+    if (Nested != nullptr && Nested->hasDefinition())
+      addOutOfLineMembers(Nested->getDefinition(), Scopes);
+  }
+}
+}
+
+bool addEnclosingScopes(const NamedDecl *Decl,
+                        SmallVectorImpl<const clang::Decl *> &Scopes) {
+  // Local extern declarations refer to something declared elsewhere
+  if (Decl->isLocalExternDecl())
+    return false;
+  const auto *Context = Decl->getDeclContext();
+
+  // A parameter is renamed in every declaration of its function
+  if (const auto *Parm = llvm::dyn_cast<ParmVarDecl>(Decl)) {
+    const auto *Function = llvm::dyn_cast<FunctionDecl>(Context);
+    if (Function == nullptr)
+      return false;
+    if (const auto *Outer = getOutermostFunction(Function->getParent())) {
+      Scopes.push_back(Outer);
+      return true;
+    }
+    for (const auto *Redecl : Function->redecls())
+      Scopes.push_back(Redecl);
+    return true;
+  }
+
+  // Only the declarations directly within a function are local to it. The
+  // members of a local class can still be reached from outside, through a
+  // deduced return type.
+  if (Context->isFunctionOrMethod()) {
+    Scopes.push_back(getOutermostFunction(Context));
+    return true;
+  }
+
+  // A private member can only be named by its class and the class's friends.
+  // The name of a constructor or an operator is the class's, or shared with
+  // others, and a template can be specialized anywhere.
+  const auto *Record = llvm::dyn_cast<CXXRecordDecl>(Context);
+  if (Record == nullptr || Decl->getAccess() != clang::AS_private ||
+      !Decl->getDeclName().isIdentifier() || Record->hasFriends() ||
+      Record->isDependentContext() ||
+      llvm::isa<ClassTemplateSpecializationDecl>(Record))
+    return false;
+  Scopes.push_back(Record);
+  addOutOfLineMembers(Record, Scopes);
+  return true;
+}
+
+bool getEnclosingScopes(const TargetDecls &Targets,
+                        SmallVectorImpl<const Decl *> &Scopes) {
+  for (const auto &Target : Targets) {
+    const auto *Named = llvm::dyn_cast<NamedDecl>(Target.first);
+    if (Named == nullptr || !addEnclosingScopes(Named, Scopes))
+      return false;
+  }
+  return true;
+}
+
+void matchWithinScopes(ASTContext &Context, MatchFinder &Finder,
+                       ArrayRef<const Decl *> Scopes) {
+  const auto SkipNone = [](const Decl *) { return false; };
+  MatchingVisitor Matcher(Context, Finder, SkipNone);
+  // The same function can be the scope of several targets
+  llvm::SmallPtrSet<const Decl *, 8> Traversed;
+  for (const auto *Scope : Scopes) {
+    if (Traversed.insert(Scope).second)
+      Matcher.TraverseDecl(const_cast<Decl *>(Scope));
+  }
+}
+}
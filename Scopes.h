@@ -0,0 +1,36 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+
+namespace rn {
+
+class TargetDecls;
+
+// Adds the declarations that every reference to Decl has to be within to
+// Scopes, and returns true, if they can be told from Decl alone:
+// - for a local variable or type, the outermost function it is declared in,
+// - for a parameter, every declaration of its function,
+// - for a private member of a class that has no friends and isn't a
+//   template, the class and the out-of-line definitions of its members,
+//   including the explicit specializations of its member templates.
+// Returns false if a reference to Decl can be anywhere in the translation
+// unit.
+bool addEnclosingScopes(const ::clang::NamedDecl *Decl,
+                        ::llvm::SmallVectorImpl<const ::clang::Decl *> &Scopes);
+
+// Same as above for every one of Targets. Returns false if one of them can be
+// referred to anywhere.
+bool getEnclosingScopes(const TargetDecls &Targets,
+                        ::llvm::SmallVectorImpl<const ::clang::Decl *> &Scopes);
+
+// Runs the matchers of Finder over the nodes within Scopes only, instead of
+// the whole translation unit.
+void matchWithinScopes(::clang::ASTContext &Context,
+                       ::clang::ast_matchers::MatchFinder &Finder,
+                       ::llvm::ArrayRef<const ::clang::Decl *> Scopes);
+}
@@ -0,0 +1,250 @@
+#include "Rename/Server.h"
+#include "Rename/Handlers.h"
+#include "Rename/Tool.h"
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/SourceMgr.h>
+#include <llvm/Support/YAMLParser.h>
+
+using clang::tooling::CompilationDatabase;
+
+using llvm::StringRef;
+using llvm::raw_ostream;
+
+namespace rn {
+
+namespace {
+struct Request {
+  Request() : IsNumericID(false), Line(0), Column(0), HasFiles(false) {}
+
+  // Echoed back as a number if it was an integer, and as a string otherwise
+  std::string ID;
+  bool IsNumericID;
+  std::string Command;
+  std::string File;
+  unsigned Line;
+  unsigned Column;
+  std::string NewName;
+  bool HasFiles;
+  std::vector<std::string> Files;
+};
+
+void writeString(raw_ostream &Out, StringRef String) {
+  Out << '"';
+  for (const char C : String) {
+    switch (C) {
+    case '"':
+      Out << "\\\"";
+      break;
+    case '\\':
+      Out << "\\\\";
+      break;
+    case '\n':
+      Out << "\\n";
+      break;
+    case '\t':
+      Out << "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(C) < 0x20)
+        Out << llvm::format("\\u%04x", static_cast<unsigned char>(C));
+      else
+        Out << C;
+    }
+  }
+  Out << '"';
+}
+
+bool getString(llvm::yaml::Node *Node, std::string &Value) {
+  auto *Scalar = llvm::dyn_cast_or_null<llvm::yaml::ScalarNode>(Node);
+  if (Scalar == nullptr)
+    return false;
+  llvm::SmallString<64> Storage;
+  Value = Scalar->getValue(Storage);
+  return true;
+}
+
+bool getUnsigned(llvm::yaml::Node *Node, unsigned &Value) {
+  std::string String;
+  return getString(Node, String) && !StringRef(String).getAsInteger(10, Value);
+}
+
+// JSON is parsed as YAML, like JSONCompilationDatabase does.
+// Returns an error message, or an empty string on success.
+std::string parseRequest(StringRef Line, Request &R) {
+  llvm::SourceMgr SourceMgr;
+  // Report the errors in the reply, not on stderr
+  SourceMgr.setDiagHandler([](const llvm::SMDiagnostic &, void *) {}, nullptr);
+  llvm::yaml::Stream Stream(Line, SourceMgr);
+  auto Document = Stream.begin();
+  if (Document == Stream.end())
+    return "empty request";
+  auto *Root = llvm::dyn_cast_or_null<llvm::yaml::MappingNode>(
+      Document->getRoot());
+  if (Root == nullptr)
+    return "the request is not an object";
+
+  for (auto &KeyValue : *Root) {
+    std::string Key;
+    if (!getString(KeyValue.getKey(), Key))
+      return "invalid key";
+    auto *Value = KeyValue.getValue();
+    bool Valid = true;
+    if (Key == "id") {
+      auto *Scalar = llvm::dyn_cast_or_null<llvm::yaml::ScalarNode>(Value);
+      Valid = Scalar != nullptr;
+      if (Valid) {
+        llvm::SmallString<64> Storage;
+        R.ID = Scalar->getValue(Storage);
+        // Quoted numbers stay strings
+        const auto Raw = Scalar->getRawValue();
+        long long Number;
+        R.IsNumericID = !Raw.startswith("\"") && !Raw.startswith("'") &&
+                        !StringRef(R.ID).getAsInteger(10, Number);
+        // Written back without the leading zeros JSON doesn't allow
+        if (R.IsNumericID)
+          R.ID = std::to_string(Number);
+      }
+    } else if (Key == "command") {
+      Valid = getString(Value, R.Command);
+    } else if (Key == "file") {
+      Valid = getString(Value, R.File);
+    } else if (Key == "line") {
+      Valid = getUnsigned(Value, R.Line);
+    } else if (Key == "column") {
+      Valid = getUnsigned(Value, R.Column);
+    } else if (Key == "new-name") {
+      Valid = getString(Value, R.NewName);
+    } else if (Key == "files") {
+      auto *Sequence = llvm::dyn_cast_or_null<llvm::yaml::SequenceNode>(Value);
+      Valid = R.HasFiles = Sequence != nullptr;
+      if (Valid) {
+        for (auto It = Sequence->begin(); Valid && It != Sequence->end();
+             ++It) {
+          R.Files.emplace_back();
+          Valid = getString(&*It, R.Files.back());
+        }
+      }
+    } else {
+      // Skip what isn't understood
+      Value->skip();
+    }
+    if (!Valid)
+      return "invalid value for '" + Key + "'";
+  }
+  if (Stream.failed())
+    return "the request is not valid JSON";
+  return "";
+}
+
+void writeID(raw_ostream &Out, const Request &R) {
+  if (R.ID.empty())
+    return;
+  Out << "\"id\": ";
+  if (R.IsNumericID)
+    Out << R.ID;
+  else
+    writeString(Out, R.ID);
+  Out << ", ";
+}
+
+void writeError(raw_ostream &Out, const Request &R, StringRef Message) {
+  Out << "{";
+  writeID(Out, R);
+  Out << "\"error\": ";
+  writeString(Out, Message);
+  Out << "}\n";
+}
+}
+
+RenameServer::RenameServer(const CompilationDatabase &Compilations,
+                           std::vector<std::string> Files, unsigned CacheSize)
+    : Compilations(Compilations), Files(std::move(Files)),
+      DiagConsumer(nullptr), Prefilter(false), Jobs(1), Index(nullptr),
+      Cache(Compilations, CacheSize) {}
+
+void RenameServer::setDiagnosticConsumer(clang::DiagnosticConsumer *Consumer) {
+  DiagConsumer = Consumer;
+  Cache.setDiagnosticConsumer(Consumer);
+}
+
+void RenameServer::run(std::istream &In, raw_ostream &Out) {
+  std::string Line;
+  while (std::getline(In, Line)) {
+    if (StringRef(Line).trim().empty())
+      continue;
+    if (!handle(Line, Out))
+      break;
+    Out.flush();
+  }
+  Out.flush();
+}
+
+bool RenameServer::handle(StringRef Line, raw_ostream &Out) {
+  Request R;
+  const auto Error = parseRequest(Line, R);
+  if (!Error.empty()) {
+    writeError(Out, R, Error);
+    return true;
+  }
+  if (R.Command == "shutdown")
+    return false;
+  if (R.Command != "locate" && R.Command != "rename") {
+    writeError(Out, R, "unknown command '" + R.Command + "'");
+    return true;
+  }
+  if (R.File.empty() || R.Line == 0 || R.Column == 0) {
+    writeError(Out, R, "no location provided");
+    return true;
+  }
+  if (R.Command == "rename" && R.NewName.empty()) {
+    writeError(Out, R, "no new name provided");
+    return true;
+  }
+
+  SymbolData Data(R.File, R.Line, R.Column, R.NewName);
+  RenameTool Tool(Compilations, R.HasFiles ? R.Files : Files);
+  Tool.setDiagnosticConsumer(DiagConsumer);
+  Tool.setPrefilter(Prefilter);
+  Tool.setJobs(Jobs);
+  Tool.setIndex(Index);
+  Tool.setASTCache(&Cache);
+
+  if (Tool.locate(Data)) {
+    writeError(Out, R, "failed to parse " + R.File);
+    return true;
+  }
+  if (Data.USR.empty()) {
+    writeError(Out, R, "unable to determine USR");
+    return true;
+  }
+  const bool Failed = R.Command == "rename" && Tool.rename(Data) != 0;
+
+  Out << "{";
+  writeID(Out, R);
+  Out << "\"usr\": ";
+  writeString(Out, Data.USR);
+  Out << ", \"spelling\": ";
+  writeString(Out, Data.Spelling);
+  if (R.Command == "rename") {
+    // Some files failing doesn't prevent renaming the others
+    if (Failed)
+      Out << ", \"warning\": \"some files could not be processed\"";
+    Out << ", \"replacements\": [";
+    bool First = true;
+    for (const auto &Replace : Tool.getReplacements()) {
+      Out << (First ? "" : ", ") << "{\"file\": ";
+      writeString(Out, Replace.getFilePath());
+      Out << ", \"offset\": " << Replace.getOffset()
+          << ", \"length\": " << Replace.getLength() << ", \"text\": ";
+      writeString(Out, Replace.getReplacementText());
+      Out << "}";
+      First = false;
+    }
+    Out << "]";
+  }
+  Out << "}\n";
+  return true;
+}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Rename/Cache.h"
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Tooling/CompilationDatabase.h>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace rn {
+
+class OccurrenceIndex;
+
+// Answers locate and rename requests for editors, keeping the compilation
+// database and the ASTs of the recently used files alive between them.
+//
+// Each request is a JSON object on a line of its own, and gets a JSON object
+// on a line of its own in reply:
+//
+//   {"id": 1, "command": "locate", "file": "a.cpp", "line": 3, "column": 5}
+//   {"id": 1, "usr": "c:@F@f#", "spelling": "f"}
+//
+//   {"id": 2, "command": "rename", "file": "a.cpp", "line": 3, "column": 5,
+//    "new-name": "g", "files": ["a.cpp", "b.cpp"]}
+//   {"id": 2, "usr": "c:@F@f#", "spelling": "f", "replacements":
+//    [{"file": "/src/a.cpp", "offset": 20, "length": 1, "text": "g"}]}
+//
+// "files" defaults to the files the server was started with. A request that
+// fails gets {"id": ..., "error": "..."}, and {"command": "shutdown"} stops
+// the server.
+class RenameServer {
+public:
+  RenameServer(const ::clang::tooling::CompilationDatabase &Compilations,
+               std::vector<std::string> Files, unsigned CacheSize);
+
+  // The consumer has to outlive the server.
+  void setDiagnosticConsumer(::clang::DiagnosticConsumer *Consumer);
+
+  void setPrefilter(bool Enable) { Prefilter = Enable; }
+  // The number of files that aren't cached a rename parses in parallel.
+  void setJobs(unsigned NumJobs) { Jobs = NumJobs; }
+  void setIndex(const OccurrenceIndex *NewIndex) { Index = NewIndex; }
+
+  // Answers the requests read from In on Out, until In is closed or a
+  // shutdown request is received.
+  void run(std::istream &In, ::llvm::raw_ostream &Out);
+
+  // Answers a single request. Returns false if it's a shutdown request.
+  bool handle(::llvm::StringRef Request, ::llvm::raw_ostream &Out);
+
+private:
+  const ::clang::tooling::CompilationDatabase &Compilations;
+  std::vector<std::string> Files;
+  ::clang::DiagnosticConsumer *DiagConsumer;
+  bool Prefilter;
+  unsigned Jobs;
+  const OccurrenceIndex *Index;
+  ASTCache Cache;
+};
+}
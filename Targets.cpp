@@ -0,0 +1,99 @@
+#include "Rename/Targets.h"
+#include "Rename/Handlers.h"
+#include "Rename/Utility.h"
+
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/Basic/IdentifierTable.h>
+
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringMap.h>
+
+using clang::ASTContext;
+using clang::Decl;
+using clang::IdentifierInfo;
+using clang::NamedDecl;
+using clang::RecursiveASTVisitor;
+
+using llvm::ArrayRef;
+
+namespace rn {
+
+namespace {
+// Visits every NamedDecl, and keeps the canonical declarations with one of the
+// USRs or qualified names.
+class TargetFinder : public RecursiveASTVisitor<TargetFinder> {
+public:
+  TargetFinder(const llvm::StringMap<const SymbolData *> &USRs,
+               const llvm::StringMap<const SymbolData *> &QualifiedNames,
+               const llvm::SmallPtrSetImpl<const IdentifierInfo *> *Names,
+               llvm::SmallDenseMap<const Decl *, const SymbolData *, 4> &Decls)
+      : USRs(USRs), QualifiedNames(QualifiedNames), Names(Names),
+        Decls(Decls) {}
+
+  // Same as the MatchFinder's own traversal
+  bool shouldVisitTemplateInstantiations() const { return true; }
+  bool shouldVisitImplicitCode() const { return true; }
+
+  bool VisitNamedDecl(NamedDecl *D) {
+    // Only the declarations spelled like one of the symbols can have its USR,
+    // which saves generating a USR for nearly all of them. Constructors,
+    // operators and the like don't have an identifier, so they are always
+    // checked.
+    if (Names != nullptr && D->getDeclName().isIdentifier() &&
+        Names->count(D->getIdentifier()) == 0)
+      return true;
+    const auto *Canonical = D->getCanonicalDecl();
+    if (!Checked.insert(Canonical).second)
+      return true;
+    if (!USRs.empty()) {
+      auto Found = USRs.find(getUSRForDecl(D));
+      if (Found != USRs.end()) {
+        Decls.insert(std::make_pair(Canonical, Found->second));
+        return true;
+      }
+    }
+    if (!QualifiedNames.empty()) {
+      auto Found = QualifiedNames.find(Canonical->getQualifiedNameAsString());
+      if (Found != QualifiedNames.end())
+        Decls.insert(std::make_pair(Canonical, Found->second));
+    }
+    return true;
+  }
+
+private:
+  const llvm::StringMap<const SymbolData *> &USRs;
+  const llvm::StringMap<const SymbolData *> &QualifiedNames;
+  const llvm::SmallPtrSetImpl<const IdentifierInfo *> *Names;
+  llvm::SmallDenseMap<const Decl *, const SymbolData *, 4> &Decls;
+  llvm::SmallPtrSet<const Decl *, 32> Checked;
+};
+}
+
+void TargetDecls::resolve(ASTContext &Context, ArrayRef<SymbolData> Symbols) {
+  Decls.clear();
+  llvm::StringMap<const SymbolData *> USRs;
+  llvm::StringMap<const SymbolData *> QualifiedNames;
+  llvm::SmallPtrSet<const IdentifierInfo *, 4> Names;
+  bool AllIdentifiers = true;
+  for (const auto &Data : Symbols) {
+    if (!Data.USR.empty()) {
+      USRs.insert(std::make_pair(Data.USR, &Data));
+    } else if (!Data.QualifiedName.empty()) {
+      // ::ns::Point names the same declarations as ns::Point
+      QualifiedNames.insert(std::make_pair(
+          llvm::StringRef(Data.QualifiedName).ltrim(":"), &Data));
+    } else {
+      continue;
+    }
+    if (isIdentifier(Data.Spelling))
+      Names.insert(&Context.Idents.get(Data.Spelling));
+    else
+      AllIdentifiers = false;
+  }
+  if (USRs.empty() && QualifiedNames.empty())
+    return;
+  TargetFinder Finder(USRs, QualifiedNames, AllIdentifiers ? &Names : nullptr,
+                      Decls);
+  Finder.TraverseDecl(Context.getTranslationUnitDecl());
+}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/DeclBase.h>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+
+namespace rn {
+
+struct SymbolData;
+
+// The canonical declarations of the symbols being renamed in one translation
+// unit. They are resolved from the USRs once, so the rename matchers only
+// have to look up pointers instead of generating a USR for every candidate
+// node.
+class TargetDecls {
+public:
+  // Finds the declarations in Context that have the USR, or the qualified
+  // name, of one of Symbols. Symbols has to outlive the targets.
+  void resolve(::clang::ASTContext &Context,
+               ::llvm::ArrayRef<SymbolData> Symbols);
+
+  bool contains(const ::clang::Decl *Decl) const {
+    return lookup(Decl) != nullptr;
+  }
+
+  // Returns the symbol Decl is a declaration of, or nullptr if it isn't one
+  // of the targets.
+  const SymbolData *lookup(const ::clang::Decl *Decl) const {
+    if (Decl == nullptr)
+      return nullptr;
+    return Decls.lookup(Decl->getCanonicalDecl());
+  }
+
+  bool empty() const { return Decls.empty(); }
+
+  // The canonical declarations, and the symbols they are declarations of
+  using DeclMap =
+      ::llvm::SmallDenseMap<const ::clang::Decl *, const SymbolData *, 4>;
+  DeclMap::const_iterator begin() const { return Decls.begin(); }
+  DeclMap::const_iterator end() const { return Decls.end(); }
+
+private:
+  DeclMap Decls;
+};
+}
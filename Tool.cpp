@@ -0,0 +1,774 @@
+#include "Rename/Tool.h"
+#include "Rename/Cache.h"
+#include "Rename/Dependencies.h"
+#include "Rename/Edits.h"
+#include "Rename/Headers.h"
+#include "Rename/Index.h"
+#include "Rename/Kinds.h"
+#include "Rename/Locate.h"
+#include "Rename/Nodes.h"
+#include "Rename/Occurrences.h"
+#include "Rename/Parallel.h"
+#include "Rename/Preamble.h"
+#include "Rename/Prefilter.h"
+#include "Rename/Scopes.h"
+#include "Rename/Targets.h"
+#include "Rename/Utility.h"
+#include "Rename/Visitor.h"
+
+#include <clang/AST/ASTConsumer.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/Basic/FileManager.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+using clang::ASTConsumer;
+using clang::ASTContext;
+using clang::ASTUnit;
+using clang::CompilerInstance;
+using clang::CompilerInvocation;
+using clang::FileManager;
+using clang::PCHContainerOperations;
+using clang::tooling::ClangTool;
+using clang::tooling::CompileCommand;
+using clang::tooling::Replacement;
+using clang::tooling::Replacements;
+using clang::tooling::ToolAction;
+using clang::tooling::CompilationDatabase;
+using clang::tooling::getAbsolutePath;
+using clang::tooling::newFrontendActionFactory;
+
+using clang::ast_matchers::MatchFinder;
+
+namespace rn {
+
+namespace {
+// Everything the rename phase needs for each translation unit
+struct RenamePass {
+  RenamePass(llvm::ArrayRef<SymbolData> Symbols, OccurrenceStore *Occurrences,
+             RenameStats &Stats, HeaderClaims *Claims, RenameEngine Engine)
+      : Symbols(Symbols), Occurrences(Occurrences),
+        Matchers(Occurrences, &Targets), Stats(Stats), Claims(Claims),
+        Engine(Engine) {}
+
+  // Resolves the targets of a translation unit, then looks for the references
+  // to them with the engine. With claims, the headers that were already
+  // looked at in a translation unit with the same Config are skipped.
+  void run(ASTContext &Context, const Digest *Config = nullptr) {
+    ++Stats.TranslationUnits;
+    // The identifier table knows every name the preprocessor has seen, so if
+    // none of the symbols' names are in it, nothing here can refer to them.
+    if (std::none_of(Symbols.begin(), Symbols.end(),
+                     [&](const SymbolData &Data) {
+                       return !isIdentifier(Data.Spelling) ||
+                              mentionsIdentifier(Context, Data.Spelling);
+                     })) {
+      ++Stats.SkippedTranslationUnits;
+      return;
+    }
+    Targets.resolve(Context, Symbols);
+    if (Targets.empty())
+      return;
+    Occurrences->startTranslationUnit();
+    if (Engine == RenameEngine::Visitor) {
+      visit(Context, Config);
+      return;
+    }
+    // Only the matchers of the nodes that can refer to the kinds of the
+    // targets are run
+    const auto Kinds = getReferringKinds(Targets);
+    if (Kinds != NK_All)
+      ++Stats.NarrowedTranslationUnits;
+    auto &Finder = Matchers.get(Kinds);
+    // Locals and private members can only be referred to from within a few
+    // declarations, so the rest of the translation unit isn't looked at
+    llvm::SmallVector<const clang::Decl *, 8> Scopes;
+    if (getEnclosingScopes(Targets, Scopes)) {
+      ++Stats.ScopedTranslationUnits;
+      matchWithinScopes(Context, Finder, Scopes);
+      return;
+    }
+    if (Claims != nullptr && Config != nullptr)
+      Stats.SkippedHeaders +=
+          matchUnclaimedFiles(Context, Finder, *Claims, *Config);
+    else
+      Finder.matchAST(Context);
+  }
+
+  // Same as the rest of run(), with a single traversal instead of the
+  // matchers
+  void visit(ASTContext &Context, const Digest *Config) {
+    llvm::SmallVector<const clang::Decl *, 8> Scopes;
+    if (getEnclosingScopes(Targets, Scopes)) {
+      ++Stats.ScopedTranslationUnits;
+      renameReferencesWithinScopes(Context, Targets, *Occurrences, Scopes);
+      return;
+    }
+    if (Claims != nullptr && Config != nullptr) {
+      SkippedFiles Skipped(Context, *Claims, *Config);
+      renameReferencesOutside(Context, Targets, *Occurrences, Skipped);
+      Stats.SkippedHeaders += Skipped.size();
+    } else {
+      renameReferences(Context, Targets, *Occurrences);
+    }
+  }
+
+  llvm::ArrayRef<SymbolData> Symbols;
+  OccurrenceStore *Occurrences;
+  // Resolved again for every translation unit
+  TargetDecls Targets;
+  RenameMatchers Matchers;
+  RenameStats &Stats;
+  HeaderClaims *Claims;
+  RenameEngine Engine;
+};
+
+class RenameConsumer : public ASTConsumer {
+public:
+  RenameConsumer(RenamePass &Pass, const Digest *Config)
+      : Pass(Pass), Config(Config) {}
+
+  void HandleTranslationUnit(ASTContext &Context) override {
+    Pass.run(Context, Config);
+  }
+
+private:
+  RenamePass &Pass;
+  const Digest *Config;
+};
+
+struct RenameConsumerFactory {
+  explicit RenameConsumerFactory(RenamePass &Pass,
+                                 const Digest *Config = nullptr)
+      : Pass(Pass), Config(Config) {}
+
+  std::unique_ptr<ASTConsumer> newASTConsumer() {
+    return llvm::make_unique<RenameConsumer>(Pass, Config);
+  }
+
+  RenamePass &Pass;
+  const Digest *Config;
+};
+
+// Keeps the AST of every invocation it runs, like ClangTool::buildASTs() does
+class ASTBuilderAction : public ToolAction {
+public:
+  explicit ASTBuilderAction(std::vector<std::unique_ptr<ASTUnit>> &ASTs)
+      : ASTs(ASTs) {}
+
+  bool runInvocation(CompilerInvocation *Invocation, FileManager *Files,
+                     std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                     clang::DiagnosticConsumer *DiagConsumer) override {
+    std::unique_ptr<ASTUnit> AST = ASTUnit::LoadFromCompilerInvocation(
+        Invocation, std::move(PCHContainerOps),
+        CompilerInstance::createDiagnostics(&Invocation->getDiagnosticOpts(),
+                                            DiagConsumer,
+                                            /*ShouldOwnClient=*/false),
+        Files);
+    if (!AST)
+      return false;
+    ASTs.push_back(std::move(AST));
+    return true;
+  }
+
+private:
+  std::vector<std::unique_ptr<ASTUnit>> &ASTs;
+};
+
+// Rewrites the file Edits are in, unless its contents wouldn't change.
+// Returns false if it can't be read or written, and sets Skipped if the
+// edits can't be applied.
+bool saveFile(const OccurrenceStore &Occurrences, FileEdits Edits,
+              std::atomic<bool> &Skipped) {
+  const auto Name = Occurrences.getFileName(Edits.front().File);
+  auto Buffer = llvm::MemoryBuffer::getFile(Name);
+  if (!Buffer)
+    return false;
+  const auto Code = (*Buffer)->getBuffer();
+  std::string Rewritten;
+  if (!applyEdits(Occurrences, Edits, Code, Rewritten)) {
+    Skipped = true;
+    return true;
+  }
+  // Files that wouldn't change aren't touched, so their mtime doesn't
+  // trigger a rebuild
+  if (Rewritten == Code)
+    return true;
+  Buffer->reset();
+  return writeAtomically(Name, Rewritten);
+}
+
+// Writes the main files of a parallel rename as soon as the last of their
+// translation units is done, instead of once all of them are. Only the files
+// no other translation unit includes are written this way, since nothing
+// else can add to their occurrences.
+class MainFileWriter {
+public:
+  // Tasks are the compile commands of the rename, and Streamed the main
+  // files to write. Their occurrences in Existing, which were collected
+  // before the rename, are written along with them.
+  MainFileWriter(
+      const std::vector<std::pair<std::string, CompileCommand>> &Tasks,
+      const llvm::StringSet<> &Streamed, const OccurrenceStore &Existing)
+      : Skipped(false), Failed(false) {
+    llvm::StringMap<unsigned> Slots;
+    for (const auto &Task : Tasks) {
+      if (!Streamed.count(Task.first)) {
+        TaskFiles.push_back(nullptr);
+        continue;
+      }
+      // Named like the occurrences name it
+      auto Name = makeAbsolute("", Task.first);
+      const auto Inserted =
+          Slots.insert(std::make_pair(Name, unsigned(Files.size())));
+      if (Inserted.second) {
+        Files.push_back(llvm::make_unique<File>());
+        Files.back()->Name = std::move(Name);
+        Files.back()->Pending = 0;
+      }
+      TaskFiles.push_back(Files[Inserted.first->second].get());
+      ++TaskFiles.back()->Pending;
+    }
+    for (const auto &O : Existing.getOccurrences()) {
+      const auto Name = Existing.getFileName(O.File);
+      const auto Found = Slots.find(Name);
+      if (Found != Slots.end())
+        Files[Found->second]->Occurrences.add(
+            Name, O.Offset, O.Length, Existing.getSpelling(O.Spelling));
+    }
+  }
+
+  // Returns true if the main file of the task is written by finish()
+  bool isStreamed(size_t Task) const { return TaskFiles[Task] != nullptr; }
+
+  // Adds the occurrences Task found in its main file, and writes it if this
+  // was its last task. The other occurrences are added to Rest.
+  void finish(size_t Task, const OccurrenceStore &Found,
+              OccurrenceStore &Rest) {
+    auto &F = *TaskFiles[Task];
+    std::lock_guard<std::mutex> Lock(F.Lock);
+    for (const auto &O : Found.getOccurrences()) {
+      const auto Name = Found.getFileName(O.File);
+      (Name == F.Name ? F.Occurrences : Rest)
+          .add(Name, O.Offset, O.Length, Found.getSpelling(O.Spelling));
+    }
+    if (--F.Pending != 0 || F.Occurrences.empty())
+      return;
+    F.Occurrences.sort();
+    for (const auto &Edits : getFileEdits(F.Occurrences)) {
+      if (!saveFile(F.Occurrences, Edits, Skipped))
+        Failed = true;
+    }
+  }
+
+  // Adds the main files it writes to Names
+  void getFiles(llvm::StringSet<> &Names) const {
+    for (const auto &F : Files)
+      Names.insert(F->Name);
+  }
+
+  bool skipped() const { return Skipped; }
+  bool failed() const { return Failed; }
+
+private:
+  struct File {
+    std::string Name;
+    std::mutex Lock;
+    OccurrenceStore Occurrences;
+    // The tasks that haven't finished
+    unsigned Pending;
+  };
+
+  std::vector<std::unique_ptr<File>> Files;
+  // The file each task writes, if any
+  std::vector<File *> TaskFiles;
+  std::atomic<bool> Skipped;
+  std::atomic<bool> Failed;
+};
+}
+
+RenameTool::RenameTool(const CompilationDatabase &Compilations,
+                       std::vector<std::string> Files)
+    : Compilations(Compilations), Files(std::move(Files)),
+      DiagConsumer(nullptr), Prefilter(false), Jobs(1), Index(nullptr),
+      Cache(nullptr), Preambles(nullptr), Graph(nullptr),
+      Engine(RenameEngine::Matchers), SaveAsParsed(false),
+      ReplacesBuilt(true), SaveSkipped(false), SaveFailed(false) {}
+
+RenameTool::~RenameTool() {}
+
+void RenameTool::setDeduplicateHeaders(bool Enable) {
+  if (!Enable)
+    Claims.reset();
+  else if (!Claims)
+    Claims = llvm::make_unique<HeaderClaims>();
+}
+
+int RenameTool::locate(SymbolData &Data) {
+  CursorFile = getAbsolutePath(Data.File);
+  // The symbols of a batch that are in the same file share its ASTs
+  if (hasCursorFile())
+    return locateInASTs(Data);
+
+  // Only one translation unit is needed to find the symbol. If the cursor is
+  // in a header, this is the cheapest file that includes it, or the next one
+  // if it turns out not to, and then the files that include it through other
+  // headers.
+  auto Candidates = selectLocateFiles(Compilations, CursorFile);
+  int Result = 0;
+  for (bool Indirect = false;; Indirect = true) {
+    for (const auto &File : Candidates) {
+      Result = buildLocateASTs(File);
+      if (Result == 0 && hasCursorFile())
+        return locateInASTs(Data);
+    }
+    if (Indirect || !Compilations.getCompileCommands(CursorFile).empty())
+      break;
+    Candidates = findIndirectIncluders(Compilations, CursorFile, Candidates);
+  }
+  return Result != 0 ? Result : locateInASTs(Data);
+}
+
+int RenameTool::buildLocateASTs(const std::string &File) {
+  LocatedFile = File;
+  ASTs.clear();
+  OwnedASTs.clear();
+
+  if (Cache != nullptr) {
+    if (!Cache->get(LocatedFile, ASTs))
+      return 1;
+  } else if (Preambles != nullptr) {
+    if (int Result = buildASTsWithPreambles(LocatedFile))
+      return Result;
+    for (const auto &AST : OwnedASTs)
+      ASTs.push_back(AST.get());
+  } else {
+    ClangTool Tool(Compilations, {LocatedFile});
+    Tool.setDiagnosticConsumer(DiagConsumer);
+    if (int Result = Tool.buildASTs(OwnedASTs))
+      return Result;
+    for (const auto &AST : OwnedASTs)
+      ASTs.push_back(AST.get());
+  }
+  return 0;
+}
+
+bool RenameTool::hasCursorFile() const {
+  return std::any_of(ASTs.begin(), ASTs.end(), [&](clang::ASTUnit *AST) {
+    return isInTranslationUnit(AST->getASTContext(), CursorFile);
+  });
+}
+
+int RenameTool::locateInASTs(SymbolData &Data) {
+  for (const auto &AST : ASTs) {
+    locateSymbol(AST->getASTContext(), Data);
+    if (!Data.USR.empty())
+      break;
+  }
+  return 0;
+}
+
+int RenameTool::rename(const SymbolData &Data) {
+  return rename(llvm::makeArrayRef(Data));
+}
+
+int RenameTool::rename(llvm::ArrayRef<SymbolData> Symbols) {
+  ReplacesBuilt = false;
+  // The located file (and the header the cursor is in, if any) has already
+  // been parsed, so reuse its ASTs
+  std::vector<std::string> Remaining;
+  for (const auto &File : Files) {
+    const auto Path = getAbsolutePath(File);
+    if (!ASTs.empty() && (Path == LocatedFile || Path == CursorFile))
+      continue;
+    Remaining.push_back(File);
+  }
+  // Symbols no other translation unit can see are only renamed in the one they
+  // were located in, which is most renames of locals and static functions
+  const bool AllLocal =
+      std::none_of(Symbols.begin(), Symbols.end(),
+                   [](const SymbolData &Data) { return Data.LocalTo.empty(); });
+  if (AllLocal) {
+    llvm::StringSet<> Owners;
+    for (const auto &Data : Symbols)
+      Owners.insert(Data.LocalTo);
+    const auto Unscoped = Remaining.size();
+    Remaining.erase(std::remove_if(Remaining.begin(), Remaining.end(),
+                                   [&](const std::string &File) {
+                                     const auto Path = getAbsolutePath(File);
+                                     return Owners.count(
+                                                makeAbsolute("", Path)) == 0;
+                                   }),
+                    Remaining.end());
+    Stats.OutOfScopeFiles += Unscoped - Remaining.size();
+  }
+  // The headers claimed by an earlier rename say nothing about these symbols
+  if (Claims)
+    Claims = llvm::make_unique<HeaderClaims>();
+  {
+    RenamePass Pass(Symbols, &Occurrences, Stats, Claims.get(), Engine);
+    const auto Configs = getConfigurations(LocatedFile, ASTs.size());
+    for (size_t I = 0; I < ASTs.size(); ++I)
+      Pass.run(ASTs[I]->getASTContext(),
+               Configs.empty() ? nullptr : &Configs[I]);
+  }
+  // The ASTs are not needed anymore, and can be quite large
+  ASTs.clear();
+  OwnedASTs.clear();
+
+  // The index only knows the occurrences by USR
+  if (Index != nullptr &&
+      std::none_of(Symbols.begin(), Symbols.end(),
+                   [](const SymbolData &Data) { return Data.USR.empty(); }))
+    renameFromIndex(Remaining, Symbols);
+
+  std::vector<std::string> Spellings;
+  for (const auto &Data : Symbols)
+    Spellings.push_back(Data.Spelling);
+  const bool AllSpelled =
+      std::none_of(Spellings.begin(), Spellings.end(),
+                   [](const std::string &Spelling) {
+                     return Spelling.empty();
+                   });
+  if (Prefilter && AllSpelled) {
+    TextPrefilter Filter(Compilations, std::move(Spellings));
+    const auto Unfiltered = Remaining.size();
+    Remaining.erase(std::remove_if(Remaining.begin(), Remaining.end(),
+                                   [&](const std::string &File) {
+                                     return !Filter.mayReference(File);
+                                   }),
+                    Remaining.end());
+    Stats.PrefilteredFiles += Unfiltered - Remaining.size();
+  }
+
+  // A symbol declared in headers can only be referred to by the translation
+  // units that include one of them, which are found without parsing
+  const bool AllInHeaders =
+      std::none_of(Symbols.begin(), Symbols.end(),
+                   [](const SymbolData &Data) { return Data.Headers.empty(); });
+  if (Graph != nullptr && AllInHeaders && !Remaining.empty()) {
+    Graph->update(Compilations, Remaining, Jobs, DiagConsumer);
+    llvm::StringSet<> Includers;
+    for (const auto &Data : Symbols)
+      Graph->getIncluders(Data.Headers, Includers);
+    const auto Unreached = Remaining.size();
+    Remaining.erase(std::remove_if(Remaining.begin(), Remaining.end(),
+                                   [&](const std::string &File) {
+                                     const auto Path = getAbsolutePath(File);
+                                     return Graph->hasAllIncludes(Path) &&
+                                            Includers.count(Path) == 0;
+                                   }),
+                    Remaining.end());
+    Stats.UnreachedFiles += Unreached - Remaining.size();
+  }
+
+  if (Remaining.empty())
+    return 0;
+  if (Cache != nullptr) {
+    // Only the files that were used recently are worth keeping, and the
+    // others would evict them
+    const auto Uncached =
+        std::partition(Remaining.begin(), Remaining.end(),
+                       [&](const std::string &File) {
+                         return Cache->contains(File);
+                       });
+    std::vector<std::string> Cached(Remaining.begin(), Uncached);
+    Remaining.erase(Remaining.begin(), Uncached);
+    int Result = renameWithCache(Cached, Symbols);
+    if (!Remaining.empty()) {
+      const auto Parsed = renameInParallel(Remaining, Symbols);
+      Result = Result == 1 || Parsed == 1 ? 1 : std::max(Result, Parsed);
+    }
+    return Result;
+  }
+  // ClangTool can't be told to use the preambles, and doesn't say which compile
+  // command a translation unit was parsed with, so the files are parsed one
+  // compile command at a time instead
+  if (Jobs != 1 || Preambles != nullptr || Claims)
+    return renameInParallel(Remaining, Symbols);
+
+  RenamePass Pass(Symbols, &Occurrences, Stats, nullptr, Engine);
+  RenameConsumerFactory Factory(Pass);
+
+  ClangTool Tool(Compilations, Remaining);
+  Tool.setDiagnosticConsumer(DiagConsumer);
+  return Tool.run(newFrontendActionFactory(&Factory).get());
+}
+
+void RenameTool::renameFromIndex(std::vector<std::string> &Remaining,
+                                 llvm::ArrayRef<SymbolData> Symbols) {
+  // A translation unit is up to date if neither its main file nor anything it
+  // includes changed since it was indexed. The occurrences in those files are
+  // taken from the index, and only the other translation units are parsed.
+  llvm::StringSet<> Covered;
+  std::vector<std::string> Stale;
+  for (const auto &File : Remaining) {
+    unsigned MainFile;
+    llvm::SmallVector<unsigned, 1> Units;
+    if (!Index->lookupFile(getAbsolutePath(File), &MainFile) ||
+        !Index->findTranslationUnits(MainFile, Units) ||
+        !std::all_of(Units.begin(), Units.end(),
+                     [&](unsigned Unit) { return Index->isFresh(Unit); })) {
+      Stale.push_back(File);
+      continue;
+    }
+    for (const auto Unit : Units) {
+      llvm::SmallVector<unsigned, 64> UnitFiles;
+      Index->getTranslationUnitFiles(Unit, UnitFiles);
+      for (const auto F : UnitFiles)
+        Covered.insert(Index->getFileName(F));
+      ++Stats.IndexedTranslationUnits;
+    }
+  }
+  Remaining = std::move(Stale);
+
+  for (const auto &Data : Symbols) {
+    Index->forEachOccurrence(
+        Data.USR, [&](unsigned File, unsigned Offset, unsigned Length) {
+          const auto Name = Index->getFileName(File);
+          if (Covered.count(Name))
+            Occurrences.add(Name, Offset, Length, Data.NewSpelling);
+        });
+  }
+}
+
+int RenameTool::renameWithCache(const std::vector<std::string> &Files,
+                                llvm::ArrayRef<SymbolData> Symbols) {
+  RenamePass Pass(Symbols, &Occurrences, Stats, Claims.get(), Engine);
+
+  int Result = 0;
+  std::vector<clang::ASTUnit *> FileASTs;
+  for (const auto &File : Files) {
+    if (!Cache->get(File, FileASTs)) {
+      llvm::errs() << "Error while processing " << File << ".\n";
+      Result = 1;
+      continue;
+    }
+    const auto Configs = getConfigurations(File, FileASTs.size());
+    for (size_t I = 0; I < FileASTs.size(); ++I)
+      Pass.run(FileASTs[I]->getASTContext(),
+               Configs.empty() ? nullptr : &Configs[I]);
+  }
+  return Result;
+}
+
+int RenameTool::renameInParallel(const std::vector<std::string> &Files,
+                                 llvm::ArrayRef<SymbolData> Symbols) {
+  // Every compile command of every file is a task
+  bool FileSkipped = false;
+  const auto Tasks = getCompileCommands(Compilations, Files, &FileSkipped);
+  std::vector<Digest> Configs;
+  if (Claims) {
+    for (const auto &Task : Tasks)
+      Configs.push_back(hashConfiguration(Task.second, Task.first));
+  }
+
+  // The main files no other translation unit includes are written as soon
+  // as they are done, if the includes of every translation unit are known
+  llvm::StringSet<> Streamed;
+  if (SaveAsParsed && Graph != nullptr) {
+    Graph->update(Compilations, Files, Jobs, DiagConsumer);
+    const bool AllKnown =
+        std::all_of(Tasks.begin(), Tasks.end(),
+                    [&](const std::pair<std::string, CompileCommand> &Task) {
+                      return Graph->hasAllIncludes(Task.first);
+                    });
+    for (const auto &Task : Tasks) {
+      llvm::StringSet<> Includers;
+      if (AllKnown)
+        Graph->getIncluders(Task.first, Includers);
+      if (Includers.size() == 1 && Includers.count(Task.first))
+        Streamed.insert(Task.first);
+    }
+  }
+  MainFileWriter Writer(Tasks, Streamed, Occurrences);
+
+  // Each worker collects into its own shard, so they never contend on the
+  // occurrences. The shards are merged once all the workers are done, and
+  // since the occurrences are sorted in the end, the result doesn't depend on
+  // which worker ran what.
+  WorkStealingExecutor Executor(Jobs);
+  std::vector<OccurrenceStore> Shards(Executor.getNumWorkers());
+  std::vector<RenameStats> ShardStats(Executor.getNumWorkers());
+  std::atomic<bool> ProcessingFailed(false);
+  SynchronizedDiagConsumer Diagnostics(DiagConsumer);
+  Executor.run(Tasks.size(), [&](size_t Index, unsigned Worker) {
+    // A streamed task's occurrences are split between its main file and the
+    // shard once it's done
+    OccurrenceStore TaskOccurrences;
+    const bool IsStreamed = Writer.isStreamed(Index);
+    RenamePass Pass(Symbols,
+                    IsStreamed ? &TaskOccurrences : &Shards[Worker],
+                    ShardStats[Worker], Claims.get(), Engine);
+    RenameConsumerFactory Factory(Pass,
+                                  Configs.empty() ? nullptr : &Configs[Index]);
+
+    const auto &Task = Tasks[Index];
+    auto Action = newFrontendActionFactory(&Factory);
+    bool Succeeded;
+    if (Preambles != nullptr) {
+      // Only the located file's preamble is worth building
+      PreambleAction WithPreamble(*Preambles, Task.second, Action.get(),
+                                  /*Build=*/false);
+      Succeeded = runOnCompileCommand(Task.second, Task.first, &WithPreamble,
+                                      Diagnostics.get());
+    } else {
+      Succeeded = runOnCompileCommand(Task.second, Task.first, Action.get(),
+                                      Diagnostics.get());
+    }
+    if (!Succeeded)
+      ProcessingFailed = true;
+    if (IsStreamed)
+      Writer.finish(Index, TaskOccurrences, Shards[Worker]);
+  });
+  Writer.getFiles(SavedFiles);
+  SaveSkipped = SaveSkipped || Writer.skipped();
+  SaveFailed = SaveFailed || Writer.failed();
+
+  // The same header is usually seen by several translation units, so each
+  // shard is deduplicated before it's merged
+  for (unsigned Worker = 0; Worker < Shards.size(); ++Worker) {
+    Shards[Worker].sort();
+    Occurrences.merge(Shards[Worker]);
+    Stats.TranslationUnits += ShardStats[Worker].TranslationUnits;
+    Stats.SkippedTranslationUnits +=
+        ShardStats[Worker].SkippedTranslationUnits;
+    Stats.SkippedHeaders += ShardStats[Worker].SkippedHeaders;
+    Stats.ScopedTranslationUnits += ShardStats[Worker].ScopedTranslationUnits;
+    Stats.NarrowedTranslationUnits +=
+        ShardStats[Worker].NarrowedTranslationUnits;
+  }
+  return ProcessingFailed ? 1 : FileSkipped ? 2 : 0;
+}
+
+std::vector<Digest> RenameTool::getConfigurations(llvm::StringRef File,
+                                                  size_t NumASTs) const {
+  std::vector<Digest> Configs;
+  if (!Claims)
+    return Configs;
+  const auto Path = getAbsolutePath(File);
+  const auto Commands = Compilations.getCompileCommands(Path);
+  // The ASTs are in the same order as the commands they were parsed with
+  if (Commands.size() != NumASTs)
+    return Configs;
+  for (const auto &Command : Commands)
+    Configs.push_back(hashConfiguration(Command, Path));
+  return Configs;
+}
+
+int RenameTool::buildASTsWithPreambles(llvm::StringRef File) {
+  bool FileSkipped = false;
+  const auto Commands =
+      getCompileCommands(Compilations, {File.str()}, &FileSkipped);
+  for (const auto &Command : Commands) {
+    ASTBuilderAction Builder(OwnedASTs);
+    PreambleAction WithPreamble(*Preambles, Command.second, &Builder,
+                                /*Build=*/true);
+    if (!runOnCompileCommand(Command.second, Command.first, &WithPreamble,
+                             DiagConsumer))
+      return 1;
+  }
+  return FileSkipped ? 2 : 0;
+}
+
+const Replacements &RenameTool::getReplacements() {
+  if (!ReplacesBuilt) {
+    Occurrences.sort();
+    Replaces.clear();
+    Occurrences.addTo(Replaces);
+    ReplacesBuilt = true;
+  }
+  return Replaces;
+}
+
+int RenameTool::save() {
+  if (SaveSkipped)
+    llvm::errs() << "Skipped some replacements in the files written during "
+                    "the rename.\n";
+  if (SavedFiles.empty())
+    return saveOccurrences(Occurrences, Jobs) || SaveFailed ? 1 : 0;
+  // The main files written during the rename aren't written again
+  OccurrenceStore Rest;
+  for (const auto &O : Occurrences.getOccurrences()) {
+    const auto Name = Occurrences.getFileName(O.File);
+    if (!SavedFiles.count(Name))
+      Rest.add(Name, O.Offset, O.Length, Occurrences.getSpelling(O.Spelling));
+  }
+  return saveOccurrences(Rest, Jobs) || SaveFailed ? 1 : 0;
+}
+
+int RenameTool::diff(llvm::raw_ostream &OS) {
+  return diffOccurrences(Occurrences, OS);
+}
+
+namespace {
+OccurrenceStore getOccurrences(const Replacements &Replaces) {
+  OccurrenceStore Occurrences;
+  for (const auto &Replace : Replaces) {
+    if (Replace.isApplicable())
+      Occurrences.add(Replace.getFilePath(), Replace.getOffset(),
+                      Replace.getLength(), Replace.getReplacementText());
+  }
+  return Occurrences;
+}
+}
+
+int saveOccurrences(OccurrenceStore &Occurrences, unsigned Jobs) {
+  // The occurrences of a file are next to each other once they're sorted
+  Occurrences.sort();
+  const auto Files = getFileEdits(Occurrences);
+
+  // Every file is rewritten on its own, so they are written in parallel
+  std::atomic<bool> Skipped(false);
+  std::atomic<bool> Failed(false);
+  WorkStealingExecutor Executor(Jobs);
+  Executor.run(Files.size(), [&](size_t Index, unsigned) {
+    if (!saveFile(Occurrences, Files[Index], Skipped))
+      Failed = true;
+  });
+  if (Skipped)
+    llvm::errs() << "Skipped some replacements.\n";
+  return Failed ? 1 : 0;
+}
+
+int saveReplacements(const Replacements &Replaces, unsigned Jobs) {
+  auto Occurrences = getOccurrences(Replaces);
+  return saveOccurrences(Occurrences, Jobs);
+}
+
+int diffOccurrences(OccurrenceStore &Occurrences, llvm::raw_ostream &OS) {
+  Occurrences.sort();
+  auto Files = getFileEdits(Occurrences);
+  // The files are in the order they were first seen in, which depends on the
+  // order the translation units were parsed in
+  std::sort(Files.begin(), Files.end(),
+            [&](const FileEdits &LHS, const FileEdits &RHS) {
+              return Occurrences.getFileName(LHS.front().File) <
+                     Occurrences.getFileName(RHS.front().File);
+            });
+  bool Failed = false;
+  for (const auto &Edits : Files) {
+    const auto Name = Occurrences.getFileName(Edits.front().File);
+    auto Buffer = llvm::MemoryBuffer::getFile(Name);
+    if (!Buffer ||
+        !writeUnifiedDiff(Occurrences, Edits, Name, (*Buffer)->getBuffer(), OS))
+      Failed = true;
+  }
+  return Failed ? 1 : 0;
+}
+
+int diffReplacements(const Replacements &Replaces, llvm::raw_ostream &OS) {
+  auto Occurrences = getOccurrences(Replaces);
+  return diffOccurrences(Occurrences, OS);
+}
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include "Rename/Digest.h"
+#include "Rename/Handlers.h"
+#include "Rename/Occurrences.h"
+#include "Rename/Visitor.h"
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/Refactoring.h>
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace rn {
+
+class ASTCache;
+class HeaderClaims;
+class IncludeGraph;
+class OccurrenceIndex;
+class PreambleCache;
+
+// Counts of what the rename phase did
+struct RenameStats {
+  RenameStats()
+      : PrefilteredFiles(0), TranslationUnits(0), SkippedTranslationUnits(0),
+        IndexedTranslationUnits(0), SkippedHeaders(0), OutOfScopeFiles(0),
+        ScopedTranslationUnits(0), UnreachedFiles(0),
+        NarrowedTranslationUnits(0) {}
+
+  // The files that were not parsed, because the textual prefilter found that
+  // they can't refer to the symbol
+  unsigned PrefilteredFiles;
+  unsigned TranslationUnits;
+  // The translation units the matchers didn't run over, because they never
+  // mention the symbol's name
+  unsigned SkippedTranslationUnits;
+  // The translation units that were up to date in the index, and weren't
+  // parsed at all
+  unsigned IndexedTranslationUnits;
+  // The headers the matchers didn't run over in a translation unit, because
+  // another one with the same configuration already did
+  unsigned SkippedHeaders;
+  // The files that were not parsed, because the symbols are local to the
+  // translation units they were located in
+  unsigned OutOfScopeFiles;
+  // The translation units the matchers only ran over the functions or the
+  // class the symbols are local to
+  unsigned ScopedTranslationUnits;
+  // The files that were not parsed, because the include graph says they
+  // don't include any of the headers the symbols are declared in
+  unsigned UnreachedFiles;
+  // The translation units only the matchers of the kinds of nodes that can
+  // refer to the symbols ran over
+  unsigned NarrowedTranslationUnits;
+};
+
+// Runs the locate and rename phases over a set of files.
+// The translation unit the symbol is located in is parsed once, and its AST is
+// kept alive so the rename phase can run over it without parsing it again.
+class RenameTool {
+public:
+  RenameTool(const ::clang::tooling::CompilationDatabase &Compilations,
+             std::vector<std::string> Files);
+  ~RenameTool();
+
+  // With more than one job, the consumer is shared between the threads.
+  void setDiagnosticConsumer(::clang::DiagnosticConsumer *Consumer) {
+    DiagConsumer = Consumer;
+  }
+
+  // If set, files are scanned for the symbol's spelling before the rename
+  // phase, and those that can't refer to it are not parsed.
+  void setPrefilter(bool Enable) { Prefilter = Enable; }
+
+  // The number of translation units the rename phase processes in parallel.
+  // 0 means one per hardware thread.
+  void setJobs(unsigned NumJobs) { Jobs = NumJobs; }
+
+  // If set, the occurrences in the translation units that haven't changed
+  // since they were indexed are read from the index instead of parsing them.
+  void setIndex(const OccurrenceIndex *NewIndex) { Index = NewIndex; }
+
+  // If set, the located file is parsed through the cache, and its ASTs are
+  // kept for the next renames. The other files that are in the cache are
+  // renamed in their cached ASTs, one at a time, and the rest are parsed as
+  // if there was no cache.
+  void setASTCache(ASTCache *NewCache) { Cache = NewCache; }
+
+  // If set, the files are parsed with the precompiled preambles kept in the
+  // cache. Only the preambles of the files symbols are located in are built,
+  // the second time such a file is located, since those are the files that
+  // are parsed again and again. Ignored for the files parsed through the AST
+  // cache, which has preambles of its own.
+  void setPreambleCache(PreambleCache *NewPreambles) {
+    Preambles = NewPreambles;
+  }
+
+  // If set, each header is only matched in the first translation unit that
+  // includes it, of all those parsed with the same flags. This assumes that a
+  // header means the same wherever it is included, which doesn't hold for
+  // headers that depend on the macros their includers define, or for the
+  // templates they instantiate with the includers' types.
+  void setDeduplicateHeaders(bool Enable);
+
+  // If set, the symbols declared in headers are only looked for in the
+  // translation units that include one of those headers, after the graph is
+  // brought up to date for the files. This assumes that a file refers to
+  // such a symbol through its header, and doesn't declare it on its own.
+  void setIncludeGraph(IncludeGraph *NewGraph) { Graph = NewGraph; }
+
+  // If set, along with the include graph, the main files of the translation
+  // units parsed in parallel are written as soon as those are done, if no
+  // other translation unit includes them. save() only writes the rest, and
+  // the main files written early are left out of diff() and
+  // getReplacements(), so rename() has to be called once, before save().
+  void setSaveAsParsed(bool Enable) { SaveAsParsed = Enable; }
+
+  // How the rename phase finds the references in the translation units it
+  // parses. Both engines find the same ones.
+  void setEngine(RenameEngine NewEngine) { Engine = NewEngine; }
+
+  // Parses the translation unit Data.File is in and fills in Data.USR and
+  // Data.Spelling. The translation unit isn't parsed again if the previous
+  // symbol was located in one that has Data.File too.
+  // Returns 0 on success, like ClangTool::run().
+  int locate(SymbolData &Data);
+
+  // Collects an occurrence of every reference to Data.USR, or to the
+  // declarations named Data.QualifiedName, in the files. Data doesn't have to
+  // be located first if either is set. If Data.LocalTo is set, only that
+  // file is looked at.
+  // Returns 0 on success, like ClangTool::run().
+  int rename(const SymbolData &Data);
+
+  // Same as above for several symbols at once, in a single pass over the
+  // files. Each reference is replaced with the NewSpelling of its symbol.
+  int rename(::llvm::ArrayRef<SymbolData> Symbols);
+
+  // Applies the collected occurrences to the files on disk, with
+  // saveOccurrences().
+  // Returns 0 on success.
+  int save();
+
+  // Writes the changes save() would make as unified diffs, with
+  // diffOccurrences().
+  // Returns 0 on success.
+  int diff(::llvm::raw_ostream &OS);
+
+  // The collected occurrences, as Replacements, which are only built from
+  // them when they're asked for.
+  const ::clang::tooling::Replacements &getReplacements();
+
+  const RenameStats &getStats() const { return Stats; }
+
+private:
+  // Collects the occurrences in the translation units that are up to date in
+  // the index, and removes them from Remaining.
+  void renameFromIndex(std::vector<std::string> &Remaining,
+                       ::llvm::ArrayRef<SymbolData> Symbols);
+  int renameWithCache(const std::vector<std::string> &Files,
+                      ::llvm::ArrayRef<SymbolData> Symbols);
+  int renameInParallel(const std::vector<std::string> &Files,
+                       ::llvm::ArrayRef<SymbolData> Symbols);
+  int locateInASTs(SymbolData &Data);
+  // Parses File into the ASTs the symbols are located in.
+  int buildLocateASTs(const std::string &File);
+  // Returns true if the cursor's file is in the ASTs.
+  bool hasCursorFile() const;
+  int buildASTsWithPreambles(::llvm::StringRef File);
+  // The configuration of every compile command of File, if headers are
+  // deduplicated and File has NumASTs of them.
+  std::vector<Digest> getConfigurations(::llvm::StringRef File,
+                                        size_t NumASTs) const;
+
+  const ::clang::tooling::CompilationDatabase &Compilations;
+  std::vector<std::string> Files;
+  ::clang::DiagnosticConsumer *DiagConsumer;
+  bool Prefilter;
+  unsigned Jobs;
+  const OccurrenceIndex *Index;
+  ASTCache *Cache;
+  PreambleCache *Preambles;
+  IncludeGraph *Graph;
+  RenameEngine Engine;
+  // Shared by the translation units of a rename, and reset by each rename
+  std::unique_ptr<HeaderClaims> Claims;
+
+  // The file the cursor is in, the file that was parsed to locate the symbol
+  // (the same unless the cursor is in a header), and the ASTs it was parsed
+  // into (one per compile command). The ASTs are owned by the cache, if any.
+  std::string CursorFile;
+  std::string LocatedFile;
+  std::vector<::clang::ASTUnit *> ASTs;
+  std::vector<std::unique_ptr<::clang::ASTUnit>> OwnedASTs;
+
+  bool SaveAsParsed;
+
+  OccurrenceStore Occurrences;
+  // Built from the occurrences by getReplacements()
+  ::clang::tooling::Replacements Replaces;
+  bool ReplacesBuilt;
+  // The main files rename() wrote, and how that went
+  ::llvm::StringSet<> SavedFiles;
+  bool SaveSkipped;
+  bool SaveFailed;
+  RenameStats Stats;
+};
+
+// Applies the occurrences to the files on disk, Jobs files at a time (0 for
+// one per hardware thread). A file's new contents are built in one pass over
+// it, with applyEdits(), and replace it through a temporary file. A file is
+// left alone if its contents wouldn't change.
+// Returns 0 on success.
+int saveOccurrences(OccurrenceStore &Occurrences, unsigned Jobs = 1);
+
+// Applies Replaces to the files on disk, like saveOccurrences().
+// Returns 0 on success.
+int saveReplacements(const ::clang::tooling::Replacements &Replaces,
+                     unsigned Jobs = 1);
+
+// Writes the changes the occurrences make to the files on disk to OS, as a
+// unified diff for each file, in the order of their names.
+// Returns 0 on success.
+int diffOccurrences(OccurrenceStore &Occurrences, ::llvm::raw_ostream &OS);
+
+// Same as above, for Replaces.
+// Returns 0 on success.
+int diffReplacements(const ::clang::tooling::Replacements &Replaces,
+                     ::llvm::raw_ostream &OS);
+}
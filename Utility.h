@@ -1,15 +1,37 @@
 #pragma once
 
 #include <clang/AST/AST.h>
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/Basic/CharInfo.h>
+#include <clang/Basic/FileManager.h>
+#include <clang/Basic/SourceManager.h>
 #include <clang/Index/USRGeneration.h>
 
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallString.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 namespace rn {
 
-static inline std::string declID(std::string ID) { return ID + "Decl"; }
+// The ID every node matcher binds the declaration the node refers to to
+static constexpr const char *declID() { return "Decl"; }
+
+// Returns the length of Decl's name, which is only built if it isn't an
+// identifier (like the name of a constructor or an operator)
+static inline unsigned getNameLength(const clang::NamedDecl *Decl) {
+  if (const auto *Identifier = Decl->getIdentifier())
+    return Identifier->getLength();
+  return Decl->getNameAsString().size();
+}
 
 // Get the USR (a globally unique string) for a NamedDecl
 static inline std::string getUSRForDecl(const clang::NamedDecl *Decl) {
@@ -23,4 +45,285 @@ static inline std::string getUSRForDecl(const clang::NamedDecl *Decl) {
 
   return std::string(Buf.data(), Buf.size());
 }
+
+// Returns the declaration of the same parameter as Parm that the others are
+// renamed along with: the one in the definition of its function, or else in
+// its most recent declaration, that has the same name. Returns nullptr if
+// Parm has no name, or no such declaration has it.
+static inline const clang::ParmVarDecl *
+getBestParmVarDecl(const clang::ParmVarDecl *Parm) {
+  const auto Name = Parm->getName();
+  if (Name.empty())
+    return nullptr;
+  const auto *Function = llvm::dyn_cast_or_null<clang::FunctionDecl>(
+      Parm->getParentFunctionOrMethod());
+  if (Function == nullptr)
+    return Parm;
+
+  const clang::ParmVarDecl *BestDecl = nullptr;
+  // Can't use Function->redecls(), since the order differs depending on which
+  // node it's called on.
+  const auto *Redecl = Function->getMostRecentDecl();
+  while (Redecl != nullptr) {
+    if (Redecl->isFunctionTemplateSpecialization()) {
+      Redecl = Redecl->getPreviousDecl();
+      continue;
+    }
+    if (const clang::ParmVarDecl *OtherDecl =
+            Redecl->getParamDecl(Parm->getFunctionScopeIndex())) {
+      if (OtherDecl->getName() == Name) {
+        if (BestDecl == nullptr) {
+          BestDecl = OtherDecl;
+        } else if (Redecl->doesThisDeclarationHaveABody()) {
+          BestDecl = OtherDecl;
+          break;
+        }
+      }
+    }
+    Redecl = Redecl->getPreviousDecl();
+  }
+  return BestDecl;
+}
+
+// Returns Path, relative to Directory, which is relative to the current
+// directory, as an absolute native path without . or .. components.
+static inline std::string makeAbsolute(llvm::StringRef Directory,
+                                       llvm::StringRef Path) {
+  llvm::SmallString<256> Result;
+  if (llvm::sys::path::is_relative(Path))
+    Result = Directory;
+  llvm::sys::path::append(Result, Path);
+  llvm::sys::fs::make_absolute(Result);
+  llvm::sys::path::remove_dots(Result, /*remove_dot_dot=*/true);
+  llvm::sys::path::native(Result);
+  return Result.str();
+}
+
+// Returns the absolute path of Entry, without . or .. components. This is
+// how files are named in the index, the include graph, the header claims
+// and the occurrences.
+static inline std::string getAbsoluteName(const clang::FileManager &FileMgr,
+                                          const clang::FileEntry *Entry) {
+  llvm::SmallString<256> Path(Entry->getName());
+  FileMgr.makeAbsolutePath(Path);
+  llvm::sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+  return Path.str();
+}
+
+// Returns the absolute name of the main file of the translation unit Decl is
+// in, if no other translation unit can refer to it. That is the case for
+// locals, parameters, static functions and the contents of anonymous
+// namespaces, as long as none of their declarations is in a header. Returns an
+// empty string otherwise.
+static inline std::string
+getOwningMainFile(const clang::SourceManager &SourceMgr,
+                  const clang::NamedDecl *Decl) {
+  if (Decl->isExternallyVisible())
+    return std::string{};
+  const auto MainFile = SourceMgr.getMainFileID();
+  for (const auto *Redecl : Decl->redecls()) {
+    const auto Loc = SourceMgr.getExpansionLoc(Redecl->getLocation());
+    if (Loc.isInvalid() || SourceMgr.getFileID(Loc) != MainFile)
+      return std::string{};
+  }
+  const auto *Entry = SourceMgr.getFileEntryForID(MainFile);
+  return Entry == nullptr ? std::string{}
+                          : getAbsoluteName(SourceMgr.getFileManager(), Entry);
+}
+
+// Returns the absolute paths of the files other than the main file that Decl
+// is declared in, or nothing if it's only declared in the main file.
+static inline std::vector<std::string>
+getDeclaringHeaders(const clang::SourceManager &SourceMgr,
+                    const clang::NamedDecl *Decl) {
+  std::vector<std::string> Headers;
+  for (const auto *Redecl : Decl->redecls()) {
+    const auto Loc = SourceMgr.getExpansionLoc(Redecl->getLocation());
+    if (Loc.isInvalid() || SourceMgr.isInMainFile(Loc))
+      continue;
+    const auto *Entry = SourceMgr.getFileEntryForID(SourceMgr.getFileID(Loc));
+    if (Entry == nullptr)
+      continue;
+    auto Header = getAbsoluteName(SourceMgr.getFileManager(), Entry);
+    if (std::find(Headers.begin(), Headers.end(), Header) == Headers.end())
+      Headers.push_back(std::move(Header));
+  }
+  return Headers;
+}
+
+// Returns true if the preprocessor of the translation unit Context was parsed
+// from has seen the identifier Name. Identifiers are interned as they are
+// lexed, so a name that isn't in the table was never spelled anywhere.
+// Note: Name is interned if it wasn't already, so ask only once per Context.
+static inline bool mentionsIdentifier(clang::ASTContext &Context,
+                                      llvm::StringRef Name) {
+  auto &Idents = Context.Idents;
+  // Identifiers from an AST file (PCH or module) are only loaded on demand
+  if (Idents.getExternalIdentifierLookup() != nullptr)
+    return true;
+  const auto Size = Idents.size();
+  Idents.get(Name);
+  return Idents.size() == Size;
+}
+
+// Returns the last component of a qualified name, like Point for ns::Point
+static inline llvm::StringRef getUnqualifiedName(llvm::StringRef Name) {
+  const auto Separator = Name.rfind("::");
+  return Separator == llvm::StringRef::npos ? Name : Name.substr(Separator + 2);
+}
+
+// Returns true if Name is spelled like a plain identifier
+static inline bool isIdentifier(llvm::StringRef Name) {
+  if (Name.empty() || !clang::isIdentifierHead(Name.front()))
+    return false;
+  for (const auto C : Name.drop_front()) {
+    if (!clang::isIdentifierBody(C))
+      return false;
+  }
+  return true;
+}
+
+// Returns the name of the declaration USR refers to, like bar for c:@F@bar#,
+// Foo for c:@S@Foo or x for c:a.cpp@30@F@f#$@S@Bar#@x. A USR is a list of
+// components that start with an @. The name of a component's declaration is
+// followed by its template and function arguments, whose types may have an @
+// too, but only after a $. Returns an empty string if the name isn't a plain
+// identifier, or can't be told.
+static inline std::string getSpellingFromUSR(llvm::StringRef USR) {
+  llvm::StringRef Name;
+  size_t Start = 0;
+  // Whether the name of the current component hasn't ended yet
+  bool InName = true;
+  // The nesting of template arguments, and whether a type is being referred
+  // to by its declaration's USR
+  unsigned Depth = 0;
+  bool InType = false;
+  for (size_t I = 0; I < USR.size(); ++I) {
+    const char C = USR[I];
+    const char Next = I + 1 < USR.size() ? USR[I + 1] : '\0';
+    if (InName) {
+      if (C == '@') {
+        Start = I + 1;
+      } else if (C == '>' && clang::isDigit(Next)) {
+        // The template parameters, like >2#T#T. The name of a function
+        // template follows them, as the name of a pack follows its T.
+        unsigned Count = 0;
+        for (++I; I < USR.size() && clang::isDigit(USR[I]); ++I)
+          Count = Count * 10 + (USR[I] - '0');
+        for (; Count != 0; --Count, I += 2) {
+          if (!USR.substr(I).startswith("#T"))
+            return std::string();
+        }
+        if (I < USR.size() && USR[I] == 'p')
+          return std::string();
+        Start = I--;
+      } else if (C == '#' || C == '<' || C == '>') {
+        Name = USR.slice(Start, I);
+        InName = false;
+        Depth = C == '<';
+      }
+      continue;
+    }
+    switch (C) {
+    case '<':
+      ++Depth;
+      break;
+    case '>':
+      // The USR of a template specialization type isn't preceded by a $
+      if (Next == '@' || Depth == 0)
+        return std::string();
+      --Depth;
+      InType = false;
+      break;
+    case '$':
+      InType = true;
+      break;
+    case '#':
+      InType = false;
+      break;
+    case '@':
+      // The component of a declaration within this one, like a local
+      if (!InType && Depth == 0) {
+        InName = true;
+        Start = I + 1;
+      }
+      break;
+    }
+  }
+  if (InName)
+    Name = USR.substr(Start);
+  // The name of operator< ends at its <
+  if (!isIdentifier(Name) || Name == "operator")
+    return std::string();
+  return Name.str();
+}
+
+// Writes Contents to Path through a temporary file, so a reader never sees a
+// partial file. Returns true on success.
+static inline bool writeAtomically(llvm::StringRef Path,
+                                   llvm::StringRef Contents) {
+  llvm::SmallString<256> TempPath;
+  int FD;
+  if (llvm::sys::fs::createUniqueFile(Path + ".tmp-%%%%%%", FD, TempPath))
+    return false;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Contents;
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      llvm::sys::fs::remove(TempPath);
+      return false;
+    }
+  }
+  return !llvm::sys::fs::rename(TempPath, Path);
+}
+
+// Hands every node within the declarations it traverses to the MatchFinder,
+// like MatchFinder::matchAST() does for the whole translation unit, but
+// doesn't descend into the declarations Skip returns true for.
+class MatchingVisitor : public clang::RecursiveASTVisitor<MatchingVisitor> {
+public:
+  MatchingVisitor(clang::ASTContext &Context,
+                  clang::ast_matchers::MatchFinder &Finder,
+                  llvm::function_ref<bool(const clang::Decl *)> Skip)
+      : Context(Context), Finder(Finder), Skip(Skip) {}
+
+  // Same as the MatchFinder's own traversal
+  bool shouldVisitTemplateInstantiations() const { return true; }
+  bool shouldVisitImplicitCode() const { return true; }
+
+  bool TraverseDecl(clang::Decl *D) {
+    if (D == nullptr || Skip(D))
+      return true;
+    Finder.match(*D, Context);
+    return RecursiveASTVisitor::TraverseDecl(D);
+  }
+
+  bool TraverseStmt(clang::Stmt *S) {
+    if (S == nullptr)
+      return true;
+    Finder.match(*S, Context);
+    return RecursiveASTVisitor::TraverseStmt(S);
+  }
+
+  bool TraverseTypeLoc(clang::TypeLoc TL) {
+    if (TL.isNull())
+      return true;
+    Finder.match(TL, Context);
+    return RecursiveASTVisitor::TraverseTypeLoc(TL);
+  }
+
+  bool TraverseNestedNameSpecifierLoc(clang::NestedNameSpecifierLoc NNS) {
+    if (!NNS)
+      return true;
+    Finder.match(NNS, Context);
+    return RecursiveASTVisitor::TraverseNestedNameSpecifierLoc(NNS);
+  }
+
+private:
+  clang::ASTContext &Context;
+  clang::ast_matchers::MatchFinder &Finder;
+  llvm::function_ref<bool(const clang::Decl *)> Skip;
+};
 }
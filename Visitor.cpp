@@ -0,0 +1,186 @@
+#include "Rename/Visitor.h"
+#include "Rename/Handlers.h"
+#include "Rename/Headers.h"
+#include "Rename/Occurrences.h"
+#include "Rename/Targets.h"
+#include "Rename/Utility.h"
+
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/DeclTemplate.h>
+#include <clang/AST/Expr.h>
+#include <clang/AST/RecursiveASTVisitor.h>
+
+#include <llvm/ADT/SmallPtrSet.h>
+
+using clang::ASTContext;
+using clang::CXXConstructorDecl;
+using clang::Decl;
+using clang::DeclRefExpr;
+using clang::MemberExpr;
+using clang::NamedDecl;
+using clang::NamespaceAliasDecl;
+using clang::NestedNameSpecifier;
+using clang::NestedNameSpecifierLoc;
+using clang::ParmVarDecl;
+using clang::RecursiveASTVisitor;
+using clang::SourceLocation;
+using clang::TagType;
+using clang::TemplateSpecializationType;
+using clang::TemplateTypeParmType;
+using clang::TypeLoc;
+using clang::TypedefType;
+using clang::UsingDecl;
+using clang::UsingDirectiveDecl;
+
+using llvm::ArrayRef;
+
+namespace rn {
+
+namespace {
+// Returns the declaration a type refers to, like the hasDeclaration() matcher
+// of TypeWithDeclarationNode does, or nullptr
+const NamedDecl *getTypeDecl(const clang::Type *Type) {
+  if (Type == nullptr)
+    return nullptr;
+  if (const auto *Tag = llvm::dyn_cast<TagType>(Type))
+    return Tag->getDecl();
+  if (const auto *Typedef = llvm::dyn_cast<TypedefType>(Type))
+    return Typedef->getDecl();
+  if (const auto *Parm = llvm::dyn_cast<TemplateTypeParmType>(Type))
+    return Parm->getDecl();
+  if (const auto *Specialization =
+          llvm::dyn_cast<TemplateSpecializationType>(Type))
+    return Specialization->getTemplateName().getAsTemplateDecl();
+  return nullptr;
+}
+
+// Returns the class or namespace a specifier names, like the matcher of
+// NestedNameSpecifierNode does, or nullptr
+const NamedDecl *getSpecifiedDecl(const NestedNameSpecifier *Specifier) {
+  if (const auto *Type = Specifier->getAsType()) {
+    const auto *Tag = llvm::dyn_cast<TagType>(Type);
+    return Tag == nullptr ? nullptr : Tag->getDecl();
+  }
+  return Specifier->getAsNamespace();
+}
+
+// Visits every node once, in the same traversal as the MatchFinder, and
+// replaces the ones whose declaration is one of the targets. Each kind of
+// node is handled by its own Visit method, which gets the declaration it
+// refers to with the accessor its matcher in Nodes.h uses.
+class ReferenceVisitor : public RecursiveASTVisitor<ReferenceVisitor> {
+public:
+  ReferenceVisitor(ASTContext &Context, const TargetDecls &Targets,
+                   OccurrenceStore &Occurrences,
+                   SkippedFiles *Skipped = nullptr)
+      : SourceMgr(Context.getSourceManager()), Targets(Targets),
+        Occurrences(Occurrences), Skipped(Skipped) {}
+
+  // Same as the MatchFinder's own traversal
+  bool shouldVisitTemplateInstantiations() const { return true; }
+  bool shouldVisitImplicitCode() const { return true; }
+
+  bool TraverseDecl(Decl *D) {
+    if (D == nullptr ||
+        (Skipped != nullptr && Skipped->contains(D->getLocation())))
+      return true;
+    return RecursiveASTVisitor<ReferenceVisitor>::TraverseDecl(D);
+  }
+
+  bool TraverseNestedNameSpecifierLoc(NestedNameSpecifierLoc NNS) {
+    if (!NNS)
+      return true;
+    add(NNS.getLocalBeginLoc(),
+        getSpecifiedDecl(NNS.getNestedNameSpecifier()));
+    return RecursiveASTVisitor<
+        ReferenceVisitor>::TraverseNestedNameSpecifierLoc(NNS);
+  }
+
+  bool VisitNamedDecl(NamedDecl *D) {
+    add(D->getLocation(), D);
+    return true;
+  }
+
+  bool VisitParmVarDecl(ParmVarDecl *D) {
+    add(D->getLocation(), getBestParmVarDecl(D));
+    return true;
+  }
+
+  bool VisitCXXConstructorDecl(CXXConstructorDecl *D) {
+    add(D->getLocation(), D->getParent());
+    return true;
+  }
+
+  bool VisitUsingDirectiveDecl(UsingDirectiveDecl *D) {
+    add(D->getIdentLocation(), D->getNominatedNamespaceAsWritten());
+    return true;
+  }
+
+  bool VisitUsingDecl(UsingDecl *D) {
+    if (D->shadow_size() == 1)
+      add(D->getNameInfo().getLoc(), (*D->shadow_begin())->getTargetDecl());
+    return true;
+  }
+
+  bool VisitNamespaceAliasDecl(NamespaceAliasDecl *D) {
+    add(D->getTargetNameLoc(), D->getAliasedNamespace());
+    return true;
+  }
+
+  bool VisitDeclRefExpr(DeclRefExpr *E) {
+    add(E->getLocation(), E->getDecl());
+    return true;
+  }
+
+  bool VisitMemberExpr(MemberExpr *E) {
+    add(E->getMemberLoc(), E->getMemberDecl());
+    return true;
+  }
+
+  bool VisitTypeLoc(TypeLoc TL) {
+    add(TL.getBeginLoc(), getTypeDecl(TL.getTypePtr()));
+    return true;
+  }
+
+private:
+  // Adds the name of Decl at Loc, if Decl is one of the targets
+  void add(SourceLocation Loc, const NamedDecl *Decl) {
+    const auto *Data = Targets.lookup(Decl);
+    if (Data == nullptr)
+      return;
+    Occurrences.add(SourceMgr, Loc, getNameLength(Decl), Data->NewSpelling);
+  }
+
+  const clang::SourceManager &SourceMgr;
+  const TargetDecls &Targets;
+  OccurrenceStore &Occurrences;
+  SkippedFiles *Skipped;
+};
+}
+
+void renameReferences(ASTContext &Context, const TargetDecls &Targets,
+                      OccurrenceStore &Occurrences) {
+  ReferenceVisitor Visitor(Context, Targets, Occurrences);
+  Visitor.TraverseDecl(Context.getTranslationUnitDecl());
+}
+
+void renameReferencesWithinScopes(ASTContext &Context,
+                                  const TargetDecls &Targets,
+                                  OccurrenceStore &Occurrences,
+                                  ArrayRef<const Decl *> Scopes) {
+  ReferenceVisitor Visitor(Context, Targets, Occurrences);
+  // The same function can be the scope of several targets
+  llvm::SmallPtrSet<const Decl *, 8> Traversed;
+  for (const auto *Scope : Scopes) {
+    if (Traversed.insert(Scope).second)
+      Visitor.TraverseDecl(const_cast<Decl *>(Scope));
+  }
+}
+
+void renameReferencesOutside(ASTContext &Context, const TargetDecls &Targets,
+                             OccurrenceStore &Occurrences,
+                             SkippedFiles &Skipped) {
+  ReferenceVisitor Visitor(Context, Targets, Occurrences, &Skipped);
+  Visitor.TraverseDecl(Context.getTranslationUnitDecl());
+}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/DeclBase.h>
+
+#include <llvm/ADT/ArrayRef.h>
+
+namespace rn {
+
+class OccurrenceStore;
+class SkippedFiles;
+class TargetDecls;
+
+// How the rename phase finds the references to the targets
+enum class RenameEngine {
+  // An AST matcher for each kind of node in Nodes.h, run by a MatchFinder
+  Matchers,
+  // A single traversal, that gets the declaration each node refers to
+  // directly
+  Visitor
+};
+
+// Collects an occurrence for every node in Context that refers to one of
+// Targets, the same ones the rename matchers would.
+void renameReferences(::clang::ASTContext &Context, const TargetDecls &Targets,
+                      OccurrenceStore &Occurrences);
+
+// Same as above, but only for the nodes within Scopes.
+void renameReferencesWithinScopes(
+    ::clang::ASTContext &Context, const TargetDecls &Targets,
+    OccurrenceStore &Occurrences,
+    ::llvm::ArrayRef<const ::clang::Decl *> Scopes);
+
+// Same as above, but not for the declarations in the skipped headers.
+void renameReferencesOutside(::clang::ASTContext &Context,
+                             const TargetDecls &Targets,
+                             OccurrenceStore &Occurrences,
+                             SkippedFiles &Skipped);
+}
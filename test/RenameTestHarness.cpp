@@ -1,8 +1,7 @@
 #include "RenameTestHarness.h"
 
 #include <Rename/Handlers.h>
-//#include <Rename/Matchers.h>
-#include <Rename/Nodes.h>
+#include <Rename/Tool.h>
 
 #include <clang/ASTMatchers/ASTMatchFinder.h>
 #include <clang/Basic/Diagnostic.h>
@@ -11,6 +10,13 @@
 #include <clang/Basic/FileSystemOptions.h>
 #include <clang/Tooling/CompilationDatabase.h>
 #include <clang/Tooling/Refactoring.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
 
 #include <fstream>
 #include <string>
@@ -19,15 +25,14 @@
 using namespace clang;
 
 using clang::tooling::FixedCompilationDatabase;
-using clang::tooling::RefactoringTool;
 using clang::tooling::Replacements;
-using clang::tooling::newFrontendActionFactory;
-
-using clang::ast_matchers::MatchFinder;
 
 std::string addPrefix(std::string File) {
-  const std::string Directory = "test/files/";
-  return Directory + File;
+  // Absolute, like the renames name the files they change
+  llvm::SmallString<128> Path("test/files");
+  llvm::sys::fs::make_absolute(Path);
+  llvm::sys::path::append(Path, File);
+  return Path.str();
 }
 
 std::ostream &operator<<(std::ostream &out, const RunResults &Results) {
@@ -42,7 +47,7 @@ std::ostream &operator<<(std::ostream &out, const RunResults &Results) {
   return out;
 }
 RunResults runRenaming(std::string File, unsigned Line, unsigned Column,
-                       std::string NewSpelling) {
+                       std::string NewSpelling, rn::RenameEngine Engine) {
   RunResults Results;
   using namespace rn;
 
@@ -55,19 +60,15 @@ RunResults runRenaming(std::string File, unsigned Line, unsigned Column,
 
   std::vector<std::string> Files;
   Files.push_back(File);
-  RefactoringTool Tool(CompilationDB, Files);
+  RenameTool Tool(CompilationDB, Files);
   IgnoringDiagConsumer DiagConsumer;
   Tool.setDiagnosticConsumer(&DiagConsumer);
+  Tool.setEngine(Engine);
 
   // Find the source location
-  {
-    MatchFinder Finder;
-    RN_ADD_ALL_MATCHERS(RN_ADD_SOURCE_LOCATION_MATCHER)
-
-    if (Tool.run(newFrontendActionFactory(&Finder).get())) {
-      Results.SourceLocationProcessingFailed = true;
-      return Results;
-    }
+  if (Tool.locate(Data)) {
+    Results.SourceLocationProcessingFailed = true;
+    return Results;
   }
   if (Data.USR.empty()) {
     Results.UnableToDetermineUSR = true;
@@ -75,14 +76,9 @@ RunResults runRenaming(std::string File, unsigned Line, unsigned Column,
   }
 
   // Find all references and rename them
-  {
-    auto Replace = &Tool.getReplacements();
-    MatchFinder Finder;
-    RN_ADD_ALL_MATCHERS(RN_ADD_RENAME_MATCHER)
-    if (Tool.run(newFrontendActionFactory(&Finder).get())) {
-      Results.RenameProcessingFailed = true;
-      return Results;
-    }
+  if (Tool.rename(Data)) {
+    Results.RenameProcessingFailed = true;
+    return Results;
   }
   Results.Replaces = Tool.getReplacements();
   return Results;
@@ -110,8 +106,82 @@ void getLineColumn(std::string File, unsigned Offset, unsigned *Line,
 }
 
 RunResults runRenaming(std::string File, unsigned Offset,
-                       std::string NewSpelling) {
+                       std::string NewSpelling, rn::RenameEngine Engine) {
   unsigned Line, Column;
   getLineColumn(File, Offset, &Line, &Column);
-  return runRenaming(File, Line, Column, NewSpelling);
+  return runRenaming(File, Line, Column, NewSpelling, Engine);
+}
+
+RunResults runRenamingByName(std::string File, std::string QualifiedName,
+                             std::string NewSpelling) {
+  RunResults Results;
+  using namespace rn;
+
+  SymbolData Data(File, 0, 0, NewSpelling);
+  Data.QualifiedName = QualifiedName;
+  Data.Spelling = getUnqualifiedName(QualifiedName).str();
+
+  std::vector<std::string> Args;
+  Args.push_back("-std=c++11");
+  auto CompilationDB = FixedCompilationDatabase{".", Args};
+
+  std::vector<std::string> Files;
+  Files.push_back(File);
+  RenameTool Tool(CompilationDB, Files);
+  IgnoringDiagConsumer DiagConsumer;
+  Tool.setDiagnosticConsumer(&DiagConsumer);
+
+  if (Tool.rename(Data)) {
+    Results.RenameProcessingFailed = true;
+    return Results;
+  }
+  Results.Replaces = Tool.getReplacements();
+  return Results;
+}
+
+ParsedCode::ParsedCode(llvm::StringRef Code, std::vector<std::string> Args)
+    : AST(tooling::buildASTFromCodeWithArgs(Code, Args, "input.cc")) {}
+
+const NamedDecl *
+ParsedCode::find(const ast_matchers::DeclarationMatcher &Matcher) {
+  using namespace clang::ast_matchers;
+  if (AST == nullptr)
+    return nullptr;
+  return selectFirst<NamedDecl>(
+      "decl", match(Matcher.bind("decl"), AST->getASTContext()));
+}
+
+const NamedDecl *ParsedCode::find(llvm::StringRef Name) {
+  return find(ast_matchers::namedDecl(ast_matchers::hasName(Name)));
+}
+
+TemporaryDirectory::TemporaryDirectory() {
+  llvm::SmallString<128> Directory;
+  if (!llvm::sys::fs::createUniqueDirectory("rn-tests", Directory))
+    Path = Directory.str();
+}
+
+TemporaryDirectory::~TemporaryDirectory() {
+  if (created())
+    llvm::sys::fs::remove_directories(Path);
+}
+
+std::string TemporaryDirectory::getPath(llvm::StringRef Name) const {
+  llvm::SmallString<128> Result(Path);
+  llvm::sys::path::append(Result, Name);
+  return Result.str();
+}
+
+std::string TemporaryDirectory::write(llvm::StringRef Name,
+                                      llvm::StringRef Contents) const {
+  const auto Result = getPath(Name);
+  std::error_code EC;
+  llvm::raw_fd_ostream OS(Result, EC, llvm::sys::fs::F_None);
+  OS << Contents;
+  return Result;
+}
+
+std::string readFile(llvm::StringRef Path) {
+  auto Buffer = llvm::MemoryBuffer::getFile(Path);
+  return Buffer ? (*Buffer)->getBuffer().str() : std::string();
 }
@@ -1,10 +1,20 @@
 #pragma once
 
+#include <Rename/Visitor.h>
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <clang/ASTMatchers/ASTMatchers.h>
+#include <clang/Frontend/ASTUnit.h>
 #include <clang/Tooling/Refactoring.h>
 
+#include <llvm/ADT/StringRef.h>
+
 #include <iostream>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 struct RunResults {
   RunResults()
@@ -43,10 +53,58 @@ struct RunResults {
 
 std::ostream &operator<<(std::ostream &out, const RunResults &Results);
 
+// Returns the absolute path of the fixture File
 std::string addPrefix(std::string File);
 
 RunResults runRenaming(std::string File, unsigned Line, unsigned Column,
-                       std::string NewSpelling);
+                       std::string NewSpelling,
+                       rn::RenameEngine Engine = rn::RenameEngine::Matchers);
 
 RunResults runRenaming(std::string File, unsigned Offset,
-                       std::string NewSpelling);
+                       std::string NewSpelling,
+                       rn::RenameEngine Engine = rn::RenameEngine::Matchers);
+
+// Renames the declarations named QualifiedName, without locating them first
+RunResults runRenamingByName(std::string File, std::string QualifiedName,
+                             std::string NewSpelling);
+
+// Code parsed as input.cc, to look declarations up in
+class ParsedCode {
+public:
+  explicit ParsedCode(::llvm::StringRef Code,
+                      std::vector<std::string> Args = {});
+
+  bool parsed() const { return AST != nullptr; }
+  ::clang::ASTContext &getContext() { return AST->getASTContext(); }
+
+  // Returns the first declaration Matcher matches, or null
+  const ::clang::NamedDecl *
+  find(const ::clang::ast_matchers::DeclarationMatcher &Matcher);
+  // Returns the first declaration named Name, or null
+  const ::clang::NamedDecl *find(::llvm::StringRef Name);
+
+private:
+  std::unique_ptr<::clang::ASTUnit> AST;
+};
+
+// A directory the fixtures of a test are written to, which is removed along
+// with them once the test is done
+class TemporaryDirectory {
+public:
+  TemporaryDirectory();
+  ~TemporaryDirectory();
+
+  bool created() const { return !Path.empty(); }
+  const std::string &getPath() const { return Path; }
+
+  // Returns the path of Name in the directory
+  std::string getPath(::llvm::StringRef Name) const;
+  // Writes Contents to Name in the directory, and returns its path
+  std::string write(::llvm::StringRef Name, ::llvm::StringRef Contents) const;
+
+private:
+  std::string Path;
+};
+
+// Returns the contents of Path, or an empty string if it can't be read
+std::string readFile(::llvm::StringRef Path);
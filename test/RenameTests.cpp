@@ -1,10 +1,41 @@
 #include "RenameTestHarness.h"
 
+#include <Rename/Batch.h>
+#include <Rename/Compilations.h>
+#include <Rename/Dependencies.h>
+#include <Rename/Edits.h>
+#include <Rename/Headers.h>
+#include <Rename/Index.h>
+#include <Rename/Kinds.h>
+#include <Rename/Locate.h>
+#include <Rename/Occurrences.h>
+#include <Rename/Parallel.h>
+#include <Rename/Preamble.h>
+#include <Rename/Prefilter.h>
+#include <Rename/Rules.h>
+#include <Rename/Scopes.h>
+#include <Rename/Server.h>
+#include <Rename/Tool.h>
+#include <Rename/Utility.h>
+
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/ASTMatchers/ASTMatchers.h>
+#include <clang/Tooling/Tooling.h>
+
 #include <clang/Tooling/Refactoring.h>
 
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <set>
 #include <string>
+#include <tuple>
 #include <vector>
 
 using namespace std;
@@ -22,6 +53,8 @@ void checkReplacements(string File, unsigned SpellingLength, string NewSpelling,
 
   for (const auto Loc : Locs) {
     EXPECT_EQ(ExpectedResults, runRenaming(File, Loc, NewSpelling));
+    EXPECT_EQ(ExpectedResults, runRenaming(File, Loc, NewSpelling,
+                                           rn::RenameEngine::Visitor));
   }
 }
 
@@ -59,6 +92,38 @@ TEST(EnumConstantDecl, EnumClass) {
   checkReplacements("EnumDecl.cpp", 1, "W", {55, 171});
 }
 
+TEST(QualifiedName, Works) {
+  const auto File = addPrefix("RecordDecl.cpp");
+  EXPECT_EQ(runRenaming(File, 21, "PT"),
+            runRenamingByName(File, "x::TP", "PT"));
+  EXPECT_EQ(runRenaming(File, 191, "PT"), runRenamingByName(File, "TP", "PT"));
+  EXPECT_EQ(runRenaming(File, 21, "PT"),
+            runRenamingByName(File, "::x::TP", "PT"));
+}
+
+TEST(USR, Spelling) {
+  EXPECT_EQ("bar", rn::getSpellingFromUSR("c:@F@bar#"));
+  EXPECT_EQ("Foo", rn::getSpellingFromUSR("c:@S@Foo"));
+  EXPECT_EQ("x", rn::getSpellingFromUSR("c:a.cpp@30@F@f#I#@x"));
+  EXPECT_EQ("Foo", rn::getSpellingFromUSR("c:@SP>1#T@Foo>#*t0.0"));
+  EXPECT_EQ("", rn::getSpellingFromUSR("c:@S@A@F@operator+#"));
+  EXPECT_EQ("", rn::getSpellingFromUSR("c:@S@A@F@operator<#&1$@S@A#1"));
+  // Record typed parameters and template arguments
+  EXPECT_EQ("foo", rn::getSpellingFromUSR("c:@F@foo#$@S@Bar#"));
+  EXPECT_EQ("foo", rn::getSpellingFromUSR("c:@N@ns@F@foo#*$@N@ns@E@E#I#"));
+  EXPECT_EQ("g", rn::getSpellingFromUSR("c:@S@A@F@g#&1$@S@A#1"));
+  EXPECT_EQ("foo", rn::getSpellingFromUSR("c:@F@foo<#$@S@Bar>#$@S@Bar#"));
+  EXPECT_EQ("Foo", rn::getSpellingFromUSR("c:@S@Foo>#$@S@Bar"));
+  EXPECT_EQ("foo", rn::getSpellingFromUSR("c:@FT@>1#Tfoo#t0.0#"));
+  EXPECT_EQ("Foo", rn::getSpellingFromUSR("c:@ST>2#T#T@Foo"));
+  // Declarations within functions with such parameters
+  EXPECT_EQ("x", rn::getSpellingFromUSR("c:a.cpp@30@F@f#$@S@Bar#@x"));
+  EXPECT_EQ("g", rn::getSpellingFromUSR("c:a.cpp@30@F@f#$@S@Bar#@S@L@F@g#"));
+  // Template specialization types and packs aren't told apart from names
+  EXPECT_EQ("", rn::getSpellingFromUSR("c:@F@foo#>@ST>1#T@Vec#1I#"));
+  EXPECT_EQ("", rn::getSpellingFromUSR("c:@FT@>1#Tpfoo#Pt0.0#"));
+}
+
 TEST(NamespaceDecl, Works) {
   checkReplacements("NamespaceDecl.cpp", 1, "a",
                     {10, 88, 106, 118, 141, 158, 279, 288, 304, 376});
@@ -155,3 +220,844 @@ TEST(ParmVarDecl, Works) {
   // rename (other) foo::y (double)
   checkReplacements("ParmVarDecls.cpp", 1, "bar", {169});
 }
+
+TEST(FieldDecl, MemberSpecializations) {
+  // A private member, used in specializations of member templates written
+  // outside of the class
+  checkReplacements("MemberSpecializations.cpp", 3, "y", {16, 124, 192});
+}
+
+TEST(Linkage, OwningMainFile) {
+  ParsedCode Code("static int f();\n"
+                  "int g(int p) { int l = p; return l; }\n"
+                  "namespace { int h; }\n"
+                  "namespace n { int i; }\n");
+  ASSERT_TRUE(Code.parsed());
+  const auto OwningMainFile = [&](const char *Name) {
+    const auto *Decl = Code.find(Name);
+    if (Decl == nullptr)
+      return std::string("<not found>");
+    return rn::getOwningMainFile(Code.getContext().getSourceManager(), Decl);
+  };
+  // The main file is named by its absolute path
+  llvm::SmallString<128> MainFile("input.cc");
+  ASSERT_FALSE(llvm::sys::fs::make_absolute(MainFile));
+  EXPECT_EQ(MainFile.str(), OwningMainFile("f"));
+  EXPECT_EQ("", OwningMainFile("g"));
+  EXPECT_EQ(MainFile.str(), OwningMainFile("p"));
+  EXPECT_EQ(MainFile.str(), OwningMainFile("l"));
+  EXPECT_EQ(MainFile.str(), OwningMainFile("h"));
+  EXPECT_EQ("", OwningMainFile("i"));
+}
+
+TEST(Scopes, EnclosingScopes) {
+  ParsedCode Code("int f(int p);\n"
+                  "int f(int p) { int l = p; return l; }\n"
+                  "class A { int m; void g(); public: int n; };\n"
+                  "void A::g() { m = 0; }\n"
+                  "class B { int o; friend void h(); };\n");
+  ASSERT_TRUE(Code.parsed());
+  const auto NumScopes = [&](const char *Name) {
+    const auto *Decl = Code.find(Name);
+    llvm::SmallVector<const clang::Decl *, 4> Scopes;
+    if (Decl == nullptr || !rn::addEnclosingScopes(Decl, Scopes))
+      return -1;
+    return static_cast<int>(Scopes.size());
+  };
+  EXPECT_EQ(2, NumScopes("p"));
+  EXPECT_EQ(1, NumScopes("l"));
+  // The class, and the definition of A::g()
+  EXPECT_EQ(2, NumScopes("m"));
+  EXPECT_EQ(-1, NumScopes("n"));
+  EXPECT_EQ(-1, NumScopes("o"));
+  EXPECT_EQ(-1, NumScopes("f"));
+}
+
+TEST(Nodes, NameLength) {
+  using namespace clang::ast_matchers;
+  ParsedCode Code("struct Point { Point(); bool operator<(Point); };");
+  ASSERT_TRUE(Code.parsed());
+  const auto NameLength = [&](const DeclarationMatcher &Matcher) {
+    const auto *Decl = Code.find(Matcher);
+    return Decl == nullptr ? 0u : rn::getNameLength(Decl);
+  };
+  EXPECT_EQ(5u, NameLength(cxxRecordDecl(hasName("Point"))));
+  EXPECT_EQ(5u, NameLength(cxxConstructorDecl()));
+  EXPECT_EQ(9u, NameLength(cxxMethodDecl(hasName("operator<"))));
+}
+
+TEST(Kinds, ReferringKinds) {
+  using namespace clang::ast_matchers;
+  ParsedCode Code("namespace n { struct S { int f; }; }\n"
+                  "typedef n::S T;\n"
+                  "template <typename P> void g(P p);\n"
+                  "enum E { e };\n");
+  ASSERT_TRUE(Code.parsed());
+  const auto Kinds = [&](const char *Name) {
+    const auto *Decl = Code.find(Name);
+    return Decl == nullptr ? 0 : rn::getReferringKinds(Decl);
+  };
+  EXPECT_EQ(rn::NK_NamedDecl | rn::NK_UsingDirectiveDecl |
+                rn::NK_AliasedNamespace | rn::NK_NestedNameSpecifier,
+            Kinds("n"));
+  EXPECT_TRUE(Kinds("S") & rn::NK_TagType);
+  EXPECT_FALSE(Kinds("S") & (rn::NK_MemberExpr | rn::NK_ParmVarDecl));
+  EXPECT_TRUE(Kinds("f") & rn::NK_MemberExpr);
+  EXPECT_FALSE(Kinds("f") & rn::NK_TypeWithDeclaration);
+  EXPECT_EQ(rn::NK_NamedDecl | rn::NK_UsingDecl | rn::NK_TypedefType,
+            Kinds("T"));
+  EXPECT_EQ(rn::NK_NamedDecl | rn::NK_TemplateTypeParmType, Kinds("P"));
+  EXPECT_EQ(rn::NK_NamedDecl | rn::NK_ParmVarDecl | rn::NK_DeclRefExpr,
+            Kinds("p"));
+  const auto *Template = Code.find(functionTemplateDecl(hasName("g")));
+  ASSERT_TRUE(Template != nullptr);
+  EXPECT_TRUE(rn::getReferringKinds(Template) &
+              rn::NK_TemplateSpecializationType);
+  EXPECT_TRUE(Kinds("e") & rn::NK_DeclRefExpr);
+  EXPECT_FALSE(Kinds("e") & rn::NK_NestedNameSpecifier);
+}
+
+TEST(Occurrences, SortAndMerge) {
+  rn::OccurrenceStore First, Second;
+  First.add("b.h", 10, 5, "Other");
+  First.add("a.cc", 20, 5, "Other");
+  Second.add("b.h", 10, 5, "Other");
+  Second.add("a.cc", 4, 1, "y");
+  First.merge(Second);
+  First.sort();
+  EXPECT_EQ(3u, First.size());
+
+  Replacements Replaces;
+  First.addTo(Replaces);
+  Replacements Expected;
+  Expected.emplace("a.cc", 4, 1, "y");
+  Expected.emplace("a.cc", 20, 5, "Other");
+  Expected.emplace("b.h", 10, 5, "Other");
+  EXPECT_EQ(Expected, Replaces);
+}
+
+TEST(Occurrences, Save) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  const auto Renamed = Directory.write("a.cpp", "int x = 1;\nint y = x;\n");
+  const auto Unchanged = Directory.write("b.cpp", "int x = 2;\n");
+  llvm::sys::fs::UniqueID UnchangedID;
+  ASSERT_FALSE(llvm::sys::fs::getUniqueID(Unchanged, UnchangedID));
+
+  rn::OccurrenceStore Occurrences;
+  Occurrences.add(Renamed, 19, 1, "z");
+  Occurrences.add(Renamed, 4, 1, "z");
+  Occurrences.add(Unchanged, 4, 1, "x");
+  EXPECT_EQ(0, rn::saveOccurrences(Occurrences, 2));
+  EXPECT_EQ("int z = 1;\nint y = z;\n", readFile(Renamed));
+  // The file that wouldn't change hasn't been replaced
+  EXPECT_EQ("int x = 2;\n", readFile(Unchanged));
+  llvm::sys::fs::UniqueID ID;
+  ASSERT_FALSE(llvm::sys::fs::getUniqueID(Unchanged, ID));
+  EXPECT_EQ(UnchangedID, ID);
+}
+
+TEST(Occurrences, SaveAsParsed) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  const auto Header = Directory.write("a.h", "int f();\n");
+  const auto First =
+      Directory.write("a.cpp", "#include \"a.h\"\nint g() { return f(); }\n");
+  const auto Second =
+      Directory.write("b.cpp", "#include \"a.h\"\nint h() { return f(); }\n");
+  FixedCompilationDatabase Compilations(Directory.getPath(), {"-std=c++11"});
+  rn::IncludeGraph Graph(Directory.getPath("graph"));
+  rn::RenameTool Tool(Compilations, {First, Second});
+  clang::IgnoringDiagConsumer DiagConsumer;
+  Tool.setDiagnosticConsumer(&DiagConsumer);
+  Tool.setJobs(2);
+  Tool.setIncludeGraph(&Graph);
+  Tool.setSaveAsParsed(true);
+
+  rn::SymbolData Data(First, 0, 0, "e");
+  Data.USR = "c:@F@f#";
+  Data.Spelling = "f";
+  EXPECT_EQ(0, Tool.rename(Data));
+  // The main files are written by then, but not the header they share
+  EXPECT_EQ("#include \"a.h\"\nint g() { return e(); }\n", readFile(First));
+  EXPECT_EQ("#include \"a.h\"\nint h() { return e(); }\n", readFile(Second));
+  EXPECT_EQ("int f();\n", readFile(Header));
+  EXPECT_EQ(0, Tool.save());
+  EXPECT_EQ("int e();\n", readFile(Header));
+  EXPECT_EQ("#include \"a.h\"\nint g() { return e(); }\n", readFile(First));
+}
+
+TEST(Edits, ApplyAndDiff) {
+  const string Code = "int x = 1;\n"
+                      "int a;\n"
+                      "int b;\n"
+                      "int c;\n"
+                      "int d;\n"
+                      "int y = x + x;";
+  rn::OccurrenceStore Occurrences;
+  Occurrences.add("a.cpp", 4, 1, "z");
+  Occurrences.add("a.cpp", 47, 1, "z");
+  Occurrences.add("a.cpp", 51, 1, "z");
+  Occurrences.sort();
+  const auto Files = rn::getFileEdits(Occurrences);
+  ASSERT_EQ(1u, Files.size());
+
+  string Result;
+  ASSERT_TRUE(rn::applyEdits(Occurrences, Files.front(), Code, Result));
+  EXPECT_EQ("int z = 1;\nint a;\nint b;\nint c;\nint d;\nint y = z + z;",
+            Result);
+
+  string Diff;
+  llvm::raw_string_ostream OS(Diff);
+  ASSERT_TRUE(
+      rn::writeUnifiedDiff(Occurrences, Files.front(), "a.cpp", Code, OS, 1));
+  EXPECT_EQ("--- a.cpp\n"
+            "+++ a.cpp\n"
+            "@@ -1,2 +1,2 @@\n"
+            "-int x = 1;\n"
+            "+int z = 1;\n"
+            " int a;\n"
+            "@@ -5,2 +5,2 @@\n"
+            " int d;\n"
+            "-int y = x + x;\n"
+            "\\ No newline at end of file\n"
+            "+int y = z + z;\n"
+            "\\ No newline at end of file\n",
+            OS.str());
+
+  // Overlapping edits can't be applied
+  Occurrences.add("a.cpp", 4, 3, "w");
+  Occurrences.sort();
+  EXPECT_FALSE(rn::applyEdits(Occurrences,
+                              rn::getFileEdits(Occurrences).front(), Code,
+                              Result));
+}
+
+TEST(Parallel, WorkStealingExecutor) {
+  EXPECT_LE(1u, rn::WorkStealingExecutor(0).getNumWorkers());
+  rn::WorkStealingExecutor Executor(4);
+  ASSERT_EQ(4u, Executor.getNumWorkers());
+  const size_t NumTasks = 1000;
+  vector<std::atomic<unsigned>> Runs(NumTasks);
+  for (auto &R : Runs)
+    R = 0;
+  std::atomic<bool> BadWorker(false);
+  Executor.run(NumTasks, [&](size_t Index, unsigned Worker) {
+    if (Worker >= Executor.getNumWorkers())
+      BadWorker = true;
+    ++Runs[Index];
+  });
+  EXPECT_FALSE(BadWorker);
+  for (size_t I = 0; I < NumTasks; ++I)
+    EXPECT_EQ(1u, Runs[I]) << "task " << I;
+  // The executor can be run again
+  std::atomic<unsigned> Total(0);
+  Executor.run(10, [&](size_t, unsigned) { ++Total; });
+  EXPECT_EQ(10u, Total);
+}
+
+TEST(Index, RoundTrip) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  const auto Header = Directory.write("a.h", "extern int x;\n");
+  const auto Source = Directory.write(
+      "a.cpp", "#include \"a.h\"\nint x = 1;\nint y = x;\n");
+  const auto IndexPath = Directory.getPath("index");
+
+  FixedCompilationDatabase Compilations(Directory.getPath(), vector<string>());
+  clang::IgnoringDiagConsumer DiagConsumer;
+  ASSERT_EQ(0, rn::buildIndex(Compilations, {Source}, IndexPath, 1,
+                              /*Update=*/false, &DiagConsumer));
+  auto Index = rn::OccurrenceIndex::load(IndexPath);
+  ASSERT_TRUE(Index != nullptr);
+
+  set<tuple<string, unsigned, unsigned>> Occurrences;
+  Index->forEachOccurrence(
+      "c:@x", [&](unsigned File, unsigned Offset, unsigned Length) {
+        Occurrences.emplace(
+            llvm::sys::path::filename(Index->getFileName(File)), Offset,
+            Length);
+      });
+  const set<tuple<string, unsigned, unsigned>> Expected = {
+      make_tuple("a.h", 11, 1), make_tuple("a.cpp", 19, 1),
+      make_tuple("a.cpp", 34, 1)};
+  EXPECT_EQ(Expected, Occurrences);
+  Index->forEachOccurrence("c:@z", [&](unsigned, unsigned, unsigned) {
+    ADD_FAILURE() << "z isn't declared";
+  });
+  EXPECT_EQ("", Index->getFileName(100));
+
+  unsigned MainFile, HeaderFile;
+  ASSERT_TRUE(Index->lookupFile(Source, &MainFile));
+  ASSERT_TRUE(Index->lookupFile(Header, &HeaderFile));
+  EXPECT_FALSE(Index->lookupFile(Directory.getPath("b.cpp"), &MainFile));
+  llvm::SmallVector<unsigned, 1> Units;
+  ASSERT_TRUE(Index->findTranslationUnits(MainFile, Units));
+  ASSERT_EQ(1u, Units.size());
+  EXPECT_TRUE(Index->isFresh(Units[0]));
+
+  // Truncated, mislabeled or inconsistent indexes aren't loaded, and names
+  // out of bounds aren't read
+  const auto Contents = readFile(IndexPath);
+  Directory.write("truncated", llvm::StringRef(Contents).drop_back());
+  EXPECT_TRUE(rn::OccurrenceIndex::load(Directory.getPath("truncated")) ==
+              nullptr);
+  auto Corrupt = Contents;
+  Corrupt[0] ^= 1;
+  Directory.write("magic", Corrupt);
+  EXPECT_TRUE(rn::OccurrenceIndex::load(Directory.getPath("magic")) ==
+              nullptr);
+  Corrupt = Contents;
+  // The number of occurrences
+  ++Corrupt[16];
+  Directory.write("count", Corrupt);
+  EXPECT_TRUE(rn::OccurrenceIndex::load(Directory.getPath("count")) ==
+              nullptr);
+  Corrupt = Contents;
+  // The name offset of the first file
+  Corrupt[35] = '\xff';
+  Directory.write("name", Corrupt);
+  const auto Misnamed = rn::OccurrenceIndex::load(Directory.getPath("name"));
+  ASSERT_TRUE(Misnamed != nullptr);
+  EXPECT_EQ("", Misnamed->getFileName(0));
+
+  // Changing the header makes the translation unit stale
+  Directory.write("a.h", "extern int x, z;\n");
+  Index = rn::OccurrenceIndex::load(IndexPath);
+  ASSERT_TRUE(Index != nullptr);
+  EXPECT_TRUE(Index->isStale(HeaderFile));
+  EXPECT_FALSE(Index->isStale(MainFile));
+  EXPECT_FALSE(Index->isFresh(Units[0]));
+}
+
+TEST(Index, Update) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  Directory.write("config.h", "#define USE_F\n");
+  Directory.write("g.h", "#ifdef USE_F\nvoid f();\n#endif\nvoid g();\n");
+  const auto A =
+      Directory.write("a.cpp", "#include \"config.h\"\n#include \"g.h\"\n");
+  const auto B = Directory.write("b.cpp", "#include \"g.h\"\n");
+  const auto IndexPath = Directory.getPath("index");
+
+  FixedCompilationDatabase Compilations(Directory.getPath(), vector<string>());
+  clang::IgnoringDiagConsumer DiagConsumer;
+  ASSERT_EQ(0, rn::buildIndex(Compilations, {A, B}, IndexPath, 1,
+                              /*Update=*/false, &DiagConsumer));
+  auto count = [&](llvm::StringRef USR) {
+    auto Index = rn::OccurrenceIndex::load(IndexPath);
+    unsigned Count = 0;
+    if (Index)
+      Index->forEachOccurrence(
+          USR, [&](unsigned, unsigned, unsigned) { ++Count; });
+    return Count;
+  };
+  EXPECT_EQ(1u, count("c:@F@f#"));
+  EXPECT_EQ(1u, count("c:@F@g#"));
+
+  // g.h doesn't change, but a.cpp no longer sees f in it
+  Directory.write("config.h", "");
+  ASSERT_EQ(0, rn::buildIndex(Compilations, {A}, IndexPath, 1,
+                              /*Update=*/true, &DiagConsumer));
+  EXPECT_EQ(0u, count("c:@F@f#"));
+  EXPECT_EQ(1u, count("c:@F@g#"));
+  auto Index = rn::OccurrenceIndex::load(IndexPath);
+  ASSERT_TRUE(Index != nullptr);
+  EXPECT_EQ(2u, Index->getNumTranslationUnits());
+}
+
+TEST(Index, SameSecondEdit) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  const auto Source = Directory.write("a.cpp", "int x = 1;\n");
+  const auto IndexPath = Directory.getPath("index");
+  FixedCompilationDatabase Compilations(Directory.getPath(), vector<string>());
+  clang::IgnoringDiagConsumer DiagConsumer;
+  ASSERT_EQ(0, rn::buildIndex(Compilations, {Source}, IndexPath, 1,
+                              /*Update=*/false, &DiagConsumer));
+
+  // Renamed to a name as long, most likely within the second it was indexed
+  // in, so neither its size nor its modification time in seconds tell
+  Directory.write("a.cpp", "int y = 1;\n");
+  const auto Index = rn::OccurrenceIndex::load(IndexPath);
+  ASSERT_TRUE(Index != nullptr);
+  unsigned MainFile;
+  ASSERT_TRUE(Index->lookupFile(Source, &MainFile));
+  EXPECT_TRUE(Index->isStale(MainFile));
+}
+
+TEST(Index, KeepOnFailure) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  const auto A = Directory.write("a.cpp", "int x = 1;\n");
+  const auto B = Directory.write("b.cpp", "int y = x;\n");
+  const auto IndexPath = Directory.getPath("index");
+  FixedCompilationDatabase Compilations(Directory.getPath(), vector<string>());
+  clang::IgnoringDiagConsumer DiagConsumer;
+  ASSERT_EQ(0, rn::buildIndex(Compilations, {A}, IndexPath, 1,
+                              /*Update=*/false, &DiagConsumer));
+  const auto Contents = readFile(IndexPath);
+
+  // b.cpp doesn't parse, so the index isn't replaced by a partial one
+  EXPECT_EQ(1, rn::buildIndex(Compilations, {A, B}, IndexPath, 1,
+                              /*Update=*/true, &DiagConsumer));
+  EXPECT_EQ(Contents, readFile(IndexPath));
+  EXPECT_EQ(1, rn::buildIndex(Compilations, {A, B}, IndexPath, 1,
+                              /*Update=*/false, &DiagConsumer));
+  EXPECT_EQ(Contents, readFile(IndexPath));
+}
+
+TEST(Index, MixedWithParsed) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  ASSERT_FALSE(llvm::sys::fs::create_directory(Directory.getPath("include")));
+  ASSERT_FALSE(llvm::sys::fs::create_directory(Directory.getPath("a")));
+  ASSERT_FALSE(llvm::sys::fs::create_directory(Directory.getPath("b")));
+  const auto Header = Directory.write("include/f.h", "int f();\n");
+  const auto A = Directory.write(
+      "a/a.cpp", "#include \"../include/f.h\"\nint g() { return f(); }\n");
+  const auto B = Directory.write(
+      "b/b.cpp", "#include \"../include/f.h\"\nint h() { return f(); }\n");
+  const auto IndexPath = Directory.getPath("index");
+
+  FixedCompilationDatabase Compilations(Directory.getPath(), {"-std=c++11"});
+  clang::IgnoringDiagConsumer DiagConsumer;
+  ASSERT_EQ(0, rn::buildIndex(Compilations, {A, B}, IndexPath, 1,
+                              /*Update=*/false, &DiagConsumer));
+  // b.cpp is parsed again, and a.cpp's occurrences come from the index
+  Directory.write(
+      "b/b.cpp", "#include \"../include/f.h\"\nint hh() { return f(); }\n");
+  const auto Index = rn::OccurrenceIndex::load(IndexPath);
+  ASSERT_TRUE(Index != nullptr);
+  rn::RenameTool Tool(Compilations, {A, B});
+  Tool.setDiagnosticConsumer(&DiagConsumer);
+  Tool.setIndex(Index.get());
+
+  rn::SymbolData Data(A, 0, 0, "e");
+  Data.USR = "c:@F@f#";
+  Data.Spelling = "f";
+  EXPECT_EQ(0, Tool.rename(Data));
+  EXPECT_EQ(1u, Tool.getStats().IndexedTranslationUnits);
+  // Both name the header the same way, so it's only changed once
+  EXPECT_EQ(3u, Tool.getReplacements().size());
+  EXPECT_EQ(0, Tool.save());
+  EXPECT_EQ("int e();\n", readFile(Header));
+  EXPECT_EQ("#include \"../include/f.h\"\nint hh() { return e(); }\n",
+            readFile(B));
+}
+
+TEST(Locate, Includers) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  ASSERT_FALSE(llvm::sys::fs::create_directory(Directory.getPath("a")));
+  ASSERT_FALSE(llvm::sys::fs::create_directory(Directory.getPath("b")));
+  Directory.write("a/config.h", "int alpha();\n");
+  const auto Config = Directory.write("b/config.h", "int beta();\n");
+  const auto Indirect = Directory.write("b/c.h", "int gamma();\n");
+  Directory.write("b/w.h", "#include \"c.h\"\n");
+  const auto Guarded = Directory.write("b/q.h", "int delta();\n");
+  const string Padding(256, ' ');
+  const vector<pair<string, string>> Sources = {
+      {"a/x.cpp", "#include \"config.h\"\n"},
+      {"b/y.cpp", "#include \"config.h\"\n" + Padding + "\n"},
+      {"b/z.cpp", "#include \"w.h\"\n"},
+      // Cheaper than real.cpp, but doesn't actually include q.h
+      {"b/cheap.cpp", "#if 0\n#include \"q.h\"\n#endif\n"},
+      {"b/real.cpp", "#include \"q.h\"\n" + Padding + "\n"}};
+  string JSON = "[";
+  for (const auto &Source : Sources) {
+    const auto Path = Directory.write(Source.first, Source.second);
+    JSON += string(JSON.size() > 1 ? "," : "") + "{\"directory\": \"" +
+            Directory.getPath() + "\", \"file\": \"" + Path +
+            "\", \"command\": \"clang++ -std=c++11 -c " + Path + "\"}";
+  }
+  std::string ErrorMessage;
+  auto Compilations = rn::LazyCompilationDatabase::loadFromFile(
+      Directory.write("compile_commands.json", JSON + "]\n"), ErrorMessage);
+  ASSERT_TRUE(Compilations != nullptr) << ErrorMessage;
+
+  // a/x.cpp includes a "config.h" too, but not this one
+  const vector<string> Includers = {Directory.getPath("b/y.cpp")};
+  EXPECT_EQ(Includers, rn::selectLocateFiles(*Compilations, Config));
+  const vector<string> Includes = {Directory.getPath("b/z.cpp")};
+  EXPECT_EQ(Includes,
+            rn::findIndirectIncluders(*Compilations, Indirect, Includers));
+
+  clang::IgnoringDiagConsumer DiagConsumer;
+  auto locate = [&](const string &File) {
+    rn::RenameTool Tool(*Compilations, {File});
+    Tool.setDiagnosticConsumer(&DiagConsumer);
+    rn::SymbolData Data(File, 1, 5, "e");
+    EXPECT_EQ(0, Tool.locate(Data));
+    return Data.USR;
+  };
+  EXPECT_EQ("c:@F@beta#", locate(Config));
+  EXPECT_EQ("c:@F@gamma#", locate(Indirect));
+  EXPECT_EQ("c:@F@delta#", locate(Guarded));
+}
+
+// Locates f in File, with its preamble from Preambles
+string locateWithPreamble(const CompilationDatabase &Compilations,
+                          rn::PreambleCache &Preambles, const string &File) {
+  clang::IgnoringDiagConsumer DiagConsumer;
+  rn::RenameTool Tool(Compilations, {File});
+  Tool.setDiagnosticConsumer(&DiagConsumer);
+  Tool.setPreambleCache(&Preambles);
+  rn::SymbolData Data(File, 2, 18, "h");
+  EXPECT_EQ(0, Tool.locate(Data));
+  return Data.USR;
+}
+
+TEST(Preambles, BuildReuseInvalidate) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  Directory.write("a.h", "int f();\n");
+  const auto Source =
+      Directory.write("a.cpp", "#include \"a.h\"\nint g() { return f(); }\n");
+  FixedCompilationDatabase Compilations(Directory.getPath(), {"-std=c++11"});
+  rn::PreambleCache Preambles(Directory.getPath("preambles"), 1 << 30);
+
+  // Only built once the file is located again
+  EXPECT_EQ("c:@F@f#", locateWithPreamble(Compilations, Preambles, Source));
+  EXPECT_EQ(0u, Preambles.getNumBuilt());
+  EXPECT_EQ("c:@F@f#", locateWithPreamble(Compilations, Preambles, Source));
+  EXPECT_EQ(1u, Preambles.getNumBuilt());
+  EXPECT_EQ("c:@F@f#", locateWithPreamble(Compilations, Preambles, Source));
+  EXPECT_EQ(1u, Preambles.getNumBuilt());
+  EXPECT_EQ(1u, Preambles.getNumReused());
+
+  // A header it includes changed
+  Directory.write("a.h", "int f(int = 0);\n");
+  EXPECT_EQ("c:@F@f#I#", locateWithPreamble(Compilations, Preambles, Source));
+  EXPECT_EQ(2u, Preambles.getNumBuilt());
+  EXPECT_EQ(1u, Preambles.getNumReused());
+}
+
+TEST(Preambles, Evict) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  Directory.write("a.h", "int f();\n");
+  const auto First =
+      Directory.write("a.cpp", "#include \"a.h\"\nint g() { return f(); }\n");
+  const auto Second =
+      Directory.write("b.cpp", "#include \"a.h\"\nint h() { return f(); }\n");
+  FixedCompilationDatabase Compilations(Directory.getPath(), {"-std=c++11"});
+  // Too small for more than one preamble
+  rn::PreambleCache Preambles(Directory.getPath("preambles"), 1);
+
+  for (const auto &File : {First, First, First, Second, Second, First})
+    EXPECT_EQ("c:@F@f#", locateWithPreamble(Compilations, Preambles, File));
+  // The first file's preamble was removed to make room for the second's, and
+  // was forgotten
+  EXPECT_EQ(2u, Preambles.getNumBuilt());
+  EXPECT_EQ(1u, Preambles.getNumReused());
+}
+
+TEST(IncludeGraph, Includers) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  const auto Header = Directory.write("a.h", "int f();\n");
+  const auto Includer = Directory.write("b.h", "#include \"a.h\"\n");
+  const auto User = Directory.write(
+      "c.cpp", "#include \"b.h\"\nint g() { return f(); }\n");
+  const auto Other = Directory.write("d.cpp", "int h();\n");
+  const auto GraphPath = Directory.getPath("graph");
+
+  FixedCompilationDatabase Compilations(Directory.getPath(), vector<string>());
+  clang::IgnoringDiagConsumer DiagConsumer;
+  {
+    rn::IncludeGraph Graph(GraphPath);
+    EXPECT_EQ(0, Graph.update(Compilations, {User, Other}, 1, &DiagConsumer));
+  }
+  // Read back from the file
+  rn::IncludeGraph Graph(GraphPath);
+  EXPECT_TRUE(Graph.hasAllIncludes(User));
+  EXPECT_TRUE(Graph.hasAllIncludes(Other));
+  llvm::StringSet<> MainFiles;
+  Graph.getIncluders({Header}, MainFiles);
+  EXPECT_EQ(1u, MainFiles.size());
+  EXPECT_EQ(1u, MainFiles.count(User));
+  MainFiles.clear();
+  Graph.getIncluders({Includer, Other}, MainFiles);
+  EXPECT_EQ(2u, MainFiles.size());
+}
+
+TEST(IncludeGraph, Modules) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  const auto File = Directory.write("a.cpp", "int f();\n");
+  FixedCompilationDatabase Compilations(
+      Directory.getPath(),
+      {"-fmodules", "-fmodules-cache-path=" + Directory.getPath("modules")});
+  clang::IgnoringDiagConsumer DiagConsumer;
+  rn::IncludeGraph Graph(Directory.getPath("graph"));
+  EXPECT_EQ(0, Graph.update(Compilations, {File}, 1, &DiagConsumer));
+  // The headers of the modules it imports aren't known
+  EXPECT_FALSE(Graph.hasAllIncludes(File));
+}
+
+TEST(Compilations, NormalizeArguments) {
+  CompileCommand Command;
+  Command.Directory = "/src";
+  Command.CommandLine = {"clang++",
+                         "-O2",
+                         "-g",
+                         "-Wall",
+                         "-Wp,-DX",
+                         "-DY",
+                         "-MF",
+                         "a.d",
+                         "-c",
+                         "-o",
+                         "a.o",
+                         "-ObjC",
+                         "-MTa.o",
+                         "-o/tmp/b.o",
+                         "-objcmt-migrate-literals",
+                         "-objcmt-whitelist-dir-path=/src",
+                         "a.cpp"};
+  // Only -o and its value are dropped, not the other options starting with
+  // -o
+  const vector<string> Expected = {"clang++",
+                                   "-O2",
+                                   "-Wp,-DX",
+                                   "-DY",
+                                   "-ObjC",
+                                   "-objcmt-migrate-literals",
+                                   "-objcmt-whitelist-dir-path=/src",
+                                   "a.cpp"};
+  EXPECT_EQ(Expected, rn::normalizeArguments(Command));
+}
+
+TEST(Compilations, LazyDatabase) {
+  llvm::SmallString<128> Path;
+  int FD;
+  ASSERT_FALSE(
+      llvm::sys::fs::createTemporaryFile("rn-tests", "json", FD, Path));
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << "[\n"
+          "{\"directory\": \"/src\", \"file\": \"a.cpp\",\n"
+          " \"command\": \"clang++ -O0 '-DNAME=\\\"a b\\\"' -c a.cpp\"},\n"
+          "{\"directory\": \"/src\", \"file\": \"a.cpp\",\n"
+          " \"arguments\": [\"clang++\", \"-O0\", \"-g\", "
+          "\"-DNAME=\\\"a b\\\"\", \"-c\", \"a.cpp\"]},\n"
+          "{\"directory\": \"/src\", \"file\": \"a.cpp\",\n"
+          " \"arguments\": [\"clang++\", \"-O2\", \"-D\\ud83d\\ude00\", "
+          "\"-D\\ud800\", \"-c\", \"a.cpp\"]},\n"
+          "{\"directory\": \"/src\", \"file\": \"/src/b.cpp\", \"output\": 1,\n"
+          " \"command\": \"clang++ -c b.cpp\"}\n"
+          "]\n";
+  }
+  std::string ErrorMessage;
+  auto Database = rn::LazyCompilationDatabase::loadFromFile(Path, ErrorMessage);
+  llvm::sys::fs::remove(Path);
+  ASSERT_TRUE(Database != nullptr) << ErrorMessage;
+
+  const vector<string> Files = {"/src/a.cpp", "/src/b.cpp"};
+  EXPECT_EQ(Files, Database->getAllFiles());
+  auto Commands = Database->getCompileCommands("/src/a.cpp");
+  ASSERT_EQ(3u, Commands.size());
+  const vector<string> Expected = {"clang++", "-O0", "-DNAME=\"a b\"", "-c",
+                                   "a.cpp"};
+  EXPECT_EQ(Expected, Commands[0].CommandLine);
+  EXPECT_EQ("/src", Commands[0].Directory);
+  // A pair of surrogates, and a lone one
+  ASSERT_EQ(5u, Commands[2].CommandLine.size());
+  EXPECT_EQ("-D\xF0\x9F\x98\x80", Commands[2].CommandLine[2]);
+  EXPECT_EQ("-D\xEF\xBF\xBD", Commands[2].CommandLine[3]);
+
+  // The first two commands only differ in their debug info
+  Database->setDeduplicate(true);
+  EXPECT_EQ(2u, Database->getCompileCommands("/src/a.cpp").size());
+  EXPECT_EQ(1u, Database->getCompileCommands("/src/b.cpp").size());
+  EXPECT_TRUE(Database->getCompileCommands("/src/c.cpp").empty());
+}
+
+TEST(Compilations, LazyDatabaseSymlink) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  const auto File = Directory.write("a.cpp", "int f();\n");
+  const auto Link = Directory.getPath("link");
+  ASSERT_FALSE(llvm::sys::fs::create_link(Directory.getPath(), Link));
+  const auto JSON = Directory.write(
+      "compile_commands.json", "[{\"directory\": \"" + Link +
+                                   "\", \"file\": \"a.cpp\", "
+                                   "\"command\": \"clang++ -c a.cpp\"}]\n");
+  std::string ErrorMessage;
+  auto Database = rn::LazyCompilationDatabase::loadFromFile(JSON, ErrorMessage);
+  ASSERT_TRUE(Database != nullptr) << ErrorMessage;
+
+  // Named through the real directory instead of the symlink
+  EXPECT_EQ(1u, Database->getCompileCommands(File).size());
+  // Not followed when the directory is removed
+  llvm::sys::fs::remove(Link);
+}
+
+TEST(Prefilter, ContainsSubstring) {
+  const string Text = "struct Point { int x; };\n"
+                      "Point makePoint(int x, int y) { return Point{x}; }\n";
+  EXPECT_TRUE(rn::containsSubstring(Text, "Point"));
+  EXPECT_TRUE(rn::containsSubstring(Text, "makePoint"));
+  EXPECT_TRUE(rn::containsSubstring(Text, "}; }\n"));
+  EXPECT_TRUE(rn::containsSubstring(Text, "s"));
+  EXPECT_FALSE(rn::containsSubstring(Text, "PointList"));
+  EXPECT_FALSE(rn::containsSubstring(Text, "z"));
+  EXPECT_FALSE(rn::containsSubstring("Poin", "Point"));
+  // Matches that straddle the vectorized blocks
+  for (size_t Offset = 0; Offset < 40; ++Offset) {
+    const string Haystack = string(Offset, '.') + "needle" + string(3, '.');
+    EXPECT_TRUE(rn::containsSubstring(Haystack, "needle"));
+    EXPECT_FALSE(rn::containsSubstring(Haystack, "needles"));
+  }
+}
+
+TEST(Prefilter, MayReference) {
+  TemporaryDirectory Directory;
+  ASSERT_TRUE(Directory.created());
+  Directory.write("a.h", "int other();\n");
+  Directory.write("b.h", "int target();\n");
+  const auto Unrelated =
+      Directory.write("a.cpp", "#include \"a.h\"\nint f();\n");
+  const auto Mentions =
+      Directory.write("b.cpp", "#include \"b.h\"\nint f();\n");
+  const auto Generated =
+      Directory.write("c.cpp", "#include \"generated.h\"\nint f();\n");
+
+  FixedCompilationDatabase Compilations(Directory.getPath(), {"-std=c++11"});
+  rn::TextPrefilter Prefilter(Compilations, {"target"});
+  EXPECT_FALSE(Prefilter.mayReference(Unrelated));
+  EXPECT_TRUE(Prefilter.mayReference(Mentions));
+  // A header that can't be found could mention anything
+  EXPECT_TRUE(Prefilter.mayReference(Generated));
+
+  FixedCompilationDatabase Forced(Directory.getPath(), {"-include", "b.h"});
+  rn::TextPrefilter ForcedPrefilter(Forced, {"target"});
+  EXPECT_TRUE(ForcedPrefilter.mayReference(Unrelated));
+}
+
+TEST(Headers, Configuration) {
+  auto command = [](string Define, string File) {
+    CompileCommand Command;
+    Command.Directory = "/src";
+    Command.CommandLine = {"clang++", Define, "-c", File, "-o", File + ".o"};
+    return Command;
+  };
+  const auto A = rn::hashConfiguration(command("-DX", "a.cpp"), "/src/a.cpp");
+  const auto B = rn::hashConfiguration(command("-DX", "b.cpp"), "/src/b.cpp");
+  const auto C = rn::hashConfiguration(command("-DY", "a.cpp"), "/src/a.cpp");
+  EXPECT_EQ(A, B);
+  EXPECT_NE(A, C);
+
+  rn::HeaderClaims Claims;
+  EXPECT_TRUE(Claims.claim("/src/a.h", A));
+  EXPECT_FALSE(Claims.claim("/src/a.h", B));
+  EXPECT_TRUE(Claims.claim("/src/a.h", C));
+  EXPECT_TRUE(Claims.claim("/src/b.h", A));
+}
+
+TEST(Server, RequestID) {
+  FixedCompilationDatabase Compilations(".", vector<string>());
+  rn::RenameServer Server(Compilations, {}, 1);
+  auto reply = [&](llvm::StringRef Request) {
+    string Reply;
+    llvm::raw_string_ostream OS(Reply);
+    EXPECT_TRUE(Server.handle(Request, OS));
+    return OS.str();
+  };
+  EXPECT_EQ("{\"id\": 7, \"error\": \"unknown command 'x'\"}\n",
+            reply("{\"id\": 007, \"command\": \"x\"}"));
+  EXPECT_EQ("{\"id\": \"7\", \"error\": \"unknown command 'x'\"}\n",
+            reply("{\"id\": \"7\", \"command\": \"x\"}"));
+  EXPECT_EQ("{\"id\": \"a\\\"b\", \"error\": \"unknown command 'x'\"}\n",
+            reply("{\"id\": \"a\\\"b\", \"command\": \"x\"}"));
+}
+
+TEST(Batch, ParseRenameList) {
+  vector<rn::SymbolData> Symbols;
+  EXPECT_EQ("", rn::parseRenameList("# migration\n"
+                                    "src/a.cpp:12:5 newName\n"
+                                    "\n"
+                                    "  usr:c:@S@Point  Pt\n",
+                                    Symbols));
+  ASSERT_EQ(2u, Symbols.size());
+  EXPECT_EQ("src/a.cpp", Symbols[0].File);
+  EXPECT_EQ(12u, Symbols[0].Line);
+  EXPECT_EQ(5u, Symbols[0].Column);
+  EXPECT_EQ("newName", Symbols[0].NewSpelling);
+  EXPECT_EQ("c:@S@Point", Symbols[1].USR);
+  EXPECT_EQ("Pt", Symbols[1].NewSpelling);
+
+  EXPECT_NE("", rn::parseRenameList("src/a.cpp:12 newName\n", Symbols));
+  EXPECT_NE("", rn::parseRenameList("src/a.cpp:12:5\n", Symbols));
+
+  Symbols.clear();
+  rn::parseRenameList("usr:c:@F@f# g\nusr:c:@F@f# g\n", Symbols);
+  EXPECT_EQ("", rn::removeDuplicateSymbols(Symbols));
+  EXPECT_EQ(1u, Symbols.size());
+  rn::parseRenameList("usr:c:@F@f# h\n", Symbols);
+  EXPECT_NE("", rn::removeDuplicateSymbols(Symbols));
+}
+
+TEST(Rules, CaseStyle) {
+  using rn::CaseStyle;
+  EXPECT_EQ("HttpServer",
+            rn::applyCaseStyle("HTTPServer", CaseStyle::UpperCamel));
+  EXPECT_EQ("fooBarBaz",
+            rn::applyCaseStyle("foo_bar_baz", CaseStyle::LowerCamel));
+  EXPECT_EQ("foo_bar", rn::applyCaseStyle("fooBar", CaseStyle::Snake));
+  EXPECT_EQ("FOO_BAR", rn::applyCaseStyle("FooBar", CaseStyle::UpperSnake));
+  EXPECT_EQ("Red", rn::applyCaseStyle("RED", CaseStyle::UpperCamel));
+  EXPECT_EQ("m_x", rn::applyCaseStyle("m_x", CaseStyle::AsIs));
+}
+
+TEST(Rules, Parse) {
+  vector<rn::RenameRule> Rules;
+  EXPECT_EQ("", rn::parseRenameRules(
+                    "# drop the prefix\n"
+                    "ParmVarDecl m_(.*) \\1\n"
+                    "EnumConstant .* \\0 in X case UpperCamel\n",
+                    Rules));
+  ASSERT_EQ(2u, Rules.size());
+  EXPECT_EQ("ParmVar", Rules[0].Kind);
+  EXPECT_EQ("\\1", Rules[0].NewName);
+  EXPECT_EQ("EnumConstant", Rules[1].Kind);
+  EXPECT_EQ("X", Rules[1].Scope);
+  EXPECT_TRUE(Rules[1].Style == rn::CaseStyle::UpperCamel);
+
+  EXPECT_NE("", rn::parseRenameRules("ParmVarDecl m_(.*)\n", Rules));
+  EXPECT_NE("", rn::parseRenameRules("ParmVarDecl m_(.* \\1\n", Rules));
+  EXPECT_NE("", rn::parseRenameRules("ParmVarDecl .* x case Title\n", Rules));
+  EXPECT_NE("", rn::parseRenameRules("ParmDecl .* x\n", Rules));
+}
+
+TEST(Rules, RenameOverrides) {
+  vector<rn::RenameRule> Rules;
+  ASSERT_EQ("", rn::parseRenameRules(
+                    "CXXMethodDecl get(.*) \\1 in Base case lowerCamel\n"
+                    "FieldDecl m_(.*) \\1\n",
+                    Rules));
+  FixedCompilationDatabase Compilations(".", {"-std=c++11"});
+  const auto File = addPrefix("VirtualMethods.cpp");
+  clang::IgnoringDiagConsumer DiagConsumer;
+  Replacements Replaces;
+  ASSERT_EQ(0, rn::renameByRules(Compilations, {File}, Rules, 1,
+                                 &DiagConsumer, Replaces));
+
+  // The override isn't in Base, but keeps the name of the method it overrides
+  EXPECT_EQ("struct Base {\n"
+            "  virtual int value() const;\n"
+            "  int count;\n"
+            "};\n"
+            "\n"
+            "struct Derived : Base {\n"
+            "  int value() const override;\n"
+            "};\n"
+            "\n"
+            "int Derived::value() const { return count; }\n"
+            "\n"
+            "int use(const Base &B, const Derived &D) {\n"
+            "  return B.value() + D.value();\n"
+            "}\n",
+            applyAllReplacements(readFile(File), Replaces));
+}
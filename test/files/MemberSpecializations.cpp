@@ -0,0 +1,11 @@
+class A {
+  int m_x;
+  template <typename T> void f();
+  template <typename T> struct B;
+};
+
+template <> void A::f<int>() { m_x = 1; }
+
+template <> struct A::B<int> {
+  int g(A &a) { return a.m_x; }
+};
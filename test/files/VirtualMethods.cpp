@@ -0,0 +1,14 @@
+struct Base {
+  virtual int getValue() const;
+  int m_count;
+};
+
+struct Derived : Base {
+  int getValue() const override;
+};
+
+int Derived::getValue() const { return m_count; }
+
+int use(const Base &B, const Derived &D) {
+  return B.getValue() + D.getValue();
+}